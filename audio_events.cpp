@@ -0,0 +1,144 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// audio_events.cpp
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "audio_events.h"
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// writable_event                                                   //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+void writable_event::notify(size_t available)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        available_ = available;
+    }
+    cv_.notify_all();
+}
+
+bool writable_event::wait(size_t count)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [&] { return closed_ || available_ >= count; });
+    return !closed_;
+}
+
+bool writable_event::wait_for(size_t count, std::chrono::milliseconds timeout)
+{
+    // steady_clock overflows on very large timeouts, treat them as no timeout
+
+    if (timeout >= std::chrono::hours(24 * 365))
+    {
+        return wait(count);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    bool ready = cv_.wait_for(lock, timeout, [&] { return closed_ || available_ >= count; });
+    return ready && !closed_;
+}
+
+size_t writable_event::available() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return available_;
+}
+
+void writable_event::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+    }
+    cv_.notify_all();
+}
+
+bool writable_event::closed() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return closed_;
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// render_chunk_size                                                //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+size_t render_chunk_size(render_profile profile, int sample_rate, stream_timing timing)
+{
+    // Number of samples per write to the audio stream
+    //
+    //   - balanced: one device period, or 10 ms at the stream rate
+    //   - low_latency: 2 ms, or the device period when it is shorter
+    //   - high_throughput: the whole device buffer, or 1 s of audio when there is no device
+
+    //
+    // A chunk never exceeds the device buffer, a write larger than the
+    // stream can hold would never find enough free space
+
+    auto samples = [sample_rate](size_t ms) {
+        return (std::max)(static_cast<size_t>(sample_rate) * ms / 1000, size_t(1));
+    };
+
+    size_t chunk;
+
+    switch (profile)
+    {
+        case render_profile::low_latency:
+            chunk = samples(2);
+            if (timing.period_size > 0)
+            {
+                chunk = (std::min)(chunk, timing.period_size);
+            }
+            break;
+        case render_profile::high_throughput:
+            chunk = timing.buffer_size > 0 ? timing.buffer_size : samples(1000);
+            break;
+        case render_profile::balanced:
+        default:
+            chunk = timing.period_size > 0 ? timing.period_size : samples(10);
+            break;
+    }
+
+    if (timing.buffer_size > 0)
+    {
+        chunk = (std::min)(chunk, timing.buffer_size);
+    }
+
+    return chunk;
+}
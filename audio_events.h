@@ -0,0 +1,301 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// audio_events.h
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstddef>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <optional>
+#include <cmath>
+#include <cstdint>
+#include <atomic>
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// writable_event                                                   //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Writable space notification for audio streams
+//
+// The side that drains the stream, ex: the device callback or writer thread,
+// publishes the free space with notify(), writers block in wait_for()
+// until enough space is free, instead of sleeping and polling
+
+struct writable_event
+{
+    void notify(size_t available);
+    bool wait(size_t count);
+    bool wait_for(size_t count, std::chrono::milliseconds timeout);
+    size_t available() const;
+    void close();
+    bool closed() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t available_ = 0;
+    bool closed_ = false;
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// audio_stream_events                                              //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Optional interface for audio streams that can signal writable space
+//
+// Streams implement it alongside audio_stream, the modem discovers it
+// and blocks on it instead of sleep-polling when a write returns short
+
+struct audio_stream_events
+{
+    virtual ~audio_stream_events() = default;
+
+    // Blocks until count samples can be written or the timeout elapses
+    // Returns false on timeout or when the stream is closed
+    virtual bool wait_write(size_t count, std::chrono::milliseconds timeout) = 0;
+};
+
+// What the writer does when the wait for writable space times out,
+// same as write_concurrency_timeout_action in settings.json
+
+enum class write_timeout_policy
+{
+    block,
+    drop
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// audio_stream_timing                                              //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Device period and buffer size, in samples, 0 when unknown
+
+struct stream_timing
+{
+    size_t period_size = 0;
+    size_t buffer_size = 0;
+};
+
+// Optional interface for audio streams backed by a device with a fixed period,
+// ex: the ALSA period or the WASAPI device period
+
+struct audio_stream_timing
+{
+    virtual ~audio_stream_timing() = default;
+
+    virtual stream_timing timing() const = 0;
+};
+
+enum class render_profile
+{
+    balanced,        // One device period per write, 10 ms when unknown
+    low_latency,     // 2 ms writes or less, for push-to-talk responsiveness
+    high_throughput  // Large writes, for file rendering
+};
+
+template<typename Stream>
+inline stream_timing get_stream_timing(const Stream& stream)
+{
+    if constexpr (std::is_base_of_v<audio_stream_timing, Stream>)
+    {
+        return stream.timing();
+    }
+    else if constexpr (std::is_polymorphic_v<Stream>)
+    {
+        if (auto* t = dynamic_cast<const audio_stream_timing*>(&stream))
+        {
+            return t->timing();
+        }
+    }
+
+    return {};
+}
+
+size_t render_chunk_size(render_profile profile, int sample_rate, stream_timing timing);
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// wait_writable                                                    //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+template<typename Stream>
+inline bool wait_writable(Stream& stream, size_t count, std::chrono::milliseconds timeout)
+{
+    // Streams implementing audio_stream_events block on their event until
+    // enough space is free, the others are polled at 1 ms
+    // Returns false when the wait timed out or the stream was closed
+
+    if constexpr (std::is_base_of_v<audio_stream_events, Stream>)
+    {
+        return stream.wait_write(count, timeout);
+    }
+    else if constexpr (std::is_polymorphic_v<Stream>)
+    {
+        if (auto* events = dynamic_cast<audio_stream_events*>(&stream))
+        {
+            return events->wait_write(count, timeout);
+        }
+    }
+
+    if (timeout <= std::chrono::milliseconds(0))
+    {
+        return false;
+    }
+
+    std::this_thread::sleep_for((std::min)(timeout, std::chrono::milliseconds(1)));
+
+    return true;
+}
+
+// Streams that tell a short write the caller retries apart from a
+// dropping one, ex: spsc_audio_ring::try_write, only real drops count
+
+template<typename Stream, typename = void>
+struct has_try_write : std::false_type
+{
+};
+
+template<typename Stream>
+struct has_try_write<Stream, std::void_t<decltype(std::declval<Stream&>().try_write(std::declval<const double*>(), size_t()))>> : std::true_type
+{
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// write_audio                                                      //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+template<typename Stream>
+inline size_t write_audio(Stream& stream, const double* samples, size_t count, size_t chunk_size, double timeout_ms = 0.0, write_timeout_policy policy = write_timeout_policy::block, const std::atomic<bool>* cancel = nullptr)
+{
+    // Writes the samples in chunk_size pieces
+    // Returns the number of samples written, less than count when the
+    // rest was dropped on timeout, timeout_ms = 0 waits forever
+    // When cancel is set, the write gives up within 10 ms of it turning true
+
+    using std::chrono::milliseconds;
+
+    const bool has_timeout = timeout_ms > 0.0;
+    const milliseconds timeout(static_cast<int64_t>(std::ceil(timeout_ms)));
+
+    std::optional<std::chrono::steady_clock::time_point> blocked_since;
+
+    // Wake up as soon as one device period is free, or any space when the
+    // period is unknown, and write what fits
+    // Waiting for a whole chunk never returns when the stream is smaller than the chunk
+
+    const size_t wait_size = (std::max)(get_stream_timing(stream).period_size, size_t(1));
+
+    size_t pos = 0;
+    while (pos < count)
+    {
+        if (cancel != nullptr && cancel->load())
+        {
+            return pos;
+        }
+
+        size_t remaining = count - pos;
+        size_t to_write = (std::min)(chunk_size, remaining);
+        size_t written = 0;
+        if constexpr (has_try_write<Stream>::value)
+        {
+            written = stream.try_write(&samples[pos], to_write);
+        }
+        else
+        {
+            written = stream.write(&samples[pos], to_write);
+        }
+        if (written > 0)
+        {
+            pos += written;
+            blocked_since.reset();
+            continue;
+        }
+
+        // Buffer full, block until the stream has room again
+        // Streams implementing audio_stream_events wake us up as soon as
+        // space is free, the others are polled
+
+        auto now = std::chrono::steady_clock::now();
+        if (!blocked_since)
+        {
+            blocked_since = now;
+        }
+
+        milliseconds waited = std::chrono::duration_cast<milliseconds>(now - *blocked_since);
+
+        if (has_timeout && waited >= timeout)
+        {
+            if (policy == write_timeout_policy::drop)
+            {
+                // Drop the rest of the frame, same as write_concurrency_timeout_action: drop
+                return pos;
+            }
+
+            blocked_since = now;
+            waited = milliseconds(0);
+        }
+
+        milliseconds wait = has_timeout ? timeout - waited : milliseconds::max();
+        if (cancel != nullptr)
+        {
+            wait = (std::min)(wait, milliseconds(10));
+        }
+
+        wait_writable(stream, (std::min)(to_write, wait_size), wait);
+    }
+
+    return pos;
+}
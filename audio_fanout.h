@@ -0,0 +1,251 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// audio_fanout.h
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <optional>
+
+#include "audio_events.h"
+#include "dsp.h"
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// audio_frame                                                      //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// One rendered transmission, immutable and shared by every output,
+// at the modulator sample rate
+// The buffer is freed when the last sink is done with it
+
+using audio_frame = std::shared_ptr<const std::vector<double>>;
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// audio_sink                                                       //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Feeds rendered frames to one output audio stream from its own thread
+//
+//   - push() never blocks, the frame is queued by reference, not copied
+//   - Frames at another rate than the stream are converted on the sink
+//     thread, with a resampler owned by the sink, ex: a 48 kHz modulator
+//     feeding a 44.1 kHz ALSA device
+//   - Every sink drains at the pace of its own stream, a slow stream,
+//     ex: a WAV file on a slow disk, only backs up its own queue
+//   - When the queue holds max_pending frames, new frames are dropped
+//     for this sink only and counted in dropped_frames()
+//   - Writes follow the modem write timeout, drop policy and render profile,
+//     see configure()
+//   - The destructor discards the queued frames and cancels the write in
+//     progress, a stuck device does not hold up the modem teardown
+
+template<typename Stream>
+struct audio_sink
+{
+    audio_sink(Stream& stream, size_t max_pending = 8, double write_timeout_ms = 0.0, write_timeout_policy policy = write_timeout_policy::block, render_profile profile = render_profile::balanced);
+    ~audio_sink();
+
+    audio_sink(const audio_sink&) = delete;
+    audio_sink& operator=(const audio_sink&) = delete;
+
+    bool push(audio_frame frame, int sample_rate);
+    void flush();
+    void configure(double write_timeout_ms, write_timeout_policy policy, render_profile profile);
+
+    Stream& stream();
+    uint64_t dropped_frames() const;
+
+private:
+    struct pending_frame
+    {
+        audio_frame frame;
+        int sample_rate;
+    };
+
+    void run();
+
+    Stream& stream_;
+    size_t max_pending_;
+    double write_timeout_ms_;
+    write_timeout_policy policy_;
+    render_profile profile_;
+    std::deque<pending_frame> queue_;
+    std::optional<polyphase_resampler> resampler_; // Sink thread only, set once a frame rate differs from the stream
+    std::vector<double> resampled_;               // Sink thread only
+    bool busy_ = false;
+    bool stop_ = false;
+    uint64_t dropped_frames_ = 0;
+    std::atomic<bool> cancel_ = false;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread thread_;
+};
+
+template<typename Stream>
+inline audio_sink<Stream>::audio_sink(Stream& stream, size_t max_pending, double write_timeout_ms, write_timeout_policy policy, render_profile profile) : stream_(stream), max_pending_(max_pending), write_timeout_ms_(write_timeout_ms), policy_(policy), profile_(profile)
+{
+    thread_ = std::thread([this] { run(); });
+}
+
+template<typename Stream>
+inline audio_sink<Stream>::~audio_sink()
+{
+    // Queued frames are dropped, and the frame being written is cut short
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        queue_.clear();
+        cancel_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+template<typename Stream>
+inline bool audio_sink<Stream>::push(audio_frame frame, int sample_rate)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queue_.size() >= max_pending_)
+        {
+            dropped_frames_++;
+            return false;
+        }
+        queue_.push_back({ std::move(frame), sample_rate });
+    }
+    cv_.notify_all();
+    return true;
+}
+
+template<typename Stream>
+inline void audio_sink<Stream>::flush()
+{
+    // Blocks until every queued frame was written
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return queue_.empty() && !busy_; });
+}
+
+template<typename Stream>
+inline void audio_sink<Stream>::configure(double write_timeout_ms, write_timeout_policy policy, render_profile profile)
+{
+    // Applies from the next frame
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    write_timeout_ms_ = write_timeout_ms;
+    policy_ = policy;
+    profile_ = profile;
+}
+
+template<typename Stream>
+inline Stream& audio_sink<Stream>::stream()
+{
+    return stream_;
+}
+
+template<typename Stream>
+inline uint64_t audio_sink<Stream>::dropped_frames() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dropped_frames_;
+}
+
+template<typename Stream>
+inline void audio_sink<Stream>::run()
+{
+    const stream_timing timing = get_stream_timing(stream_);
+    const int stream_sample_rate = stream_.sample_rate();
+
+    while (true)
+    {
+        audio_frame frame;
+        int sample_rate;
+        double write_timeout_ms;
+        write_timeout_policy policy;
+        size_t chunk_size;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (queue_.empty())
+            {
+                return;
+            }
+            frame = std::move(queue_.front().frame);
+            sample_rate = queue_.front().sample_rate;
+            queue_.pop_front();
+            busy_ = true;
+            write_timeout_ms = write_timeout_ms_;
+            policy = policy_;
+            chunk_size = render_chunk_size(profile_, stream_sample_rate, timing);
+        }
+
+        const std::vector<double>* samples = frame.get();
+
+        if (sample_rate != stream_sample_rate)
+        {
+            if (!resampler_ || resampler_->input_sample_rate() != sample_rate)
+            {
+                resampler_.emplace(sample_rate, stream_sample_rate);
+            }
+
+            resample_frame(*resampler_, *frame, resampled_);
+            samples = &resampled_;
+        }
+
+        write_audio(stream_, samples->data(), samples->size(), chunk_size, write_timeout_ms, policy, &cancel_);
+
+        frame.reset();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            busy_ = false;
+        }
+        cv_.notify_all();
+    }
+}
@@ -0,0 +1,536 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// audio_ring.cpp
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "audio_ring.h"
+
+#include <algorithm>
+#include <cstring>
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// spsc_audio_ring                                                  //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+spsc_audio_ring::spsc_audio_ring(size_t capacity)
+{
+    size_t size = 1;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+
+    buffer_.resize(size);
+    mask_ = size - 1;
+}
+
+size_t spsc_audio_ring::write(const double* samples, size_t count)
+{
+    // What does not fit is dropped, counted as overrun
+
+    const size_t n = try_write(samples, count);
+
+    if (n < count)
+    {
+        overruns_.fetch_add(count - n, std::memory_order_relaxed);
+    }
+
+    return n;
+}
+
+size_t spsc_audio_ring::try_write(const double* samples, size_t count)
+{
+    // Writes what fits, the caller keeps the rest and retries
+
+    const size_t write_index = write_index_.load(std::memory_order_relaxed);
+
+    // Only reload the consumer index when the cached view looks full
+
+    size_t free = buffer_.size() - (write_index - cached_read_index_);
+    if (free < count)
+    {
+        cached_read_index_ = read_index_.load(std::memory_order_acquire);
+        free = buffer_.size() - (write_index - cached_read_index_);
+    }
+
+    const size_t n = (std::min)(count, free);
+
+    // Copy in at most two pieces, before and after the wrap
+
+    const size_t start = write_index & mask_;
+    const size_t first = (std::min)(n, buffer_.size() - start);
+
+    std::memcpy(&buffer_[start], samples, first * sizeof(double));
+    std::memcpy(&buffer_[0], samples + first, (n - first) * sizeof(double));
+
+    write_index_.store(write_index + n, std::memory_order_release);
+
+    return n;
+}
+
+template<typename Op>
+size_t spsc_audio_ring::consume(double* samples, size_t count, Op op)
+{
+    const size_t read_index = read_index_.load(std::memory_order_relaxed);
+
+    size_t available = cached_write_index_ - read_index;
+    if (available < count)
+    {
+        cached_write_index_ = write_index_.load(std::memory_order_acquire);
+        available = cached_write_index_ - read_index;
+    }
+
+    const size_t n = (std::min)(count, available);
+
+    if (n < count)
+    {
+        underruns_.fetch_add(count - n, std::memory_order_relaxed);
+    }
+
+    const size_t start = read_index & mask_;
+    const size_t first = (std::min)(n, buffer_.size() - start);
+
+    op(samples, &buffer_[start], first);
+    op(samples + first, &buffer_[0], n - first);
+
+    read_index_.store(read_index + n, std::memory_order_release);
+
+    // Wake a producer blocked in wait_write(), the fence orders the store
+    // above before the flag load, it pairs with the fence in wait_write()
+    // Only atomics and the semaphore release, never a lock the producer holds
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (n > 0 && producer_waiting_.load(std::memory_order_relaxed) && producer_waiting_.exchange(false, std::memory_order_acq_rel))
+    {
+        writable_.release();
+    }
+
+    return n;
+}
+
+size_t spsc_audio_ring::read(double* samples, size_t count)
+{
+    return consume(samples, count, [](double* out, const double* in, size_t n) {
+        std::memcpy(out, in, n * sizeof(double));
+    });
+}
+
+size_t spsc_audio_ring::read_add(double* samples, size_t count)
+{
+    // Sums into the output instead of overwriting it, used by the mixer
+
+    return consume(samples, count, [](double* out, const double* in, size_t n) {
+        for (size_t i = 0; i < n; i++)
+        {
+            out[i] += in[i];
+        }
+    });
+}
+
+bool spsc_audio_ring::wait_write(size_t count, std::chrono::milliseconds timeout)
+{
+    // Producer side, blocks until count samples are free or the timeout elapses
+    // Raise the flag, then check again, space freed before the consumer saw
+    // the flag is not missed
+    // The consumer releases the semaphore once per raised flag, when the
+    // producer lowers the flag itself and finds it already taken, the
+    // release is on its way and is consumed here, no stale wake up is left
+
+    using std::chrono::steady_clock;
+
+    count = (std::min)(count, buffer_.size());
+
+    // steady_clock overflows on very large timeouts, treat them as no timeout
+
+    const bool forever = timeout >= std::chrono::hours(24 * 365);
+    const steady_clock::time_point deadline = forever ? steady_clock::time_point::max() : steady_clock::now() + timeout;
+
+    auto lower_flag = [&] {
+        if (!producer_waiting_.exchange(false, std::memory_order_acq_rel))
+        {
+            writable_.acquire();
+        }
+    };
+
+    while (true)
+    {
+        producer_waiting_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (available_write() >= count)
+        {
+            lower_flag();
+            return true;
+        }
+
+        if (forever)
+        {
+            writable_.acquire();
+        }
+        else if (!writable_.try_acquire_until(deadline))
+        {
+            lower_flag();
+            return available_write() >= count;
+        }
+    }
+}
+
+size_t spsc_audio_ring::available_read() const
+{
+    return write_index_.load(std::memory_order_acquire) - read_index_.load(std::memory_order_acquire);
+}
+
+size_t spsc_audio_ring::available_write() const
+{
+    return buffer_.size() - available_read();
+}
+
+size_t spsc_audio_ring::capacity() const
+{
+    return buffer_.size();
+}
+
+uint64_t spsc_audio_ring::overruns() const
+{
+    return overruns_.load(std::memory_order_relaxed);
+}
+
+uint64_t spsc_audio_ring::underruns() const
+{
+    return underruns_.load(std::memory_order_relaxed);
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// audio_ring_mixer                                                 //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+audio_ring_mixer::audio_ring_mixer(size_t ring_capacity) : ring_capacity_(ring_capacity)
+{
+}
+
+spsc_audio_ring* audio_ring_mixer::add_producer()
+{
+    std::lock_guard<std::mutex> lock(add_mutex_);
+
+    size_t index = producer_count_.load(std::memory_order_relaxed);
+    if (index == max_producers)
+    {
+        return nullptr;
+    }
+
+    rings_[index] = std::make_unique<spsc_audio_ring>(ring_capacity_);
+
+    // Publish the ring, mix() only looks at rings below producer_count_
+    producer_count_.store(index + 1, std::memory_order_release);
+
+    return rings_[index].get();
+}
+
+size_t audio_ring_mixer::producers() const
+{
+    return producer_count_.load(std::memory_order_acquire);
+}
+
+void audio_ring_mixer::mix(double* samples, size_t count)
+{
+    // Idle producers are silence, only a producer that has started writing
+    // and can't keep up counts as an underrun
+
+    std::fill(samples, samples + count, 0.0);
+
+    const size_t producers = producer_count_.load(std::memory_order_acquire);
+
+    for (size_t i = 0; i < producers; i++)
+    {
+        spsc_audio_ring& ring = *rings_[i];
+        if (ring.available_read() > 0)
+        {
+            ring.read_add(samples, count);
+        }
+    }
+}
+
+uint64_t audio_ring_mixer::overruns() const
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < producers(); i++)
+    {
+        total += rings_[i]->overruns();
+    }
+    return total;
+}
+
+uint64_t audio_ring_mixer::underruns() const
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < producers(); i++)
+    {
+        total += rings_[i]->underruns();
+    }
+    return total;
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// broadcast_audio_ring                                             //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+broadcast_audio_ring::broadcast_audio_ring(size_t capacity)
+{
+    size_t size = 1;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+
+    buffer_.resize(2 * size);
+    capacity_ = size;
+    mask_ = size - 1;
+}
+
+void broadcast_audio_ring::write(const double* samples, size_t count)
+{
+    const uint64_t write_index = write_index_.load(std::memory_order_relaxed);
+
+    // Only the last capacity samples of a larger write survive
+
+    const size_t skip = count > capacity_ ? count - capacity_ : 0;
+    const size_t n = count - skip;
+    samples += skip;
+
+    // Copy in at most two pieces, before and after the wrap, each to both halves
+
+    const size_t start = static_cast<size_t>((write_index + skip) & mask_);
+    const size_t first = (std::min)(n, capacity_ - start);
+
+    std::memcpy(&buffer_[start], samples, first * sizeof(double));
+    std::memcpy(&buffer_[start + capacity_], samples, first * sizeof(double));
+    std::memcpy(&buffer_[0], samples + first, (n - first) * sizeof(double));
+    std::memcpy(&buffer_[capacity_], samples + first, (n - first) * sizeof(double));
+
+    write_index_.store(write_index + count, std::memory_order_release);
+}
+
+size_t broadcast_audio_ring::capacity() const
+{
+    return capacity_;
+}
+
+uint64_t broadcast_audio_ring::position() const
+{
+    return write_index_.load(std::memory_order_acquire);
+}
+
+uint64_t broadcast_audio_ring::dropped_readers() const
+{
+    return dropped_readers_.load(std::memory_order_relaxed);
+}
+
+size_t broadcast_ring_capacity(int sample_rate, double overrun_read_buffer_size_ms)
+{
+    return (std::max)(static_cast<size_t>(sample_rate * overrun_read_buffer_size_ms / 1000.0), size_t(1));
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// broadcast_audio_reader                                           //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+broadcast_audio_reader::broadcast_audio_reader(const broadcast_audio_ring& ring) : ring_(ring), cursor_(ring.position())
+{
+}
+
+const double* broadcast_audio_reader::peek(size_t& count)
+{
+    // Returns up to count samples in place, count is updated with the block size
+
+    if (check_overrun())
+    {
+        count = 0;
+        return nullptr;
+    }
+
+    count = (std::min)(count, available());
+
+    return &ring_.buffer_[static_cast<size_t>(cursor_ & ring_.mask_)];
+}
+
+bool broadcast_audio_reader::consume(size_t count)
+{
+    // Advance past a block returned by peek
+    // Returns false when the writer overwrote the block while it was in use
+
+    if (check_overrun())
+    {
+        return false;
+    }
+
+    cursor_ += (std::min)(count, available());
+
+    return true;
+}
+
+size_t broadcast_audio_reader::available() const
+{
+    if (dropped_)
+    {
+        return 0;
+    }
+
+    return static_cast<size_t>(ring_.position() - cursor_);
+}
+
+bool broadcast_audio_reader::dropped() const
+{
+    return dropped_;
+}
+
+uint64_t broadcast_audio_reader::position() const
+{
+    return cursor_;
+}
+
+void broadcast_audio_reader::seek(uint64_t position)
+{
+    // Moves the cursor, ex: to re-sync a dropped reader at the write position
+    // The reader is dropped again on the next access if position was already overwritten
+
+    cursor_ = position;
+    dropped_ = false;
+}
+
+bool broadcast_audio_reader::check_overrun()
+{
+    // Lagging more than the capacity means the writer lapped this reader
+
+    if (!dropped_ && ring_.position() - cursor_ > ring_.capacity_)
+    {
+        dropped_ = true;
+        ring_.dropped_readers_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return dropped_;
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// rx_front_end                                                     //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+rx_front_end::rx_front_end(int sample_rate, int decimation, double overrun_read_buffer_size_ms) :
+    sample_rate_(sample_rate / decimation),
+    ring_(broadcast_ring_capacity(sample_rate / decimation, overrun_read_buffer_size_ms))
+{
+    if (decimation > 1)
+    {
+        decimator_.emplace(decimation);
+    }
+}
+
+void rx_front_end::write(const double* samples, size_t count)
+{
+    if (!decimator_.has_value())
+    {
+        ring_.write(samples, count);
+        return;
+    }
+
+    buffer_.clear();
+    decimator_->process(samples, count, buffer_);
+    ring_.write(buffer_.data(), buffer_.size());
+}
+
+const broadcast_audio_ring& rx_front_end::ring() const
+{
+    return ring_;
+}
+
+int rx_front_end::sample_rate() const
+{
+    return sample_rate_;
+}
+
+size_t rx_front_end::delay() const
+{
+    // Decimation filter delay, in decimated samples
+    return decimator_.has_value() ? decimator_->delay() : 0;
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// energy_gate                                                      //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+energy_gate::energy_gate(const broadcast_audio_ring& ring, int sample_rate, double lookback_ms, double threshold_db, double hang_ms) :
+    ring_(ring),
+    detector_(sample_rate, 5.0, threshold_db, hang_ms),
+    detector_reader_(ring),
+    reader_(ring),
+    lookback_(static_cast<size_t>(sample_rate * lookback_ms / 1000.0)),
+    detector_block_((std::max)(static_cast<size_t>(sample_rate * 0.005), size_t(1)))
+{
+}
+
+bool energy_gate::active() const
+{
+    return detector_.detected();
+}
+
+uint64_t energy_gate::skipped() const
+{
+    return skipped_;
+}
+
+uint64_t energy_gate::resyncs() const
+{
+    return resyncs_;
+}
+
@@ -0,0 +1,381 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// audio_ring.h
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <vector>
+#include <optional>
+#include <algorithm>
+
+#include "dsp.h"
+#include "audio_events.h"
+
+// Keeps the producer and consumer indices on separate cache lines,
+// otherwise every write invalidates the reader's line and vice versa
+
+constexpr size_t audio_ring_cache_line_size = 64;
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// spsc_audio_ring                                                  //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Lock-free single-producer single-consumer sample ring
+//
+//   - write() is called only from the producer, ex: the modem render thread
+//   - read() is called only from the consumer, ex: the realtime device callback
+//   - Neither side ever blocks or allocates, a full ring drops the excess
+//     samples (overrun), an empty ring returns short (underrun)
+//   - A producer that must not drop writes with try_write(), which does
+//     not count the rest as overrun, and waits in wait_write() for the
+//     consumer to free space, ex: write_audio, the consumer wakes it with
+//     a lock-free semaphore release, the realtime side never takes a lock
+//
+// The capacity is rounded up to a power of two, indices grow monotonically
+// and are masked on access
+
+struct spsc_audio_ring : public audio_stream_events
+{
+    spsc_audio_ring(size_t capacity = 8192);
+
+    size_t write(const double* samples, size_t count);
+    size_t try_write(const double* samples, size_t count);
+    size_t read(double* samples, size_t count);
+    size_t read_add(double* samples, size_t count);
+
+    bool wait_write(size_t count, std::chrono::milliseconds timeout) override;
+
+    size_t available_read() const;
+    size_t available_write() const;
+    size_t capacity() const;
+
+    uint64_t overruns() const;
+    uint64_t underruns() const;
+
+private:
+    template<typename Op>
+    size_t consume(double* samples, size_t count, Op op);
+
+    std::vector<double> buffer_;
+    size_t mask_;
+
+    // Producer owned
+    alignas(audio_ring_cache_line_size) std::atomic<size_t> write_index_ = 0;
+    size_t cached_read_index_ = 0;      // Producer's last view of read_index_, avoids touching the consumer line on every write
+    std::atomic<uint64_t> overruns_ = 0;
+
+    // Consumer owned
+    alignas(audio_ring_cache_line_size) std::atomic<size_t> read_index_ = 0;
+    size_t cached_write_index_ = 0;     // Consumer's last view of write_index_
+    std::atomic<uint64_t> underruns_ = 0;
+
+    // Set by the producer while it waits in wait_write(), the consumer
+    // clears it and releases the semaphore, at most one release per wait
+    alignas(audio_ring_cache_line_size) std::atomic<bool> producer_waiting_ = false;
+    std::binary_semaphore writable_{ 0 };
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// audio_ring_mixer                                                 //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Multi-producer mixer for audio streams shared by several modulators
+//
+// Replaces write_concurrency: mutex, every producer gets its own
+// spsc_audio_ring, the consumer sums the rings in mix()
+// No producer ever contends with another one, and the device callback
+// never waits on a modulator thread
+//
+// add_producer() is not realtime safe, call it during setup
+// The rings live as long as the mixer
+
+struct audio_ring_mixer
+{
+    static constexpr size_t max_producers = 16;
+
+    audio_ring_mixer(size_t ring_capacity = 8192);
+
+    spsc_audio_ring* add_producer();
+    size_t producers() const;
+
+    void mix(double* samples, size_t count);
+
+    uint64_t overruns() const;
+    uint64_t underruns() const;
+
+private:
+    size_t ring_capacity_;
+    std::array<std::unique_ptr<spsc_audio_ring>, max_producers> rings_;
+    std::atomic<size_t> producer_count_ = 0;
+    std::mutex add_mutex_; // Serializes add_producer only, never taken by mix
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// broadcast_audio_ring                                             //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Single-writer multi-reader ring over one capture stream
+//
+// One input audio stream feeds several demodulators, ex: several slicers,
+// 1200 and 300 baud, FX.25 and plain AX.25, without copying the samples
+//
+//   - The writer never waits for the readers, old samples are overwritten
+//   - Every reader keeps its own cursor, see broadcast_audio_reader
+//   - Samples are stored twice, so any window up to the capacity is
+//     contiguous and readers process blocks in place
+//   - A reader that falls more than the capacity behind has lost samples,
+//     it is dropped rather than the buffer growing
+//   - The capacity is rounded up to a power of two, same as spsc_audio_ring,
+//     positions grow monotonically and are masked on access
+//
+// Size the capacity from overrun_read_buffer_size_ms, see broadcast_ring_capacity
+
+struct broadcast_audio_ring
+{
+    broadcast_audio_ring(size_t capacity = 48000);
+
+    void write(const double* samples, size_t count);
+
+    size_t capacity() const;
+    uint64_t position() const;
+    uint64_t dropped_readers() const;
+
+private:
+    friend struct broadcast_audio_reader;
+
+    std::vector<double> buffer_; // 2 * capacity, mirrored
+    size_t capacity_;
+    size_t mask_;
+    alignas(audio_ring_cache_line_size) std::atomic<uint64_t> write_index_ = 0;
+    alignas(audio_ring_cache_line_size) mutable std::atomic<uint64_t> dropped_readers_ = 0; // Updated by the readers
+};
+
+size_t broadcast_ring_capacity(int sample_rate, double overrun_read_buffer_size_ms);
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// broadcast_audio_reader                                           //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Reader cursor over a broadcast_audio_ring, one per demodulator
+//
+// peek() returns a pointer into the ring, the block stays valid until the
+// writer laps it, consume() then reports whether the block was overwritten
+// while in use. A reader starts at the current write position
+// A dropped reader stays dropped until seek() moves it back into the ring
+
+struct broadcast_audio_reader
+{
+    broadcast_audio_reader(const broadcast_audio_ring& ring);
+
+    const double* peek(size_t& count);
+    bool consume(size_t count);
+
+    size_t available() const;
+    bool dropped() const;
+    uint64_t position() const;
+    void seek(uint64_t position);
+
+private:
+    bool check_overrun();
+
+    const broadcast_audio_ring& ring_;
+    uint64_t cursor_;
+    bool dropped_ = false;
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// rx_front_end                                                     //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Per input audio stream receive front end
+//
+// Capture -> fir_decimator -> broadcast_audio_ring -> demodulators
+//
+// The decimation runs once per capture, every demodulator on the channel
+// reads the decimated samples through its own broadcast_audio_reader
+// ex: 48 kHz / 4 = 12 kHz, enough for 1200 baud AFSK at a quarter of the CPU
+
+struct rx_front_end
+{
+    rx_front_end(int sample_rate = 48000, int decimation = 4, double overrun_read_buffer_size_ms = 1000.0);
+
+    void write(const double* samples, size_t count);
+
+    const broadcast_audio_ring& ring() const;
+    int sample_rate() const;
+    size_t delay() const;
+
+private:
+    int sample_rate_;            // Decimated sample rate
+    std::optional<fir_decimator> decimator_; // Not set when decimation is 1
+    broadcast_audio_ring ring_;
+    std::vector<double> buffer_; // Decimated samples, reused across calls
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// energy_gate                                                      //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Idles the demodulators of a channel while there is no signal
+//
+// The energy detector reads every sample of the ring, the demodulators
+// read through a second cursor:
+//
+//   - No signal: the demodulator cursor is moved forward without reading,
+//     it stays lookback samples behind the detector
+//   - Signal: the demodulators get everything from the lookback point on,
+//     so the preamble that preceded the detection is not lost
+//
+// The ring capacity must be larger than the lookback
+// When the writer laps the gate, ex: a stall longer than the ring capacity,
+// both cursors restart at the write position, see resyncs()
+
+struct energy_gate
+{
+    energy_gate(const broadcast_audio_ring& ring, int sample_rate = 48000, double lookback_ms = 200.0, double threshold_db = 6.0, double hang_ms = 100.0);
+
+    template<typename Process>
+    size_t process(Process&& process);
+
+    bool active() const;
+    uint64_t skipped() const;
+    uint64_t resyncs() const;
+
+private:
+    const broadcast_audio_ring& ring_;
+    energy_detector detector_;
+    broadcast_audio_reader detector_reader_;
+    broadcast_audio_reader reader_;
+    size_t lookback_;            // Samples kept behind the detector while idle
+    size_t detector_block_;      // Samples the detector advances at a time
+    uint64_t skipped_ = 0;       // Samples the demodulators never had to process
+    uint64_t resyncs_ = 0;       // Times the writer lapped the gate
+};
+
+template<typename Process>
+inline size_t energy_gate::process(Process&& process)
+{
+    // Calls process(const double* samples, size_t count) with the samples
+    // the demodulators need to see, returns the number of samples passed
+    // The detector advances one block at a time, a short burst between
+    // two calls still opens the gate
+
+    size_t passed = 0;
+
+    while (true)
+    {
+        if (detector_reader_.dropped() || reader_.dropped())
+        {
+            // Lapped by the writer, the samples in between are lost
+
+            uint64_t position = ring_.position();
+            detector_reader_.seek(position);
+            reader_.seek(position);
+            resyncs_++;
+        }
+
+        size_t count = (std::min)(detector_reader_.available(), detector_block_);
+        if (count == 0)
+        {
+            break;
+        }
+
+        const double* samples = detector_reader_.peek(count);
+        if (samples == nullptr)
+        {
+            continue;
+        }
+        detector_.process(samples, count);
+        if (!detector_reader_.consume(count))
+        {
+            continue;
+        }
+
+        // Samples between the demodulator cursor and the detector cursor,
+        // from the cursors themselves, the write position moves meanwhile
+
+        size_t behind = static_cast<size_t>(detector_reader_.position() - reader_.position());
+
+        if (!detector_.detected())
+        {
+            if (behind > lookback_ && reader_.consume(behind - lookback_))
+            {
+                skipped_ += behind - lookback_;
+            }
+            continue;
+        }
+
+        const double* gated = reader_.peek(behind);
+        if (gated == nullptr || behind == 0)
+        {
+            continue;
+        }
+
+        process(gated, behind);
+        if (reader_.consume(behind))
+        {
+            passed += behind;
+        }
+    }
+
+    return passed;
+}
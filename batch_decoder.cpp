@@ -0,0 +1,74 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// batch_decoder.cpp
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "batch_decoder.h"
+
+#include <algorithm>
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// decode_wav_file                                                  //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+size_t merge_decoded_frames(std::vector<decoded_frame>& frames, uint64_t dedup_window)
+{
+    // Segments finish in any order, sort by position, then drop the
+    // second copy of every frame decoded by two overlapping segments
+    // Returns the number of copies removed
+
+    std::stable_sort(frames.begin(), frames.end(), [](const decoded_frame& a, const decoded_frame& b) {
+        return a.position < b.position;
+    });
+
+    frame_dedup dedup(dedup_window);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        if (dedup.insert(frames[i].frame, frames[i].position))
+        {
+            if (kept != i)
+            {
+                frames[kept] = std::move(frames[i]);
+            }
+            kept++;
+        }
+    }
+
+    size_t removed = frames.size() - kept;
+    frames.resize(kept);
+
+    return removed;
+}
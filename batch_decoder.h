@@ -0,0 +1,166 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// batch_decoder.h
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+
+#include "decoder.h"
+#include "mapped_file.h"
+#include "wav_file.h"
+#include "work_stealing_pool.h"
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// decode_wav_file                                                  //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+struct batch_decoder_options
+{
+    double segment_seconds = 60.0;   // Audio per task
+    double overlap_seconds = 3.0;    // Extra audio decoded past the end of a segment, longer than the longest frame
+    double dedup_window_ms = 500.0;  // Same frame decoded by two segments within this window is reported once
+    size_t threads = 0;              // 0 = one per core
+    size_t block_size = 4096;        // Samples converted and demodulated at a time, sets the position resolution
+};
+
+struct decoded_frame
+{
+    uint64_t position = 0;           // Sample at the end of the block the frame was decoded in
+    std::vector<uint8_t> frame;      // AX.25 frame, CRC included
+};
+
+// Offline decoder for large recordings
+//
+//   - The WAV file is memory mapped, nothing is read upfront, every task
+//     converts its own samples straight from the mapping, one block at a time
+//   - The recording is split into segments, each segment is decoded past its
+//     end by the overlap, so a frame crossing a boundary is decoded whole by
+//     the segment it starts in
+//   - Segments are decoded on a work_stealing_pool, with a fresh demodulator
+//     and deframer each
+//   - Frames are sorted by position, the copies decoded twice in the
+//     overlaps are merged with frame_dedup, by CRC and position
+//
+// make_demodulator(sample_rate) returns a demodulator with
+// demodulate(const double*, size_t, std::vector<uint8_t>&) that returns
+// NRZI line bits, ex: pll_demodulator
+
+template<typename DemodulatorFactory>
+bool decode_wav_file(const std::string& path, DemodulatorFactory make_demodulator, std::vector<decoded_frame>& frames, const batch_decoder_options& options = {});
+
+size_t merge_decoded_frames(std::vector<decoded_frame>& frames, uint64_t dedup_window);
+
+template<typename DemodulatorFactory>
+inline bool decode_wav_file(const std::string& path, DemodulatorFactory make_demodulator, std::vector<decoded_frame>& frames, const batch_decoder_options& options)
+{
+    mapped_file file(path);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    wav_info info;
+    if (!parse_wav_header(file.data(), file.size(), info))
+    {
+        return false;
+    }
+
+    const size_t segment = (std::max)(size_t(1), static_cast<size_t>(options.segment_seconds * info.sample_rate));
+    const size_t overlap = static_cast<size_t>(options.overlap_seconds * info.sample_rate);
+    const size_t block_size = (std::max)(size_t(1), options.block_size);
+
+    std::mutex mutex;
+    std::vector<decoded_frame> found;
+
+    {
+        work_stealing_pool pool(options.threads);
+
+        for (size_t start = 0; start < info.frames; start += segment)
+        {
+            const size_t end = (std::min)(info.frames, start + segment + overlap);
+
+            pool.submit([&, start, end]() {
+                auto demodulator = make_demodulator(info.sample_rate);
+                hdlc_deframer deframer;
+
+                std::vector<double> samples(block_size);
+                std::vector<uint8_t> bits;
+                std::vector<std::vector<uint8_t>> block_frames;
+                std::vector<decoded_frame> segment_frames;
+
+                for (size_t pos = start; pos < end; pos += block_size)
+                {
+                    size_t count = (std::min)(block_size, end - pos);
+
+                    read_wav_samples(file.data(), info, pos, count, samples.data());
+
+                    bits.clear();
+                    block_frames.clear();
+
+                    demodulator.demodulate(samples.data(), count, bits);
+                    deframer.process(bits.data(), bits.size(), block_frames);
+
+                    for (std::vector<uint8_t>& frame : block_frames)
+                    {
+                        segment_frames.push_back({ static_cast<uint64_t>(pos + count), std::move(frame) });
+                    }
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                for (decoded_frame& f : segment_frames)
+                {
+                    found.push_back(std::move(f));
+                }
+            });
+        }
+
+        pool.wait();
+    }
+
+    merge_decoded_frames(found, static_cast<uint64_t>(info.sample_rate * options.dedup_window_ms / 1000.0));
+
+    for (decoded_frame& f : found)
+    {
+        frames.push_back(std::move(f));
+    }
+
+    return true;
+}
@@ -32,10 +32,13 @@
 #include "bitstream.h"
 
 #include <array>
+#include <cassert>
 #include <sstream>
 #include <iomanip>
 #include <iostream>
 #include <string>
+#include <map>
+#include <memory>
 
 extern "C" {
 #include <correct.h>
@@ -77,6 +80,28 @@ bool fx25_bitstream_converter_adapter::try_decode(const std::vector<uint8_t>& bi
     return converter.try_decode(bitstream, offset, p, read);
 }
 
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// il2p_bitstream_converter_adapter                                 //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+il2p_bitstream_converter_adapter::il2p_bitstream_converter_adapter(bool max_fec) : converter(max_fec)
+{
+}
+
+std::vector<uint8_t> il2p_bitstream_converter_adapter::encode(const aprs::router::packet& p, int preamble_flags, int postamble_flags) const
+{
+    return converter.encode(p, preamble_flags, postamble_flags);
+}
+
+bool il2p_bitstream_converter_adapter::try_decode(const std::vector<uint8_t>& bitstream, size_t offset, aprs::router::packet& p, size_t& read) const
+{
+    return converter.try_decode(bitstream, offset, p, read);
+}
+
 // **************************************************************** //
 //                                                                  //
 //                                                                  //
@@ -113,6 +138,66 @@ bool fx25_bitstream_converter::try_decode(const std::vector<uint8_t>& bitstream,
     return false;
 }
 
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// il2p_bitstream_converter                                         //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+il2p_bitstream_converter::il2p_bitstream_converter(bool max_fec) : max_fec_(max_fec)
+{
+}
+
+std::vector<uint8_t> il2p_bitstream_converter::encode(const aprs::router::packet& p, int preamble_flags, int postamble_flags) const
+{
+    return encode_il2p_bitstream(p, preamble_flags, postamble_flags, max_fec_);
+}
+
+bool il2p_bitstream_converter::try_decode(const std::vector<uint8_t>& bitstream, size_t offset, aprs::router::packet& p, size_t& read) const
+{
+    return try_decode_il2p_bitstream(bitstream, offset, p, read);
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// Reed-Solomon                                                     //
+//                                                                  //
+// get_reed_solomon                                                 //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+struct reed_solomon_deleter
+{
+    void operator()(correct_reed_solomon* rs) const
+    {
+        correct_reed_solomon_destroy(rs);
+    }
+};
+
+static correct_reed_solomon* get_reed_solomon(int check_size, int first_root)
+{
+    // Creating a RS codec builds the Galois field tables and the generator polynomial,
+    // which costs more than encoding a whole packet
+    // Keep one codec per (check size, first root) for each thread and reuse it
+    //
+    // polynomial 0x11d (x^8 + x^4 + x^3 + x^2 + 1), prim = 1
+
+    thread_local std::map<std::pair<int, int>, std::unique_ptr<correct_reed_solomon, reed_solomon_deleter>> cache;
+
+    auto& rs = cache[{ check_size, first_root }];
+
+    if (!rs)
+    {
+        rs.reset(correct_reed_solomon_create(correct_rs_primitive_polynomial_8_4_3_2_0, static_cast<uint8_t>(first_root), 1, check_size));
+    }
+
+    return rs.get();
+}
+
 // **************************************************************** //
 //                                                                  //
 //                                                                  //
@@ -781,8 +866,10 @@ std::vector<uint8_t> encode_fx25_frame(const std::vector<uint8_t>& packet_bytes)
     //   - polynomial 0x11d (x^8 + x^4 + x^3 + x^2 + 1)
     //   - fcr = 1 (first consecutive root)
     //   - prim = 1 (primitive element)
+    //
+    // The encoder is cached and reused across packets
 
-    correct_reed_solomon* rs = correct_reed_solomon_create(correct_rs_primitive_polynomial_8_4_3_2_0, 1, 1, check_size);
+    correct_reed_solomon* rs = get_reed_solomon(check_size, 1);
 
     if (rs == nullptr)
     {
@@ -800,12 +887,9 @@ std::vector<uint8_t> encode_fx25_frame(const std::vector<uint8_t>& packet_bytes)
 
     if (result != total)
     {
-        correct_reed_solomon_destroy(rs);
         return {};
     }
 
-    correct_reed_solomon_destroy(rs);
-
     // Append the encoded block to output
     // 
     // This contains:
@@ -824,3 +908,562 @@ std::vector<uint8_t> encode_fx25_frame(const std::vector<uint8_t>& packet_bytes)
 
     return output;
 }
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// G3RUH                                                            //
+//                                                                  //
+// g3ruh_scrambler, g3ruh_descrambler                               //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+uint8_t g3ruh_scrambler::scramble(uint8_t bit)
+{
+    return static_cast<uint8_t>(scramble(bit & 1u, 1));
+}
+
+uint32_t g3ruh_scrambler::scramble(uint32_t bits, int count)
+{
+    // Multiplicative (self-synchronizing) scrambler, polynomial x^17 + x^12 + 1
+    //
+    //   out[n] = in[n] ^ out[n - 12] ^ out[n - 17]
+    //
+    // With state_ holding out[n - 17] .. out[n - 1] in bits 0 .. 16:
+    //
+    //   out[n - 17 + j] is bit j     of state_
+    //   out[n - 12 + j] is bit j + 5 of state_
+    //
+    // Both are available from the register for j < 12, so up to 12 bits
+    // are scrambled with a couple of shifts and xors
+
+    assert(count > 0 && count <= 12);
+
+    const uint32_t mask = (1u << count) - 1;
+
+    uint32_t out = (bits ^ (state_ >> 5) ^ state_) & mask;
+
+    state_ = ((state_ >> count) | (out << (17 - count))) & 0x1FFFF;
+
+    return out;
+}
+
+void g3ruh_scrambler::reset()
+{
+    state_ = 0;
+}
+
+uint8_t g3ruh_descrambler::descramble(uint8_t bit)
+{
+    return static_cast<uint8_t>(descramble(bit & 1u, 1));
+}
+
+uint32_t g3ruh_descrambler::descramble(uint32_t bits, int count)
+{
+    // Inverse of the scrambler, only depends on the received bits
+    //
+    //   out[n] = in[n] ^ in[n - 12] ^ in[n - 17]
+    //
+    // The register and the new word are concatenated into one 64 bit window,
+    // so up to 32 bits are descrambled at once
+
+    assert(count > 0 && count <= 32);
+
+    const uint64_t mask = (count == 32) ? 0xFFFFFFFFull : ((1ull << count) - 1);
+
+    uint64_t window = static_cast<uint64_t>(state_) | (static_cast<uint64_t>(bits & mask) << 17);
+
+    uint64_t out = (static_cast<uint64_t>(bits) ^ (window >> 5) ^ window) & mask;
+
+    state_ = static_cast<uint32_t>((window >> count) & 0x1FFFF);
+
+    return static_cast<uint32_t>(out);
+}
+
+void g3ruh_descrambler::reset()
+{
+    state_ = 0;
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// IL2P                                                             //
+//                                                                  //
+// encode_il2p_frame, encode_il2p_bitstream                         //
+// try_decode_il2p_frame, try_decode_il2p_bitstream                 //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// IL2P Frame Structure (transmitted left to right, MSB-first):
+//
+// +-----------+-----------------+----------------------------------------+
+// | Sync word |     Header      |             Payload blocks             |
+// | (3 bytes) | (13 + 2 parity) | (data + 2..16 parity bytes) x 1..5     |
+// +-----------+-----------------+----------------------------------------+
+//
+// Compared to AX.25 and FX.25:
+//
+//   - No HDLC flags, no bit stuffing, no NRZI
+//   - Type 1 headers compress the addresses, control and PID into 13 bytes
+//   - No CRC, every block is protected by its own RS parity
+//   - Header and payload blocks are scrambled, which replaces bit stuffing
+//     for keeping enough transitions in the signal
+
+constexpr uint32_t il2p_sync_word = 0xF15E48;
+constexpr size_t il2p_header_size = 13;
+constexpr int il2p_header_parity = 2;
+constexpr size_t il2p_max_payload_size = 1023;
+
+struct il2p_block_layout
+{
+    size_t block_count = 0;
+    size_t small_block_size = 0;
+    size_t large_block_count = 0; // Blocks holding small_block_size + 1 bytes, sent first
+    int parity = 0;
+};
+
+static il2p_block_layout il2p_compute_layout(size_t payload_size, bool max_fec)
+{
+    // Split the payload into equally sized RS blocks
+    //
+    //   max FEC:  up to 239 data bytes per block, 16 parity bytes
+    //   default:  up to 247 data bytes per block, 2 to 8 parity bytes
+    //             depending on the block size
+
+    il2p_block_layout layout;
+
+    if (payload_size == 0)
+    {
+        return layout;
+    }
+
+    size_t max_block_size = max_fec ? 239 : 247;
+
+    layout.block_count = (payload_size + max_block_size - 1) / max_block_size;
+    layout.small_block_size = payload_size / layout.block_count;
+    layout.large_block_count = payload_size - layout.block_count * layout.small_block_size;
+
+    if (max_fec)
+    {
+        layout.parity = 16;
+    }
+    else if (layout.small_block_size <= 61)
+    {
+        layout.parity = 2;
+    }
+    else if (layout.small_block_size <= 123)
+    {
+        layout.parity = 4;
+    }
+    else if (layout.small_block_size <= 185)
+    {
+        layout.parity = 6;
+    }
+    else
+    {
+        layout.parity = 8;
+    }
+
+    return layout;
+}
+
+static void il2p_set_bits(std::array<uint8_t, il2p_header_size>& header, size_t first_byte, size_t count, int bit, unsigned int value)
+{
+    // Spreads a field across one bit position of consecutive header bytes, MSB in the first byte
+    for (size_t i = 0; i < count; i++)
+    {
+        if ((value >> (count - 1 - i)) & 1)
+        {
+            header[first_byte + i] |= static_cast<uint8_t>(1u << bit);
+        }
+    }
+}
+
+static unsigned int il2p_get_bits(const std::array<uint8_t, il2p_header_size>& header, size_t first_byte, size_t count, int bit)
+{
+    unsigned int value = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        value = (value << 1) | ((header[first_byte + i] >> bit) & 1);
+    }
+    return value;
+}
+
+static bool il2p_try_get_callsign(std::string_view address_string, std::string& callsign, int& ssid)
+{
+    // Type 1 headers hold 6 character SIXBIT callsigns (ASCII 0x20 - 0x5F) and a 4 bit SSID
+    // Same callsign and SSID that encode_address puts in the AX.25 address
+
+    address a;
+    try_parse_address(address_string, a);
+
+    if (a.mark)
+    {
+        return false;
+    }
+
+    callsign = a.text;
+
+    if (a.n > 0)
+    {
+        callsign += std::to_string(a.n);
+    }
+
+    ssid = (a.ssid > 0) ? a.ssid : a.N;
+
+    if (callsign.empty() || callsign.size() > 6 || ssid < 0 || ssid > 15)
+    {
+        return false;
+    }
+
+    for (char c : callsign)
+    {
+        if (c < 0x20 || c > 0x5F)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool il2p_encode_block(std::vector<uint8_t>& output, const uint8_t* data, size_t size, int parity)
+{
+    std::vector<uint8_t> block(data, data + size);
+
+    il2p_scramble(block.begin(), block.end());
+
+    correct_reed_solomon* rs = get_reed_solomon(parity, 0);
+
+    if (rs == nullptr)
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> encoded_block(size + parity);
+
+    if (correct_reed_solomon_encode(rs, block.data(), size, encoded_block.data()) != static_cast<ssize_t>(size + parity))
+    {
+        return false;
+    }
+
+    output.insert(output.end(), encoded_block.begin(), encoded_block.end());
+
+    return true;
+}
+
+static bool il2p_try_decode_block(const uint8_t* encoded, size_t size, int parity, std::vector<uint8_t>& output)
+{
+    correct_reed_solomon* rs = get_reed_solomon(parity, 0);
+
+    if (rs == nullptr)
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> block(size);
+
+    if (correct_reed_solomon_decode(rs, encoded, size + parity, block.data()) != static_cast<ssize_t>(size))
+    {
+        return false;
+    }
+
+    il2p_descramble(block.begin(), block.end());
+
+    output.insert(output.end(), block.begin(), block.end());
+
+    return true;
+}
+
+std::vector<uint8_t> encode_il2p_frame(const aprs::router::packet& p, bool max_fec)
+{
+    // Header Type 1 - UI frames without digipeaters
+    //
+    //   Byte      7          6             5 .. 0
+    //   ------------------------------------------------------
+    //   0         UI         FEC level     destination SIXBIT
+    //   1         PID        header type   destination SIXBIT
+    //   2 .. 4    PID        count         destination SIXBIT
+    //   5         control    count         source SIXBIT (from byte 6)
+    //   6 .. 11   control    count         source SIXBIT
+    //   12        destination SSID (7 .. 4), source SSID (3 .. 0)
+    //
+    // (bytes 0 .. 5 hold the destination, bytes 6 .. 11 the source)
+    //
+    // Header Type 0 - anything else, ex: APRS packets with a path
+    //
+    //   Only the FEC level, header type and count bits are used
+    //   The payload carries the whole AX.25 frame, without the CRC
+
+    std::array<uint8_t, il2p_header_size> header = {};
+
+    std::vector<uint8_t> payload;
+
+    std::string destination, source;
+    int destination_ssid = 0, source_ssid = 0;
+
+    bool type_1 = p.path.empty() &&
+        il2p_try_get_callsign(p.to, destination, destination_ssid) &&
+        il2p_try_get_callsign(p.from, source, source_ssid);
+
+    if (type_1)
+    {
+        for (size_t i = 0; i < 6; i++)
+        {
+            header[i] = static_cast<uint8_t>(((i < destination.size() ? destination[i] : ' ') - 0x20) & 0x3F);
+            header[i + 6] = static_cast<uint8_t>(((i < source.size() ? source[i] : ' ') - 0x20) & 0x3F);
+        }
+
+        header[12] = static_cast<uint8_t>((destination_ssid << 4) | source_ssid);
+
+        il2p_set_bits(header, 0, 1, 7, 1);    // UI frame
+        il2p_set_bits(header, 1, 4, 7, 0xF);  // PID 0xF0, no layer 3 protocol
+        il2p_set_bits(header, 5, 7, 7, 0);    // Control, UI with P/F = 0
+
+        payload.assign(p.data.begin(), p.data.end());
+    }
+    else
+    {
+        std::vector<uint8_t> ax25_frame = encode_frame(p);
+
+        payload.assign(ax25_frame.begin(), ax25_frame.end() - 2); // Remove the CRC
+    }
+
+    if (payload.size() > il2p_max_payload_size)
+    {
+        return {};
+    }
+
+    il2p_set_bits(header, 0, 1, 6, max_fec ? 1 : 0);
+    il2p_set_bits(header, 1, 1, 6, type_1 ? 1 : 0);
+    il2p_set_bits(header, 2, 10, 6, static_cast<unsigned int>(payload.size()));
+
+    std::vector<uint8_t> output;
+
+    output.push_back((il2p_sync_word >> 16) & 0xFF);
+    output.push_back((il2p_sync_word >> 8) & 0xFF);
+    output.push_back(il2p_sync_word & 0xFF);
+
+    if (!il2p_encode_block(output, header.data(), header.size(), il2p_header_parity))
+    {
+        return {};
+    }
+
+    il2p_block_layout layout = il2p_compute_layout(payload.size(), max_fec);
+
+    size_t position = 0;
+    for (size_t i = 0; i < layout.block_count; i++)
+    {
+        size_t block_size = layout.small_block_size + (i < layout.large_block_count ? 1 : 0);
+
+        if (!il2p_encode_block(output, payload.data() + position, block_size, layout.parity))
+        {
+            return {};
+        }
+
+        position += block_size;
+    }
+
+    return output;
+}
+
+std::vector<uint8_t> encode_il2p_bitstream(const aprs::router::packet& p, int preamble_flags, int postamble_flags, bool max_fec)
+{
+    std::vector<uint8_t> frame = encode_il2p_frame(p, max_fec);
+
+    if (frame.empty())
+    {
+        return {};
+    }
+
+    // Build complete bitstream: preamble + frame + postamble
+    // IL2P uses 0x55 (alternating bits) instead of HDLC flags, one byte per flag
+    // Bytes are sent MSB-first and without NRZI
+
+    std::vector<uint8_t> bitstream;
+
+    bitstream.reserve((preamble_flags + frame.size() + postamble_flags) * 8);
+
+    auto append_byte = [&bitstream](uint8_t byte)
+    {
+        for (int i = 7; i >= 0; --i)
+        {
+            bitstream.push_back((byte >> i) & 1);
+        }
+    };
+
+    for (int i = 0; i < preamble_flags; i++)
+    {
+        append_byte(0x55);
+    }
+
+    for (uint8_t byte : frame)
+    {
+        append_byte(byte);
+    }
+
+    for (int i = 0; i < postamble_flags; i++)
+    {
+        append_byte(0x55);
+    }
+
+    return bitstream;
+}
+
+bool try_decode_il2p_frame(const std::vector<uint8_t>& frame_bytes, aprs::router::packet& p, size_t& frame_size)
+{
+    // frame_bytes starts right after the sync word
+    // frame_size is set to the number of bytes used by the header and payload blocks
+
+    frame_size = 0;
+
+    if (frame_bytes.size() < il2p_header_size + il2p_header_parity)
+    {
+        return false;
+    }
+
+    std::vector<uint8_t> header_bytes;
+
+    if (!il2p_try_decode_block(frame_bytes.data(), il2p_header_size, il2p_header_parity, header_bytes))
+    {
+        return false;
+    }
+
+    std::array<uint8_t, il2p_header_size> header;
+    std::copy(header_bytes.begin(), header_bytes.end(), header.begin());
+
+    bool max_fec = il2p_get_bits(header, 0, 1, 6) != 0;
+    bool type_1 = il2p_get_bits(header, 1, 1, 6) != 0;
+    size_t payload_size = il2p_get_bits(header, 2, 10, 6);
+
+    il2p_block_layout layout = il2p_compute_layout(payload_size, max_fec);
+
+    size_t position = il2p_header_size + il2p_header_parity;
+
+    std::vector<uint8_t> payload;
+
+    for (size_t i = 0; i < layout.block_count; i++)
+    {
+        size_t block_size = layout.small_block_size + (i < layout.large_block_count ? 1 : 0);
+
+        if (position + block_size + layout.parity > frame_bytes.size())
+        {
+            return false;
+        }
+
+        if (!il2p_try_decode_block(frame_bytes.data() + position, block_size, layout.parity, payload))
+        {
+            return false;
+        }
+
+        position += block_size + layout.parity;
+    }
+
+    frame_size = position;
+
+    if (!type_1)
+    {
+        // Type 0, the payload is the AX.25 frame without CRC
+        // Recompute the CRC and decode the frame as usual
+
+        std::array<uint8_t, 2> crc = compute_crc(payload.begin(), payload.end());
+        payload.insert(payload.end(), crc.begin(), crc.end());
+
+        return try_decode_frame(payload, p);
+    }
+
+    bool ui = il2p_get_bits(header, 0, 1, 7) != 0;
+    unsigned int pid = il2p_get_bits(header, 1, 4, 7);
+
+    if (!ui || pid != 0xF)
+    {
+        return false;
+    }
+
+    auto to_address = [&header](size_t first_byte, int ssid)
+    {
+        address a;
+        for (size_t i = first_byte; i < first_byte + 6; i++)
+        {
+            a.text += static_cast<char>((header[i] & 0x3F) + 0x20);
+        }
+        a.text = trim(a.text);
+        a.ssid = ssid;
+        return to_string(a);
+    };
+
+    p.to = to_address(0, header[12] >> 4);
+    p.from = to_address(6, header[12] & 0x0F);
+    p.path.clear();
+    p.data = std::string(payload.begin(), payload.end());
+
+    return true;
+}
+
+bool try_decode_il2p_bitstream(const std::vector<uint8_t>& bitstream, size_t offset, aprs::router::packet& p, size_t& read)
+{
+    read = 0;
+
+    if (offset >= bitstream.size())
+    {
+        return false;
+    }
+
+    // Find the sync word, either polarity
+    // Without NRZI an inverted receive path inverts every bit
+
+    std::array<uint8_t, 24> sync_pattern;
+    std::array<uint8_t, 24> inverted_sync_pattern;
+
+    for (int i = 0; i < 24; i++)
+    {
+        sync_pattern[i] = (il2p_sync_word >> (23 - i)) & 1;
+        inverted_sync_pattern[i] = sync_pattern[i] ^ 1;
+    }
+
+    auto first = bitstream.begin() + offset;
+
+    auto sync = std::search(first, bitstream.end(), sync_pattern.begin(), sync_pattern.end());
+    auto inverted_sync = std::search(first, sync, inverted_sync_pattern.begin(), inverted_sync_pattern.end());
+
+    bool inverted = inverted_sync != sync;
+
+    if (inverted)
+    {
+        sync = inverted_sync;
+    }
+
+    if (sync == bitstream.end())
+    {
+        return false;
+    }
+
+    auto frame_start = sync + 24;
+
+    // The header and the block layout are not known yet, pack the rest of the bits
+    // up to the largest possible frame
+
+    size_t max_frame_bits = (il2p_header_size + il2p_header_parity + il2p_max_payload_size + 5 * 16) * 8;
+    size_t available_bits = (std::min)(static_cast<size_t>(std::distance(frame_start, bitstream.end())), max_frame_bits);
+
+    std::vector<uint8_t> frame_bytes(available_bits / 8, 0);
+
+    for (size_t i = 0; i < frame_bytes.size() * 8; i++)
+    {
+        uint8_t bit = frame_start[i] ^ (inverted ? 1 : 0);
+        frame_bytes[i / 8] |= static_cast<uint8_t>(bit << (7 - (i % 8)));
+    }
+
+    size_t frame_size = 0;
+
+    bool result = try_decode_il2p_frame(frame_bytes, p, frame_size);
+
+    // Continue after the frame, or after the sync word if the frame could not be decoded
+
+    read = std::distance(first, frame_start) + frame_size * 8;
+
+    return result;
+}
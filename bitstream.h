@@ -64,6 +64,25 @@ struct fx25_bitstream_converter
     bool try_decode(const std::vector<uint8_t>& bitstream, size_t offset, aprs::router::packet& p, size_t& read) const;
 };
 
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// il2p_bitstream_converter                                         //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+struct il2p_bitstream_converter
+{
+    il2p_bitstream_converter(bool max_fec = false);
+
+    std::vector<uint8_t> encode(const aprs::router::packet& p, int preamble_flags, int postamble_flags) const;
+    bool try_decode(const std::vector<uint8_t>& bitstream, size_t offset, aprs::router::packet& p, size_t& read) const;
+
+private:
+    bool max_fec_;
+};
+
 // **************************************************************** //
 //                                                                  //
 //                                                                  //
@@ -112,6 +131,25 @@ private:
     fx25_bitstream_converter converter;
 };
 
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// il2p_bitstream_converter_adapter                                 //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+struct il2p_bitstream_converter_adapter : public bitstream_converter_base
+{
+    il2p_bitstream_converter_adapter(bool max_fec = false);
+
+    std::vector<uint8_t> encode(const aprs::router::packet& p, int preamble_flags = 45, int postamble_flags = 5) const override;
+    bool try_decode(const std::vector<uint8_t>& bitstream, size_t offset, aprs::router::packet& p, size_t& read) const override;
+
+private:
+    il2p_bitstream_converter converter;
+};
+
 // **************************************************************** //
 //                                                                  //
 //                                                                  //
@@ -529,3 +567,160 @@ std::vector<uint8_t> encode_fx25_frame(const std::vector<uint8_t>& frame);
 
 std::vector<uint8_t> encode_fx25_bitstream(const aprs::router::packet& p, int preamble_flags, int postamble_flags);
 
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// IL2P                                                             //
+//                                                                  //
+// encode_il2p_frame, encode_il2p_bitstream                         //
+// try_decode_il2p_frame, try_decode_il2p_bitstream                 //
+// il2p_scramble, il2p_descramble                                   //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+std::vector<uint8_t> encode_il2p_frame(const aprs::router::packet& p, bool max_fec);
+
+std::vector<uint8_t> encode_il2p_bitstream(const aprs::router::packet& p, int preamble_flags, int postamble_flags, bool max_fec);
+
+bool try_decode_il2p_frame(const std::vector<uint8_t>& frame_bytes, aprs::router::packet& p, size_t& frame_size);
+
+bool try_decode_il2p_bitstream(const std::vector<uint8_t>& bitstream, size_t offset, aprs::router::packet& p, size_t& read);
+
+template<typename It>
+inline void il2p_scramble(It first, It last)
+{
+    // Scrambles a block of bytes in-place, MSB-first
+    // Multiplicative scrambler, polynomial x^9 + x^4 + 1, initial state 0x1F0
+    //
+    //   out[n] = in[n] ^ out[n - 4] ^ out[n - 9]
+    //
+    // The state is reset for every block, so an uncorrectable block
+    // does not corrupt the next one
+
+    uint16_t state = 0x1F0; // bit 0 = out[n - 1] .. bit 8 = out[n - 9]
+
+    for (auto it = first; it != last; ++it)
+    {
+        uint8_t byte = *it;
+        uint8_t result = 0;
+        for (int i = 7; i >= 0; --i)
+        {
+            uint16_t bit = ((byte >> i) ^ (state >> 3) ^ (state >> 8)) & 1;
+            state = ((state << 1) | bit) & 0x1FF;
+            result |= static_cast<uint8_t>(bit << i);
+        }
+        *it = result;
+    }
+}
+
+template<typename It>
+inline void il2p_descramble(It first, It last)
+{
+    // Inverse of il2p_scramble
+    //
+    //   out[n] = in[n] ^ in[n - 4] ^ in[n - 9]
+
+    uint16_t state = 0x1F0; // bit 0 = in[n - 1] .. bit 8 = in[n - 9]
+
+    for (auto it = first; it != last; ++it)
+    {
+        uint8_t byte = *it;
+        uint8_t result = 0;
+        for (int i = 7; i >= 0; --i)
+        {
+            uint16_t in = (byte >> i) & 1;
+            uint16_t bit = (in ^ (state >> 3) ^ (state >> 8)) & 1;
+            state = ((state << 1) | in) & 0x1FF;
+            result |= static_cast<uint8_t>(bit << i);
+        }
+        *it = result;
+    }
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// G3RUH                                                            //
+//                                                                  //
+// g3ruh_scrambler, g3ruh_descrambler                               //
+// g3ruh_scramble, g3ruh_descramble                                 //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+struct g3ruh_scrambler
+{
+    uint8_t scramble(uint8_t bit);
+    uint32_t scramble(uint32_t bits, int count);
+    void reset();
+
+private:
+    uint32_t state_ = 0; // Last 17 output bits, bit 0 = oldest, bit 16 = newest
+};
+
+struct g3ruh_descrambler
+{
+    uint8_t descramble(uint8_t bit);
+    uint32_t descramble(uint32_t bits, int count);
+    void reset();
+
+private:
+    uint32_t state_ = 0; // Last 17 input bits, bit 0 = oldest, bit 16 = newest
+};
+
+template<typename It>
+inline void g3ruh_scramble(It first, It last, g3ruh_scrambler& scrambler)
+{
+    // Scrambles a bitstream in-place, 12 bits per step
+    //
+    // The scrambler output depends on outputs 12 and 17 bits back,
+    // so up to 12 bits can be computed at once from the register
+
+    while (first != last)
+    {
+        It chunk_first = first;
+
+        uint32_t bits = 0;
+        int count = 0;
+        while (count < 12 && first != last)
+        {
+            bits |= static_cast<uint32_t>(*first++ & 1) << count++;
+        }
+
+        uint32_t scrambled = scrambler.scramble(bits, count);
+
+        for (int i = 0; i < count; ++i)
+        {
+            *chunk_first++ = (scrambled >> i) & 1;
+        }
+    }
+}
+
+template<typename It>
+inline void g3ruh_descramble(It first, It last, g3ruh_descrambler& descrambler)
+{
+    // Descrambles a bitstream in-place, 32 bits per step
+    //
+    // The descrambler only depends on its inputs, not on its outputs,
+    // so a whole word can be computed at once
+
+    while (first != last)
+    {
+        It chunk_first = first;
+
+        uint32_t bits = 0;
+        int count = 0;
+        while (count < 32 && first != last)
+        {
+            bits |= static_cast<uint32_t>(*first++ & 1) << count++;
+        }
+
+        uint32_t descrambled = descrambler.descramble(bits, count);
+
+        for (int i = 0; i < count; ++i)
+        {
+            *chunk_first++ = (descrambled >> i) & 1;
+        }
+    }
+}
@@ -0,0 +1,627 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// data_format.cpp
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#include "data_format.h"
+#include "bitstream.h"
+#include "kiss.h"
+
+#include <charconv>
+#include <cstring>
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// data_format                                                      //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+bool operator==(const data_format& lhs, const data_format& rhs)
+{
+    return lhs.type == rhs.type && lhs.telemetry == rhs.telemetry;
+}
+
+bool try_parse_data_format(std::string_view name, data_format& format)
+{
+    constexpr std::string_view suffix = "_with_telemetry";
+
+    bool telemetry = false;
+    if (name.size() > suffix.size() && name.substr(name.size() - suffix.size()) == suffix)
+    {
+        telemetry = true;
+        name.remove_suffix(suffix.size());
+    }
+
+    data_format_type type;
+    if (name == "aprs_text")
+    {
+        type = data_format_type::aprs_text;
+    }
+    else if (name == "aprs_json")
+    {
+        type = data_format_type::aprs_json;
+    }
+    else if (name == "ax25_hex")
+    {
+        type = data_format_type::ax25_hex;
+    }
+    else if (name == "ax25_kiss")
+    {
+        type = data_format_type::ax25_kiss;
+    }
+    else if (name == "ax25_bin")
+    {
+        type = data_format_type::ax25_bin;
+    }
+    else if (name == "bitstream")
+    {
+        type = data_format_type::bitstream;
+    }
+    else if (name == "telemetry")
+    {
+        type = data_format_type::telemetry;
+    }
+    else
+    {
+        return false;
+    }
+
+    // No room for telemetry in the binary formats
+
+    if (telemetry && (type == data_format_type::ax25_kiss || type == data_format_type::ax25_bin || type == data_format_type::telemetry))
+    {
+        return false;
+    }
+
+    format.type = type;
+    format.telemetry = telemetry;
+
+    return true;
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// append_aprs_text, append_aprs_json, append_hex, append_bits      //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+namespace
+{
+    constexpr uint64_t ones = 0x0101010101010101ull;
+    constexpr uint64_t highs = 0x8080808080808080ull;
+
+    bool has_json_special(const uint8_t* p)
+    {
+        // Eight bytes at once, same zero byte test as has_kiss_special
+        // (v - 0x20..) & ~v & 0x80.. is non zero when any byte of v is below 0x20
+
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+
+        uint64_t quote = word ^ (ones * '"');
+        uint64_t backslash = word ^ (ones * '\\');
+
+        return (((word - ones * 0x20) & ~word) | ((quote - ones) & ~quote) | ((backslash - ones) & ~backslash)) & highs;
+    }
+
+    void append(std::vector<uint8_t>& out, std::string_view s)
+    {
+        out.insert(out.end(), s.begin(), s.end());
+    }
+
+    template<typename T>
+    void append_number(std::vector<uint8_t>& out, T value)
+    {
+        char buffer[24];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.insert(out.end(), buffer, result.ptr);
+    }
+
+    uint8_t* extend(std::vector<uint8_t>& out, size_t count)
+    {
+        size_t size = out.size();
+        out.resize(size + count);
+        return out.data() + size;
+    }
+}
+
+void append_aprs_text(const aprs::router::packet& p, std::vector<uint8_t>& out)
+{
+    size_t size = p.from.size() + p.to.size() + p.data.size() + 2;
+    for (const auto& address : p.path)
+    {
+        size += address.size() + 1;
+    }
+    out.reserve(out.size() + size);
+
+    append(out, p.from);
+    out.push_back('>');
+    append(out, p.to);
+    for (const auto& address : p.path)
+    {
+        out.push_back(',');
+        append(out, address);
+    }
+    out.push_back(':');
+    append(out, p.data);
+}
+
+void append_json_string(std::string_view s, std::vector<uint8_t>& out)
+{
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(s.data());
+    size_t size = s.size();
+
+    out.reserve(out.size() + size + 2);
+    out.push_back('"');
+
+    // Bytes from 0x80 are copied as is, the packet data is expected to be UTF-8
+
+    size_t run = 0;
+    size_t i = 0;
+    while (i < size)
+    {
+        if (i + 8 <= size && !has_json_special(data + i))
+        {
+            i += 8;
+            continue;
+        }
+
+        uint8_t b = data[i];
+        if (b < 0x20 || b == '"' || b == '\\')
+        {
+            out.insert(out.end(), data + run, data + i);
+            out.push_back('\\');
+            switch (b)
+            {
+                case '"': out.push_back('"'); break;
+                case '\\': out.push_back('\\'); break;
+                case '\n': out.push_back('n'); break;
+                case '\r': out.push_back('r'); break;
+                case '\t': out.push_back('t'); break;
+                default:
+                {
+                    const char* digits = "0123456789abcdef";
+                    uint8_t* p = extend(out, 5);
+                    p[0] = 'u';
+                    p[1] = '0';
+                    p[2] = '0';
+                    p[3] = digits[b >> 4];
+                    p[4] = digits[b & 0x0F];
+                    break;
+                }
+            }
+            run = i + 1;
+        }
+        i++;
+    }
+
+    out.insert(out.end(), data + run, data + size);
+    out.push_back('"');
+}
+
+void append_aprs_json(const aprs::router::packet& p, const packet_telemetry* telemetry, std::vector<uint8_t>& out)
+{
+    append(out, "{\"from\":");
+    append_json_string(p.from, out);
+    append(out, ",\"to\":");
+    append_json_string(p.to, out);
+    append(out, ",\"path\":[");
+    for (size_t i = 0; i < p.path.size(); i++)
+    {
+        if (i > 0)
+        {
+            out.push_back(',');
+        }
+        append_json_string(p.path[i], out);
+    }
+    append(out, "],\"data\":");
+    append_json_string(p.data, out);
+
+    if (telemetry != nullptr)
+    {
+        append(out, ",\"telemetry\":{\"position\":");
+        append_number(out, telemetry->position);
+        append(out, ",\"sample_rate\":");
+        append_number(out, telemetry->sample_rate);
+        append(out, ",\"frequency_offset\":");
+        append_number(out, telemetry->frequency_offset);
+        append(out, ",\"repaired_bits\":");
+        append_number(out, telemetry->repaired_bits);
+        out.push_back('}');
+    }
+
+    out.push_back('}');
+}
+
+void append_hex(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+{
+    uint8_t* p = extend(out, size * 2);
+
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4, p += 8)
+    {
+        // Spread four bytes to one per 16 bits lane, then one nibble per byte,
+        // high nibble first, a nibble n becomes '0' + n, plus 7 when n > 9
+
+        uint64_t v = static_cast<uint64_t>(data[i]) | (static_cast<uint64_t>(data[i + 1]) << 8) | (static_cast<uint64_t>(data[i + 2]) << 16) | (static_cast<uint64_t>(data[i + 3]) << 24);
+        v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+        v = (v | (v << 8)) & 0x00FF00FF00FF00FFull;
+        v = ((v >> 4) & 0x000F000F000F000Full) | ((v & 0x000F000F000F000Full) << 8);
+
+        uint64_t letters = ((v + ones * 6) >> 4) & ones;
+        v += ones * '0' + letters * 7;
+
+        // Byte stores, the compiler merges them to one
+
+        for (int k = 0; k < 8; k++)
+        {
+            p[k] = static_cast<uint8_t>(v >> (8 * k));
+        }
+    }
+
+    const char* digits = "0123456789ABCDEF";
+    for (; i < size; i++, p += 2)
+    {
+        p[0] = digits[data[i] >> 4];
+        p[1] = digits[data[i] & 0x0F];
+    }
+}
+
+void append_bits(const uint8_t* bits, size_t count, std::vector<uint8_t>& out)
+{
+    uint8_t* p = extend(out, count);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, bits + i, sizeof(word));
+        word = (word & ones) + ones * '0';
+        std::memcpy(p + i, &word, sizeof(word));
+    }
+
+    for (; i < count; i++)
+    {
+        p[i] = static_cast<uint8_t>('0' + (bits[i] & 1));
+    }
+}
+
+void append_telemetry_text(const packet_telemetry& telemetry, std::vector<uint8_t>& out)
+{
+    append(out, "position=");
+    append_number(out, telemetry.position);
+    append(out, " sample_rate=");
+    append_number(out, telemetry.sample_rate);
+    append(out, " frequency_offset=");
+    append_number(out, telemetry.frequency_offset);
+    append(out, " repaired_bits=");
+    append_number(out, telemetry.repaired_bits);
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// data_buffer_pool                                                 //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+data_buffer_pool::data_buffer_pool(size_t buffer_capacity, size_t max_free) : state_(std::make_shared<state>())
+{
+    state_->buffer_capacity = buffer_capacity;
+    state_->max_free = max_free;
+
+    // The free lists never allocate after this
+
+    state_->free_buffers.reserve(max_free);
+    state_->free_blocks.reserve(max_free);
+}
+
+std::shared_ptr<std::vector<uint8_t>> data_buffer_pool::acquire()
+{
+    // Most recently released first, its memory is the most likely to be in cache
+
+    std::vector<uint8_t>* buffer = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (!state_->free_buffers.empty())
+        {
+            buffer = state_->free_buffers.back();
+            state_->free_buffers.pop_back();
+        }
+        else
+        {
+            state_->buffers++;
+        }
+    }
+
+    if (buffer == nullptr)
+    {
+        buffer = new std::vector<uint8_t>();
+        buffer->reserve(state_->buffer_capacity);
+    }
+
+    return std::shared_ptr<std::vector<uint8_t>>(buffer, releaser{ state_ }, block_allocator<std::vector<uint8_t>>(state_));
+}
+
+size_t data_buffer_pool::size() const
+{
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->buffers;
+}
+
+size_t data_buffer_pool::free_buffers() const
+{
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->free_buffers.size();
+}
+
+data_buffer_pool::state::~state()
+{
+    for (std::vector<uint8_t>* buffer : free_buffers)
+    {
+        delete buffer;
+    }
+
+    for (void* block : free_blocks)
+    {
+        ::operator delete(block);
+    }
+}
+
+void data_buffer_pool::state::release(std::vector<uint8_t>* buffer)
+{
+    // Called by the last owner, on the thread that dropped the buffer
+
+    buffer->clear();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (free_buffers.size() < max_free)
+        {
+            free_buffers.push_back(buffer);
+            return;
+        }
+        buffers--;
+    }
+
+    delete buffer;
+}
+
+void* data_buffer_pool::state::allocate_block(size_t bytes)
+{
+    if (bytes > block_size)
+    {
+        return ::operator new(bytes);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!free_blocks.empty())
+        {
+            void* block = free_blocks.back();
+            free_blocks.pop_back();
+            return block;
+        }
+    }
+
+    return ::operator new(block_size);
+}
+
+void data_buffer_pool::state::deallocate_block(void* block, size_t bytes)
+{
+    if (bytes <= block_size)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (free_blocks.size() < max_free)
+        {
+            free_blocks.push_back(block);
+            return;
+        }
+    }
+
+    ::operator delete(block);
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// data_formatter                                                   //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+data_formatter::data_formatter(size_t buffer_capacity) : pool_(buffer_capacity)
+{
+}
+
+size_t data_formatter::add(data_format format)
+{
+    size_t index = 0;
+    while (index < formats_.size() && !(formats_[index] == format))
+    {
+        index++;
+    }
+
+    if (index == formats_.size())
+    {
+        formats_.push_back(format);
+        buffers_.emplace_back();
+    }
+
+    stream_formats_.push_back(index);
+
+    return stream_formats_.size() - 1;
+}
+
+void data_formatter::render(const data_packet& p)
+{
+    frame_ready_ = false;
+    bits_ready_ = false;
+
+    for (size_t i = 0; i < formats_.size(); i++)
+    {
+        // Release the previous packet first, its buffer can be reused
+        // right away if no stream holds it anymore
+
+        buffers_[i].reset();
+
+        std::shared_ptr<std::vector<uint8_t>> buffer = pool_.acquire();
+        render(formats_[i], p, *buffer);
+        buffers_[i] = std::move(buffer);
+
+        renders_++;
+    }
+}
+
+void data_formatter::render(data_format format, const data_packet& p, std::vector<uint8_t>& out)
+{
+    const packet_telemetry* telemetry = format.telemetry ? &p.telemetry : nullptr;
+
+    switch (format.type)
+    {
+        case data_format_type::aprs_text:
+            if (p.packet != nullptr)
+            {
+                append_aprs_text(*p.packet, out);
+            }
+            break;
+        case data_format_type::aprs_json:
+            if (p.packet != nullptr)
+            {
+                append_aprs_json(*p.packet, telemetry, out);
+            }
+            break;
+        case data_format_type::ax25_hex:
+            prepare_frame(p);
+            append_hex(frame_data_, frame_size_ - 2, out);
+            break;
+        case data_format_type::ax25_kiss:
+            prepare_frame(p);
+            kiss_encode(frame_data_, frame_size_ - 2, out);
+            return;
+        case data_format_type::ax25_bin:
+            prepare_frame(p);
+            out.insert(out.end(), frame_data_, frame_data_ + frame_size_ - 2);
+            return;
+        case data_format_type::bitstream:
+            prepare_bits(p);
+            append_bits(bits_data_, bit_count_, out);
+            break;
+        case data_format_type::telemetry:
+            append_telemetry_text(p.telemetry, out);
+            break;
+    }
+
+    // JSON carries the telemetry in the object, the other text formats
+    // after a tab
+
+    if (telemetry != nullptr && format.type != data_format_type::aprs_json)
+    {
+        out.push_back('\t');
+        append_telemetry_text(*telemetry, out);
+    }
+
+    out.push_back('\n');
+}
+
+void data_formatter::prepare_frame(const data_packet& p)
+{
+    if (frame_ready_)
+    {
+        return;
+    }
+    frame_ready_ = true;
+
+    if (p.frame != nullptr && p.frame_size >= 2)
+    {
+        frame_data_ = p.frame;
+        frame_size_ = p.frame_size;
+        return;
+    }
+
+    // No frame from the decoder, ex: a test data stream, this allocates
+
+    frame_ = p.packet != nullptr ? encode_frame(*p.packet) : std::vector<uint8_t>(2, 0);
+    frame_data_ = frame_.data();
+    frame_size_ = frame_.size();
+}
+
+void data_formatter::prepare_bits(const data_packet& p)
+{
+    if (bits_ready_)
+    {
+        return;
+    }
+    bits_ready_ = true;
+
+    if (p.bits != nullptr)
+    {
+        bits_data_ = p.bits;
+        bit_count_ = p.bit_count;
+        return;
+    }
+
+    prepare_frame(p);
+    bits_ = encode_basic_bitstream(frame_data_, frame_data_ + frame_size_, 1, 1);
+    bits_data_ = bits_.data();
+    bit_count_ = bits_.size();
+}
+
+const data_buffer& data_formatter::buffer(size_t stream) const
+{
+    return buffers_[stream_formats_[stream]];
+}
+
+size_t data_formatter::streams() const
+{
+    return stream_formats_.size();
+}
+
+size_t data_formatter::formats() const
+{
+    return formats_.size();
+}
+
+uint64_t data_formatter::renders() const
+{
+    return renders_;
+}
+
+size_t data_formatter::pooled_buffers() const
+{
+    return pool_.size();
+}
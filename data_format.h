@@ -0,0 +1,301 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// data_format.h
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "external/aprsroute.hpp"
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// data_format                                                      //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Output formats of the data streams, the "format" setting
+//
+//   - aprs_text     TNC2 text, N0CALL>APRS,WIDE1-1:data
+//   - aprs_json     {"from":..,"to":..,"path":[..],"data":..}
+//   - ax25_hex      AX.25 frame as hex digits
+//   - ax25_kiss     AX.25 frame, KISS encoded
+//   - ax25_bin      AX.25 frame, raw bytes
+//   - bitstream     Demodulated bits as '0' and '1' characters
+//   - telemetry     Telemetry only
+//
+// The AX.25 formats carry the frame without the FCS, same as KISS
+// Text formats end with a new line
+// "_with_telemetry" appends the telemetry to aprs_text, aprs_json,
+// ax25_hex and bitstream, it is not supported by the binary formats
+
+enum class data_format_type
+{
+    aprs_text,
+    aprs_json,
+    ax25_hex,
+    ax25_kiss,
+    ax25_bin,
+    bitstream,
+    telemetry
+};
+
+struct data_format
+{
+    data_format_type type = data_format_type::aprs_text;
+    bool telemetry = false;
+};
+
+bool operator==(const data_format& lhs, const data_format& rhs);
+
+bool try_parse_data_format(std::string_view name, data_format& format);
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// data_packet                                                      //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+struct packet_telemetry
+{
+    uint64_t position = 0;       // Sample index where the frame ended
+    uint32_t sample_rate = 0;
+    int frequency_offset = 0;    // Hz, channel of the channelized demodulator
+    int repaired_bits = 0;       // Bits flipped by the CRC repair
+};
+
+// One decoded packet, as handed to the output stage
+// frame and bits are optional, ex: a packet from a test data stream,
+// they are rendered from the packet when a format needs them
+
+struct data_packet
+{
+    const aprs::router::packet* packet = nullptr;
+    const uint8_t* frame = nullptr;    // AX.25 frame with the FCS, as output by hdlc_deframer
+    size_t frame_size = 0;
+    const uint8_t* bits = nullptr;     // NRZI bits, one per byte
+    size_t bit_count = 0;
+    packet_telemetry telemetry;
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// append_aprs_text, append_aprs_json, append_hex, append_bits      //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// The writers append to out and do not allocate once out has the capacity,
+// out is typically a pooled buffer that is cleared and reused
+//
+//   - append_aprs_text is to_string(packet) without the temporary strings
+//   - append_json_string scans eight bytes at a time for '"', '\' and
+//     control characters, runs with none are copied in bulk
+//   - append_hex converts four bytes to eight hex digits at once
+//   - append_bits converts eight bits to eight characters at once
+
+void append_aprs_text(const aprs::router::packet& p, std::vector<uint8_t>& out);
+void append_aprs_json(const aprs::router::packet& p, const packet_telemetry* telemetry, std::vector<uint8_t>& out);
+void append_json_string(std::string_view s, std::vector<uint8_t>& out);
+void append_hex(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+void append_bits(const uint8_t* bits, size_t count, std::vector<uint8_t>& out);
+void append_telemetry_text(const packet_telemetry& telemetry, std::vector<uint8_t>& out);
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// data_buffer_pool                                                 //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// One rendered packet, immutable and shared by every stream of a format,
+// the same type tcp_data_stream::write takes
+
+using data_buffer = std::shared_ptr<const std::vector<uint8_t>>;
+
+// Reusable buffers, the shared_ptr deleter returns a buffer to the free
+// list when the last stream drops it, from any thread
+//
+//   - acquire() and the release take a short lock on the free list, the
+//     lock also orders the last reader before the next writer
+//   - The free list keeps at most max_free buffers, the excess is freed,
+//     a burst does not pin its buffers forever
+//   - The shared_ptr control blocks are recycled the same way, buffers
+//     keep their capacity, in steady state acquire does not allocate
+//   - Buffers can outlive the pool, the free lists live until the last
+//     buffer is released
+
+struct data_buffer_pool
+{
+    data_buffer_pool(size_t buffer_capacity = 512, size_t max_free = 64);
+
+    std::shared_ptr<std::vector<uint8_t>> acquire();
+
+    size_t size() const;         // Buffers alive, in use or free
+    size_t free_buffers() const;
+
+private:
+    struct state
+    {
+        ~state();
+
+        void release(std::vector<uint8_t>* buffer);
+        void* allocate_block(size_t bytes);
+        void deallocate_block(void* block, size_t bytes);
+
+        static constexpr size_t block_size = 128; // Fits a shared_ptr control block with the releaser and allocator
+
+        mutable std::mutex mutex;
+        size_t buffer_capacity = 0;
+        size_t max_free = 0;
+        size_t buffers = 0;                               // Buffers alive, in use or free
+        std::vector<std::vector<uint8_t>*> free_buffers;
+        std::vector<void*> free_blocks;                   // Control blocks, block_size bytes each
+    };
+
+    struct releaser
+    {
+        std::shared_ptr<state> pool;
+
+        void operator()(std::vector<uint8_t>* buffer) const
+        {
+            pool->release(buffer);
+        }
+    };
+
+    // Allocator for the shared_ptr control blocks
+
+    template<typename T>
+    struct block_allocator
+    {
+        using value_type = T;
+
+        block_allocator(std::shared_ptr<state> pool) : pool(std::move(pool))
+        {
+        }
+
+        template<typename U>
+        block_allocator(const block_allocator<U>& other) : pool(other.pool)
+        {
+        }
+
+        T* allocate(size_t n)
+        {
+            return static_cast<T*>(pool->allocate_block(n * sizeof(T)));
+        }
+
+        void deallocate(T* p, size_t n)
+        {
+            pool->deallocate_block(p, n * sizeof(T));
+        }
+
+        template<typename U>
+        bool operator==(const block_allocator<U>& other) const
+        {
+            return pool == other.pool;
+        }
+
+        std::shared_ptr<state> pool;
+    };
+
+    std::shared_ptr<state> state_;
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// data_formatter                                                   //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Output formatting stage in front of the data streams
+//
+//   - add() registers a stream by its format, and returns its index,
+//     streams with the same format share one slot
+//   - render() formats a packet once per distinct format, into buffers
+//     from the pool, the frame and bitstream are computed at most once
+//   - buffer(stream) is the rendered packet for a stream, the same
+//     data_buffer for every stream of a format, ex: two TCP listeners
+//     and a log writing aprs_text
+//
+// Not thread safe, render from one thread, the buffers can be handed
+// to streams on other threads
+
+struct data_formatter
+{
+    data_formatter(size_t buffer_capacity = 512);
+
+    size_t add(data_format format);
+
+    void render(const data_packet& p);
+
+    const data_buffer& buffer(size_t stream) const;
+
+    size_t streams() const;
+    size_t formats() const;
+    uint64_t renders() const;     // Format renders since construction
+    size_t pooled_buffers() const;
+
+private:
+    void render(data_format format, const data_packet& p, std::vector<uint8_t>& out);
+    void prepare_frame(const data_packet& p);
+    void prepare_bits(const data_packet& p);
+
+    data_buffer_pool pool_;
+    std::vector<data_format> formats_;    // Distinct formats
+    std::vector<data_buffer> buffers_;    // Rendered packet, per distinct format
+    std::vector<size_t> stream_formats_;  // Stream index to format index
+    uint64_t renders_ = 0;
+
+    // Frame and bits of the packet being rendered, when not in the data_packet
+
+    std::vector<uint8_t> frame_;
+    std::vector<uint8_t> bits_;
+    const uint8_t* frame_data_ = nullptr;
+    size_t frame_size_ = 0;
+    const uint8_t* bits_data_ = nullptr;
+    size_t bit_count_ = 0;
+    bool frame_ready_ = false;
+    bool bits_ready_ = false;
+};
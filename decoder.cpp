@@ -0,0 +1,349 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// decoder.cpp
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "decoder.h"
+
+#include <algorithm>
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// hdlc_deframer                                                    //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+hdlc_deframer::hdlc_deframer(size_t max_frame_size, size_t repair_bits, int max_flips) : max_frame_bits_(max_frame_size * 8), repair_bits_(repair_bits), max_flips_(max_flips)
+{
+    // The CRC is linear, flipping a frame bit changes it by a fixed pattern
+    // that only depends on how far the bit is from the end of the data
+    // Impulse response of the CRC-16-CCITT register, one entry per distance
+
+    if (repair_bits_ > 0)
+    {
+        const uint16_t poly = 0x8408;
+
+        crc_deltas_.resize(max_frame_bits_);
+
+        uint16_t delta = poly;
+        for (size_t d = 0; d < max_frame_bits_; d++)
+        {
+            crc_deltas_[d] = delta;
+            delta = static_cast<uint16_t>((delta >> 1) ^ ((delta & 1) ? poly : 0));
+        }
+    }
+}
+
+size_t hdlc_deframer::process(const uint8_t* bits, size_t count, std::vector<std::vector<uint8_t>>& frames)
+{
+    return process(bits, nullptr, count, frames);
+}
+
+size_t hdlc_deframer::process(const uint8_t* bits, const float* confidence, size_t count, std::vector<std::vector<uint8_t>>& frames)
+{
+    size_t found = 0;
+
+    const bool soft = confidence != nullptr && repair_bits_ > 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        // NRZI: no transition = 1, transition = 0
+
+        int level = bits[i] & 1;
+        uint8_t bit = (level == prev_level_) ? 1 : 0;
+        prev_level_ = level;
+
+        pattern_ = static_cast<uint8_t>((pattern_ >> 1) | (bit << 7));
+
+        if (pattern_ == 0x7E)
+        {
+            // Flag, closes the current frame and opens the next one
+
+            end_frame(frames, found);
+            in_frame_ = true;
+            ones_ = 0;
+            continue;
+        }
+
+        int32_t data_index = -1;
+
+        if (bit == 1)
+        {
+            ones_++;
+
+            if (ones_ >= 7)
+            {
+                // Abort or idle line, wait for the next flag
+
+                in_frame_ = false;
+                frame_bits_.clear();
+                frame_line_.clear();
+                continue;
+            }
+
+            data_index = static_cast<int32_t>(frame_bits_.size());
+            frame_bits_.push_back(1);
+        }
+        else
+        {
+            // A 0 after five 1s is a stuffed bit
+
+            if (ones_ != 5)
+            {
+                data_index = static_cast<int32_t>(frame_bits_.size());
+                frame_bits_.push_back(0);
+            }
+
+            ones_ = 0;
+        }
+
+        if (soft)
+        {
+            frame_line_.push_back({ confidence[i], data_index });
+        }
+
+        if (frame_bits_.size() > max_frame_bits_)
+        {
+            in_frame_ = false;
+            frame_bits_.clear();
+            frame_line_.clear();
+        }
+    }
+
+    return found;
+}
+
+void hdlc_deframer::end_frame(std::vector<std::vector<uint8_t>>& frames, size_t& found)
+{
+    // The first seven bits of the closing flag were already collected
+
+    size_t frame_size = frame_bits_.size() >= 7 ? frame_bits_.size() - 7 : 0;
+
+    if (in_frame_ && frame_size >= 18 * 8 && frame_size % 8 == 0)
+    {
+        std::vector<uint8_t> frame_bytes;
+        frame_bytes.reserve(frame_size / 8);
+
+        bits_to_bytes(frame_bits_.begin(), frame_bits_.begin() + frame_size, std::back_inserter(frame_bytes));
+
+        std::array<uint8_t, 2> computed_crc = compute_crc(frame_bytes.begin(), frame_bytes.end() - 2);
+
+        if (computed_crc[0] == frame_bytes[frame_bytes.size() - 2] && computed_crc[1] == frame_bytes[frame_bytes.size() - 1])
+        {
+            frames.push_back(std::move(frame_bytes));
+            found++;
+        }
+        else if (!frame_line_.empty())
+        {
+            uint16_t computed = static_cast<uint16_t>(computed_crc[0] | (computed_crc[1] << 8));
+            uint16_t received = static_cast<uint16_t>(frame_bytes[frame_bytes.size() - 2] | (frame_bytes[frame_bytes.size() - 1] << 8));
+
+            if (try_repair(frame_bytes, computed ^ received))
+            {
+                frames.push_back(std::move(frame_bytes));
+                found++;
+            }
+        }
+    }
+
+    frame_bits_.clear();
+    frame_line_.clear();
+}
+
+bool hdlc_deframer::try_repair(std::vector<uint8_t>& frame_bytes, uint16_t syndrome)
+{
+    // Bounded bit flip search on a frame that failed the CRC
+    //
+    //   - A wrong line bit flips two decoded bits, the NRZI transitions
+    //     before and after it, only line bits whose two decoded bits are
+    //     both frame bits are candidates, flipping a stuffed bit or a flag
+    //     bit would change the framing
+    //   - Flipping frame bit k changes the computed CRC by crc_deltas_[d],
+    //     d bits from the end of the data, or the received CRC by one bit,
+    //     the syndrome is computed XOR received, a combination of flips
+    //     repairs the frame when its deltas XOR to the syndrome
+    //   - Only the repair_bits least confident line bits are tried, up to
+    //     max_flips at a time, the cost per failed frame is fixed, at most
+    //     C(repair_bits, 1) + ... + C(repair_bits, max_flips) XORs
+
+    repair_stats_.attempts++;
+
+    const size_t frame_bits = frame_bytes.size() * 8;
+    const size_t data_bits = frame_bits - 16;
+
+    auto delta = [&](int32_t index) -> uint16_t {
+        size_t k = static_cast<size_t>(index);
+        return k < data_bits ? crc_deltas_[data_bits - 1 - k] : static_cast<uint16_t>(1u << (k - data_bits));
+    };
+
+    candidates_.clear();
+    for (size_t k = 0; k + 1 < frame_line_.size(); k++)
+    {
+        int32_t a = frame_line_[k].data_index;
+        int32_t b = frame_line_[k + 1].data_index;
+        if (a >= 0 && b >= 0 && static_cast<size_t>(b) < frame_bits)
+        {
+            candidates_.push_back(static_cast<uint32_t>(k));
+        }
+    }
+
+    size_t count = (std::min)(repair_bits_, candidates_.size());
+
+    std::partial_sort(candidates_.begin(), candidates_.begin() + count, candidates_.end(), [&](uint32_t x, uint32_t y) {
+        return frame_line_[x].confidence < frame_line_[y].confidence;
+    });
+
+    candidates_.resize(count);
+
+    candidate_deltas_.clear();
+    for (uint32_t k : candidates_)
+    {
+        candidate_deltas_.push_back(static_cast<uint16_t>(delta(frame_line_[k].data_index) ^ delta(frame_line_[k + 1].data_index)));
+    }
+
+    // Fewest flips first, a single error is the most likely
+
+    for (int flips = 1; flips <= max_flips_; flips++)
+    {
+        chosen_.clear();
+
+        if (!search(0, flips, syndrome))
+        {
+            continue;
+        }
+
+        for (size_t c : chosen_)
+        {
+            uint32_t k = candidates_[c];
+            for (int32_t index : { frame_line_[k].data_index, frame_line_[k + 1].data_index })
+            {
+                frame_bytes[index / 8] ^= static_cast<uint8_t>(1u << (index % 8));
+            }
+        }
+
+        repair_stats_.repairs++;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool hdlc_deframer::search(size_t start, int flips_left, uint16_t syndrome)
+{
+    // Depth first over combinations, the syndrome is reduced by every flip
+
+    for (size_t c = start; c < candidate_deltas_.size(); c++)
+    {
+        uint16_t remaining = syndrome ^ candidate_deltas_[c];
+
+        chosen_.push_back(c);
+
+        if (flips_left == 1)
+        {
+            repair_stats_.candidates++;
+
+            if (remaining == 0)
+            {
+                return true;
+            }
+        }
+        else if (search(c + 1, flips_left - 1, remaining))
+        {
+            return true;
+        }
+
+        chosen_.pop_back();
+    }
+
+    return false;
+}
+
+void hdlc_deframer::reset()
+{
+    prev_level_ = -1;
+    pattern_ = 0;
+    ones_ = 0;
+    in_frame_ = false;
+    frame_bits_.clear();
+    frame_line_.clear();
+}
+
+const crc_repair_stats& hdlc_deframer::repair_stats() const
+{
+    return repair_stats_;
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// frame_dedup                                                      //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+frame_dedup::frame_dedup(uint64_t window) : window_(window)
+{
+}
+
+bool frame_dedup::insert(const std::vector<uint8_t>& frame, uint64_t time)
+{
+    // Returns true when the frame is new, false for a duplicate
+
+    while (!entries_.empty() && entries_.front().time + window_ < time)
+    {
+        entries_.pop_front();
+    }
+
+    std::array<uint8_t, 2> crc = { 0, 0 };
+    if (frame.size() >= 2)
+    {
+        crc = { frame[frame.size() - 2], frame[frame.size() - 1] };
+    }
+
+    for (const entry& e : entries_)
+    {
+        if (e.crc == crc && e.frame == frame)
+        {
+            return false;
+        }
+    }
+
+    entries_.push_back({ crc, time, frame });
+
+    return true;
+}
+
+void frame_dedup::clear()
+{
+    entries_.clear();
+}
@@ -0,0 +1,279 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// decoder.h
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <array>
+
+#include "bitstream.h"
+
+#include "external/aprsroute.hpp"
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// hdlc_deframer                                                    //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Incremental HDLC deframer
+//
+// Same steps as try_decode_basic_bitstream, one bit at a time, so the
+// demodulated bits can be fed in blocks of any size:
+//
+//   - NRZI decoding, the level carries across calls
+//   - Flag detection, abort on seven or more consecutive 1s
+//   - Bit unstuffing
+//   - Frames with a valid CRC are returned as bytes, CRC included
+//
+// With per-bit confidences from a soft demodulator, a frame that fails the
+// CRC is repaired by flipping up to max_flips of its repair_bits least
+// confident line bits, repair_bits = 0 disables the repair
+
+struct crc_repair_stats
+{
+    uint64_t attempts = 0;     // Frames that failed the CRC and were searched
+    uint64_t repairs = 0;      // Frames recovered by flipping bits
+    uint64_t candidates = 0;   // Bit flip combinations tested
+};
+
+struct hdlc_deframer
+{
+    hdlc_deframer(size_t max_frame_size = 1024, size_t repair_bits = 0, int max_flips = 2);
+
+    size_t process(const uint8_t* bits, size_t count, std::vector<std::vector<uint8_t>>& frames);
+    size_t process(const uint8_t* bits, const float* confidence, size_t count, std::vector<std::vector<uint8_t>>& frames);
+    void reset();
+
+    const crc_repair_stats& repair_stats() const;
+
+private:
+    struct line_bit
+    {
+        float confidence;       // Demodulator confidence in the line bit
+        int32_t data_index;     // Frame bit decoded at this line bit, -1 for a stuffed bit
+    };
+
+    void end_frame(std::vector<std::vector<uint8_t>>& frames, size_t& found);
+    bool try_repair(std::vector<uint8_t>& frame_bytes, uint16_t syndrome);
+    bool search(size_t start, int flips_left, uint16_t syndrome);
+
+    size_t max_frame_bits_;
+    size_t repair_bits_;            // Least confident line bits considered for a repair
+    int max_flips_;                 // Most line bits flipped together
+    int prev_level_ = -1;           // Previous NRZI level, -1 before the first bit
+    uint8_t pattern_ = 0;           // Last eight decoded bits, newest in the MSB
+    int ones_ = 0;                  // Consecutive decoded 1s
+    bool in_frame_ = false;         // An opening flag was seen
+    std::vector<uint8_t> frame_bits_;
+    std::vector<line_bit> frame_line_;       // Line bits of the current frame, only with confidences
+    std::vector<uint16_t> crc_deltas_;       // CRC change when flipping a frame bit, by distance from the end of the data
+    std::vector<uint32_t> candidates_;       // Scratch, line bits considered for the repair
+    std::vector<uint16_t> candidate_deltas_; // Scratch, CRC change for flipping each candidate
+    std::vector<size_t> chosen_;             // Scratch, candidates flipped by the search
+    crc_repair_stats repair_stats_;
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// frame_dedup                                                      //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Duplicate filter for frames decoded by several decoders
+//
+// Frames are keyed by their CRC, and compared byte for byte on a key match
+// A frame is a duplicate if it was seen less than window samples ago
+
+struct frame_dedup
+{
+    frame_dedup(uint64_t window = 24000);
+
+    bool insert(const std::vector<uint8_t>& frame, uint64_t time);
+    void clear();
+
+private:
+    struct entry
+    {
+        std::array<uint8_t, 2> crc;
+        uint64_t time;
+        std::vector<uint8_t> frame;
+    };
+
+    uint64_t window_;
+    std::deque<entry> entries_; // Oldest first
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// decoder_bank                                                     //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+struct decoder_variant_stats
+{
+    uint64_t decoded = 0;   // Frames with a valid CRC
+    uint64_t first = 0;     // Frames this variant delivered before any other variant
+};
+
+// Runs several demodulator variants over the same audio
+//
+//   - Variants differ by slicer threshold, filter bandwidth or timing offset,
+//     each one has its own incremental deframer
+//   - Frames are merged through frame_dedup, so a frame decoded by several
+//     variants is reported once
+//   - decoder_variant_stats shows which variants earn their CPU,
+//     a variant that is never first is not adding decodes
+//
+// The Demodulator type provides demodulate(const double*, size_t, std::vector<uint8_t>&)
+// and returns NRZI line bits, ex: g3ruh_demodulator
+
+template<typename Demodulator>
+struct decoder_bank
+{
+    decoder_bank(int sample_rate = 48000, double dedup_window_ms = 500.0);
+
+    size_t add_variant(const Demodulator& demodulator);
+    size_t variants() const;
+    Demodulator& variant(size_t index);
+    const decoder_variant_stats& stats(size_t index) const;
+
+    size_t process(const double* samples, size_t count, std::vector<aprs::router::packet>& packets);
+    void reset();
+
+private:
+    struct decoder_variant
+    {
+        Demodulator demodulator;
+        hdlc_deframer deframer;
+        decoder_variant_stats stats;
+    };
+
+    std::vector<decoder_variant> variants_;
+    frame_dedup dedup_;
+    uint64_t position_ = 0;                   // Samples processed so far
+    std::vector<uint8_t> bits_;               // Scratch, reused across calls
+    std::vector<std::vector<uint8_t>> frames_; // Scratch, reused across calls
+};
+
+template<typename Demodulator>
+inline decoder_bank<Demodulator>::decoder_bank(int sample_rate, double dedup_window_ms) : dedup_(static_cast<uint64_t>(sample_rate * dedup_window_ms / 1000.0))
+{
+}
+
+template<typename Demodulator>
+inline size_t decoder_bank<Demodulator>::add_variant(const Demodulator& demodulator)
+{
+    variants_.push_back({ demodulator, hdlc_deframer(), {} });
+    return variants_.size() - 1;
+}
+
+template<typename Demodulator>
+inline size_t decoder_bank<Demodulator>::variants() const
+{
+    return variants_.size();
+}
+
+template<typename Demodulator>
+inline Demodulator& decoder_bank<Demodulator>::variant(size_t index)
+{
+    return variants_[index].demodulator;
+}
+
+template<typename Demodulator>
+inline const decoder_variant_stats& decoder_bank<Demodulator>::stats(size_t index) const
+{
+    return variants_[index].stats;
+}
+
+template<typename Demodulator>
+inline size_t decoder_bank<Demodulator>::process(const double* samples, size_t count, std::vector<aprs::router::packet>& packets)
+{
+    // Every variant sees the same block, the frames are timestamped with
+    // the end of the block, close enough for duplicate detection
+
+    position_ += count;
+
+    size_t found = 0;
+
+    for (decoder_variant& v : variants_)
+    {
+        bits_.clear();
+        frames_.clear();
+
+        v.demodulator.demodulate(samples, count, bits_);
+        v.deframer.process(bits_.data(), bits_.size(), frames_);
+
+        for (const std::vector<uint8_t>& frame : frames_)
+        {
+            v.stats.decoded++;
+
+            if (!dedup_.insert(frame, position_))
+            {
+                continue;
+            }
+
+            aprs::router::packet p;
+            if (try_decode_frame(frame, p))
+            {
+                v.stats.first++;
+                packets.push_back(p);
+                found++;
+            }
+        }
+    }
+
+    return found;
+}
+
+template<typename Demodulator>
+inline void decoder_bank<Demodulator>::reset()
+{
+    for (decoder_variant& v : variants_)
+    {
+        v.demodulator.reset();
+        v.deframer.reset();
+        v.stats = {};
+    }
+
+    dedup_.clear();
+    position_ = 0;
+}
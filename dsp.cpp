@@ -0,0 +1,1176 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// dsp.cpp
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "dsp.h"
+
+#include <cassert>
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// polyphase_resampler                                              //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+polyphase_resampler::polyphase_resampler(int input_sample_rate, int output_sample_rate, int taps_per_phase) : input_sample_rate_(input_sample_rate), output_sample_rate_(output_sample_rate), taps_per_phase_(taps_per_phase)
+{
+    constexpr double pi = 3.14159265358979323846;
+
+    // Reduce the rate ratio to L/M
+    // For 48000 -> 44100: L = 147, M = 160
+
+    int divisor = std::gcd(input_sample_rate, output_sample_rate);
+    interpolation_ = output_sample_rate / divisor;
+    decimation_ = input_sample_rate / divisor;
+
+    // Prototype low-pass filter at the upsampled rate (L * input_sample_rate)
+    // Cutoff at the lower of the two Nyquist frequencies, normalized to the upsampled rate
+    // Kaiser window with beta = 8 gives ~80 dB stopband rejection
+
+    const int L = interpolation_;
+    const int T = taps_per_phase_;
+    const int N = L * T;
+    const double cutoff = 0.5 * (std::min)(1.0, static_cast<double>(L) / decimation_) / L * 0.95;
+    const double beta = 8.0;
+    const double center = (N - 1) / 2.0;
+
+    std::vector<double> prototype(N);
+    double sum = 0.0;
+    for (int n = 0; n < N; n++)
+    {
+        double t = n - center;
+        double sinc = (t == 0.0) ? 2.0 * cutoff : std::sin(2.0 * pi * cutoff * t) / (pi * t);
+        double r = 2.0 * n / (N - 1) - 1.0;
+        double window = bessel_i0(beta * std::sqrt((std::max)(0.0, 1.0 - r * r))) / bessel_i0(beta);
+        prototype[n] = sinc * window;
+        sum += prototype[n];
+    }
+
+    // Decompose into L polyphase branches
+    // Branch p, tap k = h[p + k * L], stored time-reversed so that the
+    // dot product walks the history from oldest to newest sample
+    // Each branch is scaled so the interpolated output has unity gain
+
+    filters_.resize(static_cast<size_t>(N));
+    for (int p = 0; p < L; p++)
+    {
+        for (int k = 0; k < T; k++)
+        {
+            filters_[static_cast<size_t>(p) * T + (T - 1 - k)] = prototype[p + k * L] * L / sum;
+        }
+    }
+
+    history_.assign(static_cast<size_t>(2 * T), 0.0);
+}
+
+void polyphase_resampler::process(const double* input, size_t count, std::vector<double>& output)
+{
+    // Streaming rational resampler
+    //
+    // Every input sample advances the upsampled time grid by L steps,
+    // every output sample is taken M steps after the previous one.
+    // Only the branch that lands on an output sample is evaluated,
+    // the zero-stuffed samples of the upsampled signal are never computed.
+
+    const size_t T = static_cast<size_t>(taps_per_phase_);
+
+    output.reserve(output.size() + output_size(count));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        // Write the sample twice, the window [pos + 1, pos + T] is always contiguous
+        history_[history_pos_] = input[i];
+        history_[history_pos_ + T] = input[i];
+        history_pos_ = (history_pos_ + 1) % T;
+
+        const double* window = &history_[history_pos_];
+
+        while (phase_ < interpolation_)
+        {
+            const double* filter = &filters_[static_cast<size_t>(phase_) * T];
+
+            // Contiguous multiply-accumulate, vectorized by the compiler
+            double y = 0.0;
+            for (size_t k = 0; k < T; k++)
+            {
+                y += filter[k] * window[k];
+            }
+
+            output.push_back(y);
+
+            phase_ += decimation_;
+        }
+
+        phase_ -= interpolation_;
+    }
+}
+
+void polyphase_resampler::flush(std::vector<double>& output)
+{
+    // Push the samples still inside the filter window out with zeros
+    std::vector<double> zeros(static_cast<size_t>(taps_per_phase_), 0.0);
+    process(zeros.data(), zeros.size(), output);
+}
+
+size_t polyphase_resampler::output_size(size_t input_count) const
+{
+    return static_cast<size_t>((static_cast<uint64_t>(input_count) * interpolation_) / decimation_) + 1;
+}
+
+size_t polyphase_resampler::delay() const
+{
+    // Group delay of the linear phase prototype filter, in output samples
+    // (N - 1) / 2 samples at the upsampled rate, M upsampled samples per output sample
+    double n = static_cast<double>(interpolation_) * taps_per_phase_;
+    return static_cast<size_t>(std::lround((n - 1.0) / (2.0 * decimation_)));
+}
+
+void polyphase_resampler::reset()
+{
+    phase_ = 0;
+    history_pos_ = 0;
+    std::fill(history_.begin(), history_.end(), 0.0);
+}
+
+int polyphase_resampler::input_sample_rate() const
+{
+    return input_sample_rate_;
+}
+
+int polyphase_resampler::output_sample_rate() const
+{
+    return output_sample_rate_;
+}
+
+void resample_frame(polyphase_resampler& resampler, const std::vector<double>& input, std::vector<double>& output)
+{
+    // Each transmission is independent, start from a clean filter state
+    // and flush the filter tail so the end of the frame is not cut off
+
+    output.clear();
+
+    resampler.reset();
+    resampler.process(input.data(), input.size(), output);
+    resampler.flush(output);
+
+    // Remove the filter group delay, keeps the bit timing aligned to the start of the buffer
+
+    size_t delay = (std::min)(resampler.delay(), output.size());
+
+    output.erase(output.begin(), output.begin() + delay);
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// first_order_iir                                                  //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+first_order_iir::first_order_iir(double b0, double b1, double a1) : b0_(b0), b1_(b1), a1_(a1)
+{
+    // Impulse response of the feedback path, until it decays below double precision
+    // Filters with a pole too close to 1 leave the table empty and run serially
+
+    constexpr size_t max_powers = 8192;
+
+    double power = a1;
+    while (std::abs(power) >= 1e-17 && powers_.size() < max_powers)
+    {
+        powers_.push_back(power);
+        power *= a1;
+    }
+
+    if (std::abs(power) >= 1e-17)
+    {
+        powers_.clear();
+    }
+}
+
+void first_order_iir::process(double* data, size_t count)
+{
+    // Block-parallel first-order IIR
+    //
+    //   y[n] = b0 * x[n] + b1 * x[n-1] + a1 * y[n-1]
+    //
+    // The recursion is serial, every output waits on the previous one.
+    // Split the buffer into lanes contiguous segments and run the lanes in lockstep:
+    //
+    //   1. Every lane runs the recursion from a zero state, the lanes are
+    //      independent, the lanes-wide inner loop keeps lanes multiply-add
+    //      chains in flight instead of one, the gain is mostly from hiding
+    //      the latency, the lanes are strided so the loads are not one
+    //      contiguous vector
+    //      Measured 1.3x to 3.4x the serial loop at -O2 depending on the
+    //      machine, up to 8x with -O3 -march=native, see the disabled
+    //      first_order_iir benchmark. Staging the lanes interleaved for
+    //      contiguous vector loads measured slower, the transposes cost
+    //      more than they save
+    //   2. Fix up: the true output of lane k is its partial output plus the
+    //      response to the state carried in from lane k - 1
+    //
+    //        y[k * S + i] += a1^(i + 1) * y[k * S - 1]
+    //
+    //      The powers of a1 are precomputed, the correction decays geometrically
+    //      and stops once negligible, the loop has no dependency and vectorizes
+    //
+    // Lane 0 starts from the real filter state, so it needs no fix up
+
+    constexpr size_t lanes = 8;
+    constexpr size_t min_lane_size = 64;
+
+    if (count < lanes * min_lane_size || powers_.empty() || a1_ == 0.0)
+    {
+        process_scalar(data, count);
+        return;
+    }
+
+    const size_t S = count / lanes;
+
+    // Read the lane boundary inputs before they get overwritten
+
+    double x_prev[lanes];
+    double y_state[lanes];
+
+    x_prev[0] = x_prev_;
+    y_state[0] = y_prev_;
+
+    for (size_t k = 1; k < lanes; k++)
+    {
+        x_prev[k] = data[k * S - 1];
+        y_state[k] = 0.0;
+    }
+
+    // Partial results, all lanes in lockstep
+
+    for (size_t i = 0; i < S; i++)
+    {
+        for (size_t k = 0; k < lanes; k++)
+        {
+            double x = data[k * S + i];
+            double y = b0_ * x + b1_ * x_prev[k] + a1_ * y_state[k];
+            x_prev[k] = x;
+            y_state[k] = y;
+            data[k * S + i] = y;
+        }
+    }
+
+    // Carry the state across lanes
+
+    const size_t fix_up_size = (std::min)(S, powers_.size());
+    const double* powers = powers_.data();
+
+    for (size_t k = 1; k < lanes; k++)
+    {
+        const double carry = data[k * S - 1];
+        double* lane = &data[k * S];
+
+        for (size_t i = 0; i < fix_up_size; i++)
+        {
+            lane[i] += powers[i] * carry;
+        }
+    }
+
+    x_prev_ = x_prev[lanes - 1];
+    y_prev_ = data[lanes * S - 1];
+
+    // Remaining samples that don't fill a lane
+
+    process_scalar(data + lanes * S, count - lanes * S);
+}
+
+void first_order_iir::process_scalar(double* data, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        double x = data[i];
+        double y = b0_ * x + b1_ * x_prev_ + a1_ * y_prev_;
+        x_prev_ = x;
+        y_prev_ = y;
+        data[i] = y;
+    }
+}
+
+void first_order_iir::reset()
+{
+    x_prev_ = 0.0;
+    y_prev_ = 0.0;
+}
+
+void first_order_iir::reset(double x_prev, double y_prev)
+{
+    x_prev_ = x_prev;
+    y_prev_ = y_prev;
+}
+
+first_order_iir make_preemphasis_filter(int sample_rate, double tau)
+{
+    // Same filter as apply_preemphasis
+    // H(z) = (1 - z^-1) / (1 - alpha * z^-1)
+    double alpha = std::exp(-1.0 / (sample_rate * tau));
+    return first_order_iir(1.0, -1.0, alpha);
+}
+
+first_order_iir make_deemphasis_filter(int sample_rate, double tau)
+{
+    // First-order low-pass with the same time constant, for the receive path
+    // H(z) = (1 - alpha) / (1 - alpha * z^-1)
+    double alpha = std::exp(-1.0 / (sample_rate * tau));
+    return first_order_iir(1.0 - alpha, 0.0, alpha);
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// bessel_i0                                                        //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+double bessel_i0(double x)
+{
+    // Modified Bessel function of the first kind, order 0
+    // Used for Kaiser window design
+    double sum = 1.0;
+    double term = 1.0;
+    double x_half_sq = (x * 0.5) * (x * 0.5);
+
+    for (int k = 1; k < 50; k++)
+    {
+        term *= x_half_sq / (k * k);
+        sum += term;
+
+        if (term < 1e-12 * sum)
+        {
+            break;
+        }
+    }
+
+    return sum;
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// fir_decimator                                                    //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+fir_decimator::fir_decimator(int factor, int taps_per_phase, double cutoff) : factor_(factor)
+{
+    constexpr double pi = 3.14159265358979323846;
+
+    // Kaiser windowed sinc, same design as the resampler prototype filter
+    // Cutoff by default at 80% of the output Nyquist frequency, normalized to the input rate
+    // ex: 48 kHz / 4 passes up to 4.8 kHz, stops before 6 kHz
+
+    const int N = factor * taps_per_phase;
+    if (cutoff <= 0.0)
+    {
+        cutoff = 0.5 / factor * 0.8;
+    }
+    const double beta = 8.0;
+    const double center = (N - 1) / 2.0;
+
+    taps_.resize(N);
+
+    double sum = 0.0;
+    for (int n = 0; n < N; n++)
+    {
+        double t = n - center;
+        double sinc = (t == 0.0) ? 2.0 * cutoff : std::sin(2.0 * pi * cutoff * t) / (pi * t);
+        double r = 2.0 * n / (N - 1) - 1.0;
+        double window = bessel_i0(beta * std::sqrt((std::max)(0.0, 1.0 - r * r))) / bessel_i0(beta);
+        taps_[n] = sinc * window;
+        sum += taps_[n];
+    }
+
+    // Unity gain at DC
+
+    for (double& tap : taps_)
+    {
+        tap /= sum;
+    }
+
+    history_.assign(2 * N, 0.0);
+}
+
+void fir_decimator::process(const double* input, size_t count, std::vector<double>& output)
+{
+    // Every input sample goes into the history ring, written twice so the
+    // last N samples are always contiguous, the filter is a straight dot
+    // product that the compiler vectorizes, computed once every factor samples
+    // The taps are symmetric, no need to reverse them
+
+    const size_t N = taps_.size();
+    const double* taps = taps_.data();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        history_[history_pos_] = input[i];
+        history_[history_pos_ + N] = input[i];
+        history_pos_ = (history_pos_ + 1 == N) ? 0 : history_pos_ + 1;
+
+        if (++phase_ < factor_)
+        {
+            continue;
+        }
+
+        phase_ = 0;
+
+        const double* window = &history_[history_pos_];
+
+        double sum0 = 0.0;
+        double sum1 = 0.0;
+        double sum2 = 0.0;
+        double sum3 = 0.0;
+
+        size_t k = 0;
+        for (; k + 4 <= N; k += 4)
+        {
+            sum0 += window[k] * taps[k];
+            sum1 += window[k + 1] * taps[k + 1];
+            sum2 += window[k + 2] * taps[k + 2];
+            sum3 += window[k + 3] * taps[k + 3];
+        }
+        for (; k < N; k++)
+        {
+            sum0 += window[k] * taps[k];
+        }
+
+        output.push_back((sum0 + sum1) + (sum2 + sum3));
+    }
+}
+
+size_t fir_decimator::delay() const
+{
+    // Group delay of the linear phase filter, in output samples
+    return static_cast<size_t>(std::lround((taps_.size() - 1.0) / (2.0 * factor_)));
+}
+
+void fir_decimator::reset()
+{
+    std::fill(history_.begin(), history_.end(), 0.0);
+    history_pos_ = 0;
+    phase_ = 0;
+}
+
+int fir_decimator::factor() const
+{
+    return factor_;
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// energy_detector                                                  //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+energy_detector::energy_detector(int sample_rate, double block_ms, double threshold_db, double hang_ms) :
+    block_size_((std::max)(static_cast<size_t>(sample_rate * block_ms / 1000.0), size_t(1))),
+    threshold_(std::pow(10.0, threshold_db / 10.0)),
+    hang_blocks_(static_cast<size_t>(std::ceil(hang_ms / block_ms)))
+{
+}
+
+bool energy_detector::process(const double* samples, size_t count)
+{
+    // Sum of squares over whole blocks, four partial sums so the loop vectorizes
+    // Returns the detector state after the last complete block
+
+    while (count > 0)
+    {
+        size_t n = (std::min)(count, block_size_ - block_pos_);
+
+        double sum0 = 0.0;
+        double sum1 = 0.0;
+        double sum2 = 0.0;
+        double sum3 = 0.0;
+
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            sum0 += samples[i] * samples[i];
+            sum1 += samples[i + 1] * samples[i + 1];
+            sum2 += samples[i + 2] * samples[i + 2];
+            sum3 += samples[i + 3] * samples[i + 3];
+        }
+        for (; i < n; i++)
+        {
+            sum0 += samples[i] * samples[i];
+        }
+
+        block_energy_ += (sum0 + sum1) + (sum2 + sum3);
+        block_pos_ += n;
+
+        if (block_pos_ == block_size_)
+        {
+            end_block();
+        }
+
+        samples += n;
+        count -= n;
+    }
+
+    return detected();
+}
+
+void energy_detector::end_block()
+{
+    // Absolute floor, digital silence would otherwise make any noise a signal
+    constexpr double min_power = 1e-8;
+
+    double power = block_energy_ / block_size_;
+
+    block_energy_ = 0.0;
+    block_pos_ = 0;
+
+    if (noise_floor_ < 0.0)
+    {
+        noise_floor_ = power;
+    }
+
+    if (power > (std::max)(noise_floor_, min_power) * threshold_)
+    {
+        hang_ = hang_blocks_ + 1;
+        return;
+    }
+
+    if (hang_ > 0)
+    {
+        hang_--;
+    }
+
+    // Track the noise floor only while there is no signal
+    // Falls fast, rises slowly, a burst of noise doesn't raise it much
+
+    if (hang_ == 0)
+    {
+        double rate = power < noise_floor_ ? 0.5 : 0.01;
+        noise_floor_ += (power - noise_floor_) * rate;
+    }
+}
+
+bool energy_detector::detected() const
+{
+    return hang_ > 0;
+}
+
+double energy_detector::noise_floor() const
+{
+    return noise_floor_;
+}
+
+void energy_detector::reset()
+{
+    block_pos_ = 0;
+    block_energy_ = 0.0;
+    noise_floor_ = -1.0;
+    hang_ = 0;
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// sliding_dft                                                      //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+sliding_dft::sliding_dft(double frequency, size_t window, int sample_rate) : re_(window, 0.0), im_(window, 0.0)
+{
+    constexpr double two_pi = 2.0 * 3.14159265358979323846;
+
+    step_re_ = std::cos(two_pi * frequency / sample_rate);
+    step_im_ = std::sin(two_pi * frequency / sample_rate);
+}
+
+void sliding_dft::update(double x)
+{
+    // Mix with e^(-j w n), add the new product, remove the one leaving the window
+
+    double product_re = x * osc_re_;
+    double product_im = -x * osc_im_;
+
+    sum_re_ += product_re - re_[pos_];
+    sum_im_ += product_im - im_[pos_];
+
+    re_[pos_] = product_re;
+    im_[pos_] = product_im;
+
+    double next_re = osc_re_ * step_re_ - osc_im_ * step_im_;
+    double next_im = osc_re_ * step_im_ + osc_im_ * step_re_;
+
+    osc_re_ = next_re;
+    osc_im_ = next_im;
+
+    pos_ = (pos_ + 1 == re_.size()) ? 0 : pos_ + 1;
+
+    // Rounding errors accumulate in the running sums and oscillator,
+    // recompute them from the window once per window
+
+    if (pos_ == 0)
+    {
+        resum();
+    }
+}
+
+double sliding_dft::energy() const
+{
+    return sum_re_ * sum_re_ + sum_im_ * sum_im_;
+}
+
+void sliding_dft::reset()
+{
+    osc_re_ = 1.0;
+    osc_im_ = 0.0;
+    sum_re_ = 0.0;
+    sum_im_ = 0.0;
+    pos_ = 0;
+    std::fill(re_.begin(), re_.end(), 0.0);
+    std::fill(im_.begin(), im_.end(), 0.0);
+}
+
+void sliding_dft::resum()
+{
+    sum_re_ = 0.0;
+    sum_im_ = 0.0;
+
+    for (size_t i = 0; i < re_.size(); i++)
+    {
+        sum_re_ += re_[i];
+        sum_im_ += im_[i];
+    }
+
+    double magnitude = std::sqrt(osc_re_ * osc_re_ + osc_im_ * osc_im_);
+    osc_re_ /= magnitude;
+    osc_im_ /= magnitude;
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// clock_recovery                                                   //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+clock_recovery::clock_recovery(int bitrate, int sample_rate, double phase_gain, double frequency_gain) : step_(static_cast<double>(bitrate) / sample_rate), phase_gain_(phase_gain), frequency_gain_(frequency_gain)
+{
+}
+
+bool clock_recovery::process(double x, double& value)
+{
+    // Phase runs from 0 to 1 over a bit, the bit is sampled when it wraps
+    // Transitions are expected halfway, at phase 0.5
+    //
+    //   - Sampling: when the phase wraps during this sample interval,
+    //     interpolate the input at the exact wrap point
+    //   - Zero crossing: interpolate the crossing point, the distance from
+    //     phase 0.5 is the phase error, corrects the phase (proportional)
+    //     and the rate (integral, follows the clock drift)
+
+    const double increment = step_ + frequency_;
+    double next_phase = phase_ + increment;
+
+    bool sampled = false;
+
+    if (next_phase >= 1.0)
+    {
+        double t = (1.0 - phase_) / increment;
+        value = prev_x_ + t * (x - prev_x_);
+        next_phase -= 1.0;
+        sampled = true;
+    }
+
+    if ((prev_x_ < 0.0) != (x < 0.0) && prev_x_ != x)
+    {
+        double t = prev_x_ / (prev_x_ - x);
+        double crossing_phase = phase_ + t * increment;
+
+        double error = crossing_phase - 0.5;
+        error -= std::floor(error + 0.5); // Wrap into [-0.5, 0.5)
+
+        next_phase -= phase_gain_ * error;
+        frequency_ -= frequency_gain_ * error * step_;
+
+        // Limit the tracked drift to 1% of the bit rate, well beyond sound card clock errors,
+        // a wider range lets the noise between packets walk it far off the bit rate
+
+        frequency_ = (std::max)(-0.01 * step_, (std::min)(0.01 * step_, frequency_));
+    }
+
+    // Keep the phase in [0, 1), the correction can push it across the edges
+    // Pulled back below 0 just delays the next sample, never samples a bit twice
+
+    if (next_phase >= 1.0 && !sampled)
+    {
+        value = x;
+        next_phase -= 1.0;
+        sampled = true;
+    }
+    else if (next_phase < 0.0)
+    {
+        next_phase = 0.0;
+    }
+
+    phase_ = next_phase;
+    prev_x_ = x;
+
+    return sampled;
+}
+
+void clock_recovery::reset()
+{
+    frequency_ = 0.0;
+    phase_ = 0.0;
+    prev_x_ = 0.0;
+}
+
+double clock_recovery::samples_per_bit() const
+{
+    return 1.0 / (step_ + frequency_);
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// fft_channelizer                                                  //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+namespace
+{
+    int channelizer_decimation(int sample_rate)
+    {
+        // Largest factor that divides the sample rate and keeps at least 1600 Hz,
+        // plenty for 300 baud with 200 Hz shift and +-100 Hz of offsets
+        // ex: 48000 / 30 = 1600, 44100 / 25 = 1764
+
+        int factor = (std::max)(1, sample_rate / 1600);
+        while (sample_rate % factor != 0)
+        {
+            factor--;
+        }
+        return factor;
+    }
+}
+
+fft_channelizer::fft_channelizer(int sample_rate, double center_frequency, double shift, int bitrate, double max_offset, double offset_step, size_t fft_size) :
+    sample_rate_(sample_rate / channelizer_decimation(sample_rate)),
+    fft_size_(fft_size),
+    decimator_re_(channelizer_decimation(sample_rate)),
+    decimator_im_(channelizer_decimation(sample_rate))
+{
+    constexpr double two_pi = 2.0 * 3.14159265358979323846;
+
+    assert(fft_size >= 2 && (fft_size & (fft_size - 1)) == 0);
+
+    step_re_ = std::cos(two_pi * center_frequency / sample_rate);
+    step_im_ = -std::sin(two_pi * center_frequency / sample_rate);
+
+    window_ = (std::max)(size_t(1), static_cast<size_t>(std::lround(static_cast<double>(sample_rate_) / bitrate)));
+    window_ = (std::min)(window_, fft_size_);
+
+    history_re_.assign(window_, 0.0);
+    history_im_.assign(window_, 0.0);
+    fft_re_.assign(fft_size_, 0.0);
+    fft_im_.assign(fft_size_, 0.0);
+
+    twiddle_re_.resize(fft_size_ / 2);
+    twiddle_im_.resize(fft_size_ / 2);
+    for (size_t k = 0; k < fft_size_ / 2; k++)
+    {
+        twiddle_re_[k] = std::cos(two_pi * k / fft_size_);
+        twiddle_im_[k] = -std::sin(two_pi * k / fft_size_);
+    }
+
+    bit_reverse_.resize(fft_size_);
+    size_t bits = 0;
+    while ((size_t(1) << bits) < fft_size_)
+    {
+        bits++;
+    }
+    for (size_t i = 0; i < fft_size_; i++)
+    {
+        size_t r = 0;
+        for (size_t b = 0; b < bits; b++)
+        {
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        bit_reverse_[i] = r;
+    }
+
+    // Channels at -max_offset, -max_offset + offset_step, ... max_offset
+    // Offsets and tones are rounded to the nearest bin, negative frequencies wrap
+
+    const double bin_width = static_cast<double>(sample_rate_) / fft_size_;
+
+    auto bin = [&](double frequency) {
+        long long k = std::llround(frequency / bin_width);
+        long long n = static_cast<long long>(fft_size_);
+        return static_cast<size_t>(((k % n) + n) % n);
+    };
+
+    size_t count = offset_step > 0.0 ? static_cast<size_t>(std::floor(2.0 * max_offset / offset_step + 1e-9)) + 1 : 1;
+
+    for (size_t c = 0; c < count; c++)
+    {
+        double offset = std::round((-max_offset + c * offset_step) / bin_width) * bin_width;
+        offsets_.push_back(offset);
+        mark_bins_.push_back(bin(offset - shift / 2.0));
+        space_bins_.push_back(bin(offset + shift / 2.0));
+    }
+}
+
+void fft_channelizer::process(const double* samples, size_t count, std::vector<double>& output)
+{
+    // Single pass for every channel
+    //
+    //   - Mix the whole band down to 0 Hz, the center frequency is now 0 Hz,
+    //     mark and space are at -shift / 2 and +shift / 2 from every channel offset
+    //   - Decimate I and Q, only a few hundred Hz around the center are kept
+    //   - For every decimated sample, the last bit of baseband is zero padded
+    //     and transformed, each FFT bin is a one bit matched filter, and every
+    //     channel reads its mark and space energies from the same transform
+    //
+    // Output is interleaved, channels() discriminator values per decimated sample
+
+    mixed_re_.resize(count);
+    mixed_im_.resize(count);
+
+    double osc_re = osc_re_;
+    double osc_im = osc_im_;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        mixed_re_[i] = samples[i] * osc_re;
+        mixed_im_[i] = samples[i] * osc_im;
+
+        double next_re = osc_re * step_re_ - osc_im * step_im_;
+        double next_im = osc_re * step_im_ + osc_im * step_re_;
+        osc_re = next_re;
+        osc_im = next_im;
+
+        // Renormalize now and then, the rotation slowly drifts off the unit circle
+
+        if ((i & 1023) == 1023)
+        {
+            double magnitude = std::sqrt(osc_re * osc_re + osc_im * osc_im);
+            osc_re /= magnitude;
+            osc_im /= magnitude;
+        }
+    }
+
+    double magnitude = std::sqrt(osc_re * osc_re + osc_im * osc_im);
+    osc_re_ = osc_re / magnitude;
+    osc_im_ = osc_im / magnitude;
+
+    baseband_re_.clear();
+    baseband_im_.clear();
+    decimator_re_.process(mixed_re_.data(), count, baseband_re_);
+    decimator_im_.process(mixed_im_.data(), count, baseband_im_);
+
+    const size_t channels = offsets_.size();
+
+    for (size_t n = 0; n < baseband_re_.size(); n++)
+    {
+        history_re_[history_pos_] = baseband_re_[n];
+        history_im_[history_pos_] = baseband_im_[n];
+        history_pos_ = (history_pos_ + 1 == window_) ? 0 : history_pos_ + 1;
+
+        // Oldest sample first, only the energies are used, the time origin does not matter
+
+        std::fill(fft_re_.begin(), fft_re_.end(), 0.0);
+        std::fill(fft_im_.begin(), fft_im_.end(), 0.0);
+        for (size_t k = 0; k < window_; k++)
+        {
+            size_t j = (history_pos_ + k) % window_;
+            fft_re_[bit_reverse_[k]] = history_re_[j];
+            fft_im_[bit_reverse_[k]] = history_im_[j];
+        }
+
+        transform();
+
+        for (size_t c = 0; c < channels; c++)
+        {
+            size_t m = mark_bins_[c];
+            size_t s = space_bins_[c];
+            double mark_energy = fft_re_[m] * fft_re_[m] + fft_im_[m] * fft_im_[m];
+            double space_energy = fft_re_[s] * fft_re_[s] + fft_im_[s] * fft_im_[s];
+            double total = mark_energy + space_energy;
+            output.push_back(total > 0.0 ? (mark_energy - space_energy) / total : 0.0);
+        }
+    }
+}
+
+void fft_channelizer::transform()
+{
+    // In place radix-2 decimation in time, the input is already in bit reversed order
+
+    for (size_t size = 2; size <= fft_size_; size *= 2)
+    {
+        size_t half = size / 2;
+        size_t stride = fft_size_ / size;
+
+        for (size_t start = 0; start < fft_size_; start += size)
+        {
+            for (size_t k = 0; k < half; k++)
+            {
+                double w_re = twiddle_re_[k * stride];
+                double w_im = twiddle_im_[k * stride];
+
+                size_t a = start + k;
+                size_t b = a + half;
+
+                double t_re = fft_re_[b] * w_re - fft_im_[b] * w_im;
+                double t_im = fft_re_[b] * w_im + fft_im_[b] * w_re;
+
+                fft_re_[b] = fft_re_[a] - t_re;
+                fft_im_[b] = fft_im_[a] - t_im;
+                fft_re_[a] += t_re;
+                fft_im_[a] += t_im;
+            }
+        }
+    }
+}
+
+void fft_channelizer::reset()
+{
+    osc_re_ = 1.0;
+    osc_im_ = 0.0;
+    decimator_re_.reset();
+    decimator_im_.reset();
+    std::fill(history_re_.begin(), history_re_.end(), 0.0);
+    std::fill(history_im_.begin(), history_im_.end(), 0.0);
+    history_pos_ = 0;
+}
+
+size_t fft_channelizer::channels() const
+{
+    return offsets_.size();
+}
+
+double fft_channelizer::offset(size_t channel) const
+{
+    return offsets_[channel];
+}
+
+int fft_channelizer::sample_rate() const
+{
+    return sample_rate_;
+}
+
+size_t fft_channelizer::delay() const
+{
+    // Decimator group delay plus half a bit of FFT window, in channel samples
+    return decimator_re_.delay() + window_ / 2;
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// fm_discriminator                                                 //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+fm_discriminator::fm_discriminator(double deviation, int sample_rate)
+{
+    constexpr double two_pi = 2.0 * 3.14159265358979323846;
+
+    scale_ = sample_rate / (two_pi * deviation);
+}
+
+void fm_discriminator::process(const double* re, const double* im, size_t count, double* output)
+{
+    // arg(z[n] * conj(z[n - 1])), the instantaneous frequency in radians per sample
+    // The products are independent and vectorize, only atan2 stays scalar
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    output[0] = scale_ * std::atan2(im[0] * prev_re_ - re[0] * prev_im_, re[0] * prev_re_ + im[0] * prev_im_);
+
+    for (size_t i = 1; i < count; i++)
+    {
+        double product_re = re[i] * re[i - 1] + im[i] * im[i - 1];
+        double product_im = im[i] * re[i - 1] - re[i] * im[i - 1];
+        output[i] = scale_ * std::atan2(product_im, product_re);
+    }
+
+    prev_re_ = re[count - 1];
+    prev_im_ = im[count - 1];
+}
+
+void fm_discriminator::reset()
+{
+    prev_re_ = 0.0;
+    prev_im_ = 0.0;
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// iq_channel                                                       //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+iq_channel::iq_channel(int sample_rate, double offset, int decimation, double deviation, double deemphasis_tau) :
+    offset_(offset),
+    sample_rate_(sample_rate / decimation),
+    deemphasis_(deemphasis_tau > 0.0),
+    decimator_re_(decimation, 16),
+    decimator_im_(decimation, 16),
+    channel_filter_re_(1, 64, (std::min)((deviation + 5000.0) / (sample_rate / decimation), 0.4)),
+    channel_filter_im_(1, 64, (std::min)((deviation + 5000.0) / (sample_rate / decimation), 0.4)),
+    discriminator_(deviation, sample_rate / decimation),
+    deemphasis_filter_(deemphasis_tau > 0.0 ? make_deemphasis_filter(sample_rate / decimation, deemphasis_tau) : first_order_iir())
+{
+    constexpr double two_pi = 2.0 * 3.14159265358979323846;
+
+    assert(decimation > 0 && sample_rate % decimation == 0);
+
+    // Oscillator table for one block, the running phase is renormalized once per block
+    // The decimators use 16 taps per phase, wideband IQ rates need long filters
+    // The channel filter cutoff sits 2 kHz past the Carson bandwidth, 64 taps
+    // at 48 kHz roll off over about 4 kHz around it
+
+    const double w = two_pi * offset / sample_rate;
+
+    table_re_.resize(block_size + 1);
+    table_im_.resize(block_size + 1);
+    for (size_t i = 0; i <= block_size; i++)
+    {
+        table_re_[i] = std::cos(w * i);
+        table_im_[i] = -std::sin(w * i);
+    }
+}
+
+void iq_channel::process(const double* re, const double* im, size_t count, std::vector<double>& audio)
+{
+    // Every stage works on whole blocks
+    //
+    //   - Mixer: the oscillator for a block is the table rotated by the
+    //     block start phase, complex multiplies with no dependency between
+    //     samples, the compiler vectorizes them
+    //   - Decimator: only every decimation-th output is computed
+    //   - Channel filter, discriminator and de-emphasis run at the audio rate
+
+    mixed_re_.resize(count);
+    mixed_im_.resize(count);
+
+    const double* t_re = table_re_.data();
+    const double* t_im = table_im_.data();
+
+    for (size_t start = 0; start < count; start += block_size)
+    {
+        const size_t n = (std::min)(block_size, count - start);
+
+        const double p_re = phase_re_;
+        const double p_im = phase_im_;
+
+        const double* x_re = re + start;
+        const double* x_im = im + start;
+        double* out_re = mixed_re_.data() + start;
+        double* out_im = mixed_im_.data() + start;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            double osc_re = p_re * t_re[i] - p_im * t_im[i];
+            double osc_im = p_re * t_im[i] + p_im * t_re[i];
+            out_re[i] = x_re[i] * osc_re - x_im[i] * osc_im;
+            out_im[i] = x_re[i] * osc_im + x_im[i] * osc_re;
+        }
+
+        double next_re = p_re * t_re[n] - p_im * t_im[n];
+        double next_im = p_re * t_im[n] + p_im * t_re[n];
+        double magnitude = std::sqrt(next_re * next_re + next_im * next_im);
+
+        phase_re_ = next_re / magnitude;
+        phase_im_ = next_im / magnitude;
+    }
+
+    baseband_re_.clear();
+    baseband_im_.clear();
+    decimator_re_.process(mixed_re_.data(), count, baseband_re_);
+    decimator_im_.process(mixed_im_.data(), count, baseband_im_);
+
+    channel_re_.clear();
+    channel_im_.clear();
+    channel_filter_re_.process(baseband_re_.data(), baseband_re_.size(), channel_re_);
+    channel_filter_im_.process(baseband_im_.data(), baseband_im_.size(), channel_im_);
+
+    const size_t start = audio.size();
+    const size_t produced = channel_re_.size();
+
+    audio.resize(start + produced);
+    discriminator_.process(channel_re_.data(), channel_im_.data(), produced, audio.data() + start);
+
+    if (deemphasis_)
+    {
+        deemphasis_filter_.process(audio.data() + start, produced);
+    }
+}
+
+void iq_channel::reset()
+{
+    phase_re_ = 1.0;
+    phase_im_ = 0.0;
+    decimator_re_.reset();
+    decimator_im_.reset();
+    channel_filter_re_.reset();
+    channel_filter_im_.reset();
+    discriminator_.reset();
+    deemphasis_filter_.reset();
+}
+
+double iq_channel::offset() const
+{
+    return offset_;
+}
+
+int iq_channel::sample_rate() const
+{
+    return sample_rate_;
+}
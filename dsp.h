@@ -0,0 +1,365 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// dsp.h
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// polyphase_resampler                                              //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+struct polyphase_resampler
+{
+    polyphase_resampler(int input_sample_rate = 48000, int output_sample_rate = 44100, int taps_per_phase = 32);
+
+    void process(const double* input, size_t count, std::vector<double>& output);
+    void flush(std::vector<double>& output);
+    size_t output_size(size_t input_count) const;
+    size_t delay() const;
+    void reset();
+
+    int input_sample_rate() const;
+    int output_sample_rate() const;
+
+private:
+    int input_sample_rate_;
+    int output_sample_rate_;
+    int interpolation_;              // L, upsampling factor (reduced by gcd)
+    int decimation_;                 // M, downsampling factor (reduced by gcd)
+    int taps_per_phase_;             // Filter taps per polyphase branch
+    int phase_ = 0;                  // Position on the upsampled time grid, 0 .. L-1
+    size_t history_pos_ = 0;         // Write position in the history ring
+    std::vector<double> filters_;    // L branches of taps_per_phase coefficients each, time-reversed
+    std::vector<double> history_;    // Double-length history ring, so every window is contiguous
+};
+
+// Converts one whole transmission, from a clean filter state, with the
+// filter tail flushed and the group delay removed, the bit timing stays
+// aligned to the start of the buffer
+
+void resample_frame(polyphase_resampler& resampler, const std::vector<double>& input, std::vector<double>& output);
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// first_order_iir                                                  //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+struct first_order_iir
+{
+    first_order_iir(double b0 = 1.0, double b1 = 0.0, double a1 = 0.0);
+
+    void process(double* data, size_t count);
+    void reset();
+    void reset(double x_prev, double y_prev);
+
+private:
+    void process_scalar(double* data, size_t count);
+
+    double b0_;          // Feed-forward coefficient, x[n]
+    double b1_;          // Feed-forward coefficient, x[n-1]
+    double a1_;          // Feedback coefficient, y[n-1]
+    double x_prev_ = 0.0;
+    double y_prev_ = 0.0;
+    std::vector<double> powers_; // a1^1, a1^2, ... until negligible, used for the lane fix up
+};
+
+first_order_iir make_preemphasis_filter(int sample_rate, double tau = 75e-6);
+first_order_iir make_deemphasis_filter(int sample_rate, double tau = 75e-6);
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// fir_decimator                                                    //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Anti-alias low-pass FIR followed by decimation by an integer factor
+// Only every factor-th output is computed
+// cutoff is normalized to the input rate, 0 = 80% of the output Nyquist
+// frequency, factor 1 is a plain low-pass filter
+
+struct fir_decimator
+{
+    fir_decimator(int factor = 4, int taps_per_phase = 32, double cutoff = 0.0);
+
+    void process(const double* input, size_t count, std::vector<double>& output);
+    size_t delay() const;
+    void reset();
+
+    int factor() const;
+
+private:
+    int factor_;                 // Decimation factor
+    int phase_ = 0;              // Input samples since the last output
+    size_t history_pos_ = 0;     // Write position in the history ring
+    std::vector<double> taps_;   // Linear phase low-pass, factor * taps_per_phase coefficients
+    std::vector<double> history_; // Double-length history ring, so every window is contiguous
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// energy_detector                                                  //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Carrier detect from the signal energy
+//
+// The power of short blocks is compared to a tracked noise floor,
+// the detector stays on for a hang time after the energy drops
+
+struct energy_detector
+{
+    energy_detector(int sample_rate = 48000, double block_ms = 5.0, double threshold_db = 6.0, double hang_ms = 100.0);
+
+    bool process(const double* samples, size_t count);
+    bool detected() const;
+    double noise_floor() const;
+    void reset();
+
+private:
+    void end_block();
+
+    size_t block_size_;          // Samples per power measurement
+    double threshold_;           // Power ratio over the noise floor
+    size_t hang_blocks_;         // Blocks the detector stays on after the energy drops
+    size_t block_pos_ = 0;       // Samples accumulated in the current block
+    double block_energy_ = 0.0;  // Sum of squares in the current block
+    double noise_floor_ = -1.0;  // Mean power of the noise, -1 until the first block
+    size_t hang_ = 0;            // Blocks left before the detector turns off
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// sliding_dft                                                      //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Single DFT bin over the last window samples, updated every sample in O(1)
+
+struct sliding_dft
+{
+    sliding_dft(double frequency = 1200.0, size_t window = 40, int sample_rate = 48000);
+
+    void update(double x);
+    double energy() const;
+    void reset();
+
+private:
+    void resum();
+
+    double osc_re_ = 1.0;        // e^(j w n), rotated every sample
+    double osc_im_ = 0.0;
+    double step_re_;             // e^(j w)
+    double step_im_;
+    double sum_re_ = 0.0;        // Sum of the products in the window
+    double sum_im_ = 0.0;
+    size_t pos_ = 0;             // Ring position
+    std::vector<double> re_;     // Products in the window, ring
+    std::vector<double> im_;
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// clock_recovery                                                   //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Digital PLL bit clock recovery
+//
+// Tracks the zero crossings of a discriminator output, and samples it
+// once per bit, halfway between crossings, with sub-sample precision
+
+struct clock_recovery
+{
+    clock_recovery(int bitrate = 1200, int sample_rate = 48000, double phase_gain = 0.1, double frequency_gain = 0.001);
+
+    bool process(double x, double& value);
+    void reset();
+
+    double samples_per_bit() const;
+
+private:
+    double step_;                // Nominal phase increment per sample, in bits
+    double phase_gain_;          // Proportional loop gain
+    double frequency_gain_;      // Integral loop gain, tracks clock drift
+    double frequency_ = 0.0;     // Phase increment correction, in bits per sample
+    double phase_ = 0.0;         // Bit phase, a bit is sampled when it wraps past 1
+    double prev_x_ = 0.0;
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// fft_channelizer                                                  //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Frequency offset search for narrow AFSK, ex: 300 baud HF with 200 Hz shift
+//
+// The input is mixed down once around the center frequency and decimated,
+// one zero padded FFT of the last bit then gives the mark and space energies
+// of every candidate offset, each channel outputs a discriminator in [-1, 1]
+
+struct fft_channelizer
+{
+    fft_channelizer(int sample_rate = 48000, double center_frequency = 1700.0, double shift = 200.0, int bitrate = 300, double max_offset = 100.0, double offset_step = 25.0, size_t fft_size = 128);
+
+    void process(const double* samples, size_t count, std::vector<double>& output);
+    void reset();
+
+    size_t channels() const;
+    double offset(size_t channel) const;
+    int sample_rate() const;
+    size_t delay() const;
+
+private:
+    void transform();
+
+    int sample_rate_;            // Channel sample rate, after decimation
+    size_t fft_size_;            // Power of two
+    size_t window_;              // Samples per bit at the channel sample rate, rounded
+    double osc_re_ = 1.0;        // e^(-j w n), mixes the center frequency down to 0 Hz
+    double osc_im_ = 0.0;
+    double step_re_;             // e^(-j w)
+    double step_im_;
+    fir_decimator decimator_re_;
+    fir_decimator decimator_im_;
+    std::vector<double> mixed_re_;    // Mixer outputs for the current block
+    std::vector<double> mixed_im_;
+    std::vector<double> baseband_re_; // Decimated outputs for the current block
+    std::vector<double> baseband_im_;
+    std::vector<double> history_re_;  // Last window baseband samples, ring
+    std::vector<double> history_im_;
+    size_t history_pos_ = 0;
+    std::vector<double> fft_re_;      // FFT work buffers
+    std::vector<double> fft_im_;
+    std::vector<double> twiddle_re_;  // e^(-j 2 pi k / fft_size), k < fft_size / 2
+    std::vector<double> twiddle_im_;
+    std::vector<size_t> bit_reverse_;
+    std::vector<double> offsets_;     // Channel offsets, in Hz, rounded to the FFT bins
+    std::vector<size_t> mark_bins_;   // Per channel FFT bins of the mark and space tones
+    std::vector<size_t> space_bins_;
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// fm_discriminator                                                 //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Polar FM discriminator, the phase step between consecutive IQ samples
+// Output is normalized to the peak deviation, +-deviation Hz is +-1
+
+struct fm_discriminator
+{
+    fm_discriminator(double deviation = 5000.0, int sample_rate = 48000);
+
+    void process(const double* re, const double* im, size_t count, double* output);
+    void reset();
+
+private:
+    double scale_;               // Radians per sample to output units
+    double prev_re_ = 0.0;       // Last input sample
+    double prev_im_ = 0.0;
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// iq_channel                                                       //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// One FM channel out of a wideband IQ recording
+//
+// Mixes the channel at offset Hz from the IQ center down to 0 Hz,
+// decimates to the audio rate, FM demodulates, and de-emphasizes
+//
+// The decimator only rejects what would alias, the channel filter at the
+// audio rate then keeps +-(deviation + 3 kHz), the Carson bandwidth of
+// AFSK audio, neighbouring channels never reach the discriminator
+
+struct iq_channel
+{
+    iq_channel(int sample_rate, double offset, int decimation, double deviation = 5000.0, double deemphasis_tau = 75e-6);
+
+    void process(const double* re, const double* im, size_t count, std::vector<double>& audio);
+    void reset();
+
+    double offset() const;
+    int sample_rate() const;
+
+private:
+    static constexpr size_t block_size = 256;
+
+    double offset_;              // Channel offset from the IQ center frequency, in Hz
+    int sample_rate_;            // Audio sample rate
+    bool deemphasis_;            // De-emphasis enabled, tau > 0
+    std::vector<double> table_re_;    // e^(-j w i), i = 0 .. block_size
+    std::vector<double> table_im_;
+    double phase_re_ = 1.0;      // e^(-j w n) at the start of the block
+    double phase_im_ = 0.0;
+    fir_decimator decimator_re_;
+    fir_decimator decimator_im_;
+    fir_decimator channel_filter_re_; // Channel low-pass at the audio rate
+    fir_decimator channel_filter_im_;
+    fm_discriminator discriminator_;
+    first_order_iir deemphasis_filter_;
+    std::vector<double> mixed_re_;    // Mixer outputs for the current call
+    std::vector<double> mixed_im_;
+    std::vector<double> baseband_re_; // Decimated outputs for the current call
+    std::vector<double> baseband_im_;
+    std::vector<double> channel_re_;  // Channel filter outputs for the current call
+    std::vector<double> channel_im_;
+};
+
+double bessel_i0(double x);
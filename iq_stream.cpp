@@ -0,0 +1,245 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// iq_stream.cpp
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "iq_stream.h"
+
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// input_iq_stream                                                  //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+input_iq_stream::input_iq_stream(const std::string& path, iq_format format, int sample_rate)
+{
+    open(path, format, sample_rate);
+}
+
+bool input_iq_stream::open(const std::string& path, iq_format format, int sample_rate)
+{
+    format_ = format;
+    sample_rate_ = sample_rate;
+    position_ = 0;
+    size_ = 0;
+
+    if (!file_.open(path))
+    {
+        return false;
+    }
+
+    // A trailing partial sample is ignored
+
+    const size_t sample_size = (format == iq_format::int16) ? 2 * sizeof(int16_t) : 2 * sizeof(float);
+    size_ = file_.size() / sample_size;
+
+    return true;
+}
+
+void input_iq_stream::close()
+{
+    file_.close();
+    size_ = 0;
+    position_ = 0;
+}
+
+size_t input_iq_stream::read(double* re, double* im, size_t count)
+{
+    size_t n = read(position_, re, im, count);
+    position_ += n;
+    return n;
+}
+
+size_t input_iq_stream::read(size_t offset, double* re, double* im, size_t count) const
+{
+    // De-interleave and convert, the mapping is only read
+    // memcpy keeps the loads legal for any alignment, and compiles to plain loads
+
+    if (offset >= size_)
+    {
+        return 0;
+    }
+
+    const size_t n = (std::min)(count, size_ - offset);
+
+    if (format_ == iq_format::int16)
+    {
+        const uint8_t* data = file_.data() + offset * 2 * sizeof(int16_t);
+        constexpr double scale = 1.0 / 32768.0;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            int16_t sample[2];
+            std::memcpy(sample, data + i * sizeof(sample), sizeof(sample));
+            re[i] = sample[0] * scale;
+            im[i] = sample[1] * scale;
+        }
+    }
+    else
+    {
+        const uint8_t* data = file_.data() + offset * 2 * sizeof(float);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            float sample[2];
+            std::memcpy(sample, data + i * sizeof(sample), sizeof(sample));
+            re[i] = sample[0];
+            im[i] = sample[1];
+        }
+    }
+
+    return n;
+}
+
+bool input_iq_stream::seek(size_t position)
+{
+    if (position > size_)
+    {
+        return false;
+    }
+    position_ = position;
+    return true;
+}
+
+size_t input_iq_stream::position() const
+{
+    return position_;
+}
+
+size_t input_iq_stream::size() const
+{
+    return size_;
+}
+
+int input_iq_stream::sample_rate() const
+{
+    return sample_rate_;
+}
+
+iq_format input_iq_stream::format() const
+{
+    return format_;
+}
+
+bool input_iq_stream::eof() const
+{
+    return position_ >= size_;
+}
+
+bool input_iq_stream::is_open() const
+{
+    return file_.is_open();
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// iq_channel_stream                                                //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+iq_channel_stream::iq_channel_stream(const input_iq_stream& input, double offset, int sample_rate, double deviation, double deemphasis_tau) :
+    input_(&input),
+    channel_(input.sample_rate(), offset, input.sample_rate() / sample_rate, deviation, deemphasis_tau),
+    re_(block_size),
+    im_(block_size)
+{
+    // The IQ rate must be a multiple of the audio rate, ex: 240 kHz for 48 kHz audio
+    assert(input.sample_rate() % sample_rate == 0);
+}
+
+size_t iq_channel_stream::read(double* samples, size_t count)
+{
+    // Demodulates one IQ block at a time, as the audio is consumed
+    // Returns 0 at the end of the recording
+
+    size_t produced = 0;
+
+    while (produced < count && !closed_)
+    {
+        if (audio_pos_ == audio_.size())
+        {
+            audio_.clear();
+            audio_pos_ = 0;
+
+            size_t n = input_->read(position_, re_.data(), im_.data(), block_size);
+            if (n == 0)
+            {
+                break;
+            }
+
+            position_ += n;
+            channel_.process(re_.data(), im_.data(), n, audio_);
+            continue;
+        }
+
+        size_t n = (std::min)(count - produced, audio_.size() - audio_pos_);
+        std::copy(audio_.begin() + audio_pos_, audio_.begin() + audio_pos_ + n, samples + produced);
+        audio_pos_ += n;
+        produced += n;
+    }
+
+    return produced;
+}
+
+size_t iq_channel_stream::write(const double* samples, size_t count)
+{
+    // Input only
+    (void)samples;
+    (void)count;
+    return 0;
+}
+
+void iq_channel_stream::close()
+{
+    closed_ = true;
+}
+
+int iq_channel_stream::sample_rate() const
+{
+    return channel_.sample_rate();
+}
+
+double iq_channel_stream::offset() const
+{
+    return channel_.offset();
+}
+
+bool iq_channel_stream::eof() const
+{
+    return closed_ || (position_ >= input_->size() && audio_pos_ == audio_.size());
+}
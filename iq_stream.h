@@ -0,0 +1,128 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// iq_stream.h
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "dsp.h"
+#include "mapped_file.h"
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// input_iq_stream                                                  //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+enum class iq_format
+{
+    int16,   // Interleaved I/Q, signed 16 bit, native endian
+    float32  // Interleaved I/Q, 32 bit float, native endian
+};
+
+// Wideband IQ recording, memory mapped
+//
+// Sequential reads like an audio stream, and positional reads that
+// do not touch the stream state, for several channels or threads
+// working on the same recording at the same time
+
+struct input_iq_stream
+{
+    input_iq_stream() = default;
+    input_iq_stream(const std::string& path, iq_format format, int sample_rate);
+
+    bool open(const std::string& path, iq_format format, int sample_rate);
+    void close();
+
+    size_t read(double* re, double* im, size_t count);
+    size_t read(size_t offset, double* re, double* im, size_t count) const;
+    bool seek(size_t position);
+
+    size_t position() const;
+    size_t size() const;
+    int sample_rate() const;
+    iq_format format() const;
+    bool eof() const;
+    bool is_open() const;
+
+private:
+    mapped_file file_;
+    iq_format format_ = iq_format::int16;
+    int sample_rate_ = 0;
+    size_t size_ = 0;            // Complex samples in the file
+    size_t position_ = 0;        // Next complex sample for sequential reads
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// iq_channel_stream                                                //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Virtual audio stream of one FM channel in an IQ recording
+//
+// Reads like any input audio stream, the samples are the demodulated
+// channel audio, ready for the demodulators
+// Every channel stream keeps its own position in the recording,
+// one stream per thread decodes several channels in parallel
+
+struct iq_channel_stream
+{
+    iq_channel_stream(const input_iq_stream& input, double offset, int sample_rate = 48000, double deviation = 5000.0, double deemphasis_tau = 75e-6);
+
+    size_t read(double* samples, size_t count);
+    size_t write(const double* samples, size_t count);
+    void close();
+
+    int sample_rate() const;
+    double offset() const;
+    bool eof() const;
+
+private:
+    static constexpr size_t block_size = 8192; // IQ samples per read from the recording
+
+    const input_iq_stream* input_;
+    iq_channel channel_;
+    size_t position_ = 0;        // Next IQ sample to process
+    std::vector<double> re_;     // IQ block
+    std::vector<double> im_;
+    std::vector<double> audio_;  // Demodulated audio not yet read
+    size_t audio_pos_ = 0;
+    bool closed_ = false;
+};
@@ -0,0 +1,204 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// kiss.cpp
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "kiss.h"
+
+#include <cstring>
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// KISS                                                             //
+//                                                                  //
+// kiss_encode, kiss_decoder                                        //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+namespace
+{
+    bool has_kiss_special(const uint8_t* p)
+    {
+        // Eight bytes at once, a byte equal to FEND or FESC becomes zero after the XOR,
+        // (v - 0x01..) & ~v & 0x80.. is non zero when any byte of v is zero
+
+        constexpr uint64_t ones = 0x0101010101010101ull;
+        constexpr uint64_t highs = 0x8080808080808080ull;
+
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+
+        uint64_t fend = word ^ (ones * kiss_fend);
+        uint64_t fesc = word ^ (ones * kiss_fesc);
+
+        return (((fend - ones) & ~fend) | ((fesc - ones) & ~fesc)) & highs;
+    }
+}
+
+void kiss_encode(const uint8_t* frame, size_t size, std::vector<uint8_t>& out, uint8_t port, uint8_t command)
+{
+    // Escaping adds at most one byte per special byte, reserve for the common case
+
+    out.reserve(out.size() + size + size / 16 + 4);
+
+    out.push_back(kiss_fend);
+    out.push_back(static_cast<uint8_t>((port << 4) | (command & 0x0F)));
+
+    size_t run = 0;   // Start of the bytes not yet copied
+    size_t i = 0;
+
+    while (i < size)
+    {
+        if (i + 8 <= size && !has_kiss_special(frame + i))
+        {
+            i += 8;
+            continue;
+        }
+
+        uint8_t b = frame[i];
+        if (b == kiss_fend || b == kiss_fesc)
+        {
+            out.insert(out.end(), frame + run, frame + i);
+            out.push_back(kiss_fesc);
+            out.push_back(b == kiss_fend ? kiss_tfend : kiss_tfesc);
+            run = i + 1;
+        }
+        i++;
+    }
+
+    out.insert(out.end(), frame + run, frame + size);
+    out.push_back(kiss_fend);
+}
+
+kiss_decoder::kiss_decoder(size_t max_frame_size) : max_frame_size_(max_frame_size)
+{
+    buffer_.reserve(max_frame_size + 1);
+}
+
+size_t kiss_decoder::process(const uint8_t* data, size_t size, std::vector<kiss_frame>& frames)
+{
+    // Same word at a time scan as kiss_encode, plain runs are appended in bulk,
+    // only FEND, FESC and the byte after FESC go through the state machine
+    // Empty frames, ex: back to back FENDs, are skipped
+
+    size_t found = 0;
+    size_t i = 0;
+
+    while (i < size)
+    {
+        if (!escape_)
+        {
+            size_t run = i;
+            while (i + 8 <= size && !has_kiss_special(data + i))
+            {
+                i += 8;
+            }
+            while (i < size && data[i] != kiss_fend && data[i] != kiss_fesc)
+            {
+                i++;
+            }
+
+            if (i > run && !overflow_)
+            {
+                if (buffer_.size() + (i - run) > max_frame_size_ + 1)
+                {
+                    overflow_ = true;
+                    buffer_.clear();
+                }
+                else
+                {
+                    buffer_.insert(buffer_.end(), data + run, data + i);
+                }
+            }
+
+            if (i == size)
+            {
+                break;
+            }
+        }
+
+        uint8_t b = data[i++];
+
+        if (escape_)
+        {
+            // A FESC followed by anything other than TFEND or TFESC is a protocol error, the byte is dropped
+
+            escape_ = false;
+            if (!overflow_ && (b == kiss_tfend || b == kiss_tfesc))
+            {
+                if (buffer_.size() + 1 > max_frame_size_ + 1)
+                {
+                    overflow_ = true;
+                    buffer_.clear();
+                }
+                else
+                {
+                    buffer_.push_back(b == kiss_tfend ? kiss_fend : kiss_fesc);
+                }
+            }
+            if (b != kiss_fend)
+            {
+                continue;
+            }
+        }
+
+        if (b == kiss_fesc)
+        {
+            escape_ = true;
+            continue;
+        }
+
+        // FEND
+
+        if (!overflow_ && !buffer_.empty())
+        {
+            kiss_frame frame;
+            frame.port = buffer_[0] >> 4;
+            frame.command = buffer_[0] & 0x0F;
+            frame.data.assign(buffer_.begin() + 1, buffer_.end());
+            frames.push_back(std::move(frame));
+            found++;
+        }
+
+        buffer_.clear();
+        overflow_ = false;
+    }
+
+    return found;
+}
+
+void kiss_decoder::reset()
+{
+    buffer_.clear();
+    escape_ = false;
+    overflow_ = false;
+}
@@ -0,0 +1,82 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// kiss.h
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// KISS                                                             //
+//                                                                  //
+// kiss_encode, kiss_decoder                                        //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+constexpr uint8_t kiss_fend = 0xC0;   // Frame delimiter
+constexpr uint8_t kiss_fesc = 0xDB;   // Escape
+constexpr uint8_t kiss_tfend = 0xDC;  // Escaped FEND
+constexpr uint8_t kiss_tfesc = 0xDD;  // Escaped FESC
+
+struct kiss_frame
+{
+    uint8_t port = 0;            // High nibble of the type byte
+    uint8_t command = 0;         // Low nibble of the type byte, 0 = data frame
+    std::vector<uint8_t> data;
+};
+
+// Appends FEND, the type byte, the escaped frame and FEND to out
+// The frame is scanned eight bytes at a time, runs with no FEND or FESC
+// are copied in bulk
+
+void kiss_encode(const uint8_t* frame, size_t size, std::vector<uint8_t>& out, uint8_t port = 0, uint8_t command = 0);
+
+// Incremental KISS decoder, the input can be split anywhere, ex: TCP reads
+// Frames longer than max_frame_size are dropped up to the next FEND
+
+struct kiss_decoder
+{
+    kiss_decoder(size_t max_frame_size = 1024);
+
+    size_t process(const uint8_t* data, size_t size, std::vector<kiss_frame>& frames);
+    void reset();
+
+private:
+    size_t max_frame_size_;
+    std::vector<uint8_t> buffer_;   // Type byte and unescaped data of the current frame
+    bool escape_ = false;           // Last byte was FESC
+    bool overflow_ = false;         // Current frame is too long, skipping to the next FEND
+};
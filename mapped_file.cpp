@@ -0,0 +1,360 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// mapped_file.cpp
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "mapped_file.h"
+
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// mapped_file                                                      //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+mapped_file::mapped_file(const std::string& path)
+{
+    open(path);
+}
+
+mapped_file::mapped_file(mapped_file&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+mapped_file& mapped_file::operator=(mapped_file&& other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        open_ = std::exchange(other.open_, false);
+        writable_ = std::exchange(other.writable_, false);
+#ifdef _WIN32
+        file_ = std::exchange(other.file_, nullptr);
+        mapping_ = std::exchange(other.mapping_, nullptr);
+#else
+        fd_ = std::exchange(other.fd_, -1);
+#endif
+    }
+    return *this;
+}
+
+mapped_file::~mapped_file()
+{
+    close();
+}
+
+bool mapped_file::open(const std::string& path)
+{
+    // An empty file is open with no data, mmap does not accept a zero length
+
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    file_ = file;
+    size_ = static_cast<size_t>(size.QuadPart);
+#else
+    fd_ = ::open(path.c_str(), O_RDONLY);
+    if (fd_ < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+
+    size_ = static_cast<size_t>(st.st_size);
+#endif
+
+    open_ = true;
+
+    if (!map())
+    {
+        close();
+        return false;
+    }
+
+#ifndef _WIN32
+    // Mostly sequential reads, let the kernel read ahead
+    // The mapping stays valid after the descriptor is closed
+
+    if (data_ != nullptr)
+    {
+        madvise(data_, size_, MADV_SEQUENTIAL);
+    }
+
+    ::close(fd_);
+    fd_ = -1;
+#endif
+
+    return true;
+}
+
+bool mapped_file::open_writable(const std::string& path, size_t size)
+{
+    // Opens or creates the file, the existing contents are kept up to size
+
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    file_ = file;
+#else
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0)
+    {
+        return false;
+    }
+#endif
+
+    open_ = true;
+    writable_ = true;
+
+    if (!resize(size))
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool mapped_file::resize(size_t size)
+{
+    // The mapping cannot change size in place, unmap, resize the file, map again
+    // Callers must not keep pointers into the old mapping
+
+    if (!open_ || !writable_)
+    {
+        return false;
+    }
+
+    unmap();
+
+    bool resized = true;
+
+#ifdef _WIN32
+    LARGE_INTEGER end;
+    end.QuadPart = static_cast<LONGLONG>(size);
+    resized = SetFilePointerEx(static_cast<HANDLE>(file_), end, nullptr, FILE_BEGIN) && SetEndOfFile(static_cast<HANDLE>(file_));
+#else
+    // ftruncate alone leaves a sparse file, the blocks are only allocated
+    // when the pages are written back, on a full disk the store into the
+    // mapping raises SIGBUS, allocate the new range upfront
+
+    struct stat st;
+    resized = fstat(fd_, &st) == 0;
+    if (resized && static_cast<off_t>(size) > st.st_size)
+    {
+#ifdef __APPLE__
+        resized = ftruncate(fd_, static_cast<off_t>(size)) == 0;
+#else
+        resized = posix_fallocate(fd_, st.st_size, static_cast<off_t>(size) - st.st_size) == 0;
+#endif
+    }
+    else if (resized)
+    {
+        resized = ftruncate(fd_, static_cast<off_t>(size)) == 0;
+    }
+#endif
+
+    if (resized)
+    {
+        size_ = size;
+    }
+
+    // Map again, at the previous size when the resize failed
+
+    if (!map())
+    {
+        close();
+        return false;
+    }
+
+    return resized;
+}
+
+void mapped_file::flush()
+{
+    // Schedules the write back of the dirty pages, does not wait for the disk
+
+    if (data_ == nullptr || !writable_)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    FlushViewOfFile(data_, 0);
+#else
+    msync(data_, size_, MS_ASYNC);
+#endif
+}
+
+void mapped_file::close()
+{
+    unmap();
+
+#ifdef _WIN32
+    if (file_ != nullptr)
+    {
+        CloseHandle(static_cast<HANDLE>(file_));
+    }
+    file_ = nullptr;
+#else
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+    fd_ = -1;
+#endif
+
+    size_ = 0;
+    open_ = false;
+    writable_ = false;
+}
+
+bool mapped_file::is_open() const
+{
+    return open_;
+}
+
+bool mapped_file::writable() const
+{
+    return writable_;
+}
+
+const uint8_t* mapped_file::data() const
+{
+    return data_;
+}
+
+uint8_t* mapped_file::mutable_data()
+{
+    return writable_ ? data_ : nullptr;
+}
+
+size_t mapped_file::size() const
+{
+    return size_;
+}
+
+bool mapped_file::map()
+{
+    if (size_ == 0)
+    {
+        return true;
+    }
+
+#ifdef _WIN32
+    HANDLE mapping = CreateFileMappingA(static_cast<HANDLE>(file_), nullptr, writable_ ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        return false;
+    }
+
+    mapping_ = mapping;
+
+    void* view = MapViewOfFile(mapping, writable_ ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr)
+    {
+        return false;
+    }
+#else
+    void* view = mmap(nullptr, size_, writable_ ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd_, 0);
+    if (view == MAP_FAILED)
+    {
+        return false;
+    }
+#endif
+
+    data_ = static_cast<uint8_t*>(view);
+
+    return true;
+}
+
+void mapped_file::unmap()
+{
+#ifdef _WIN32
+    if (data_ != nullptr)
+    {
+        UnmapViewOfFile(data_);
+    }
+    if (mapping_ != nullptr)
+    {
+        CloseHandle(static_cast<HANDLE>(mapping_));
+    }
+    mapping_ = nullptr;
+#else
+    if (data_ != nullptr)
+    {
+        munmap(data_, size_);
+    }
+#endif
+    data_ = nullptr;
+}
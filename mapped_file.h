@@ -0,0 +1,93 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// mapped_file.h
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// mapped_file                                                      //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Memory mapped file
+//
+// Read-only: the whole file is mapped once, readers index into it directly,
+// any number of threads can read the mapping at the same time
+// Writable: the file is sized upfront and written through the mapping,
+// resize grows or trims it, ex: recordings grown one segment at a time
+// Growth allocates the disk blocks, a full disk fails resize instead of
+// faulting on a store into the mapping later
+// A failed resize keeps the file mapped at its previous size
+
+struct mapped_file
+{
+    mapped_file() = default;
+    explicit mapped_file(const std::string& path);
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+    mapped_file(mapped_file&& other) noexcept;
+    mapped_file& operator=(mapped_file&& other) noexcept;
+    ~mapped_file();
+
+    bool open(const std::string& path);
+    bool open_writable(const std::string& path, size_t size);
+    bool resize(size_t size);
+    void flush();
+    void close();
+
+    bool is_open() const;
+    bool writable() const;
+    const uint8_t* data() const;
+    uint8_t* mutable_data();
+    size_t size() const;
+
+private:
+    bool map();
+    void unmap();
+
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    bool open_ = false;
+    bool writable_ = false;
+#ifdef _WIN32
+    void* file_ = nullptr;       // HANDLE
+    void* mapping_ = nullptr;    // HANDLE
+#else
+    int fd_ = -1;                // Kept open for writable files, to resize them
+#endif
+};
@@ -0,0 +1,391 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// mapped_wav_stream.cpp
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "mapped_wav_stream.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// mapped_wav_input_stream                                          //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+mapped_wav_input_stream::mapped_wav_input_stream(const std::string& path)
+{
+    open(path);
+}
+
+bool mapped_wav_input_stream::open(const std::string& path)
+{
+    close();
+
+    if (!file_.open(path) || !parse_wav_header(file_.data(), file_.size(), info_))
+    {
+        file_.close();
+        return false;
+    }
+
+    open_ = true;
+
+    return true;
+}
+
+void mapped_wav_input_stream::close()
+{
+    file_.close();
+    info_ = {};
+    position_ = 0;
+    open_ = false;
+}
+
+size_t mapped_wav_input_stream::read(double* samples, size_t count)
+{
+    if (!open_)
+    {
+        return 0;
+    }
+
+    size_t n = (std::min)(count, info_.frames - position_);
+    read_wav_samples(file_.data(), info_, position_, n, samples);
+    position_ += n;
+
+    return n;
+}
+
+wav_span mapped_wav_input_stream::read_span(size_t count)
+{
+    if (!open_)
+    {
+        return {};
+    }
+
+    wav_span span;
+    span.frames = (std::min)(count, info_.frames - position_);
+    span.data = file_.data() + info_.data_offset + position_ * info_.block_align;
+    span.stride = info_.block_align;
+    span.format = info_.format;
+
+    position_ += span.frames;
+
+    return span;
+}
+
+size_t mapped_wav_input_stream::write(const double* samples, size_t count)
+{
+    // Input only
+    (void)samples;
+    (void)count;
+    return 0;
+}
+
+bool mapped_wav_input_stream::seek(size_t frame)
+{
+    if (!open_ || frame > info_.frames)
+    {
+        return false;
+    }
+    position_ = frame;
+    return true;
+}
+
+int mapped_wav_input_stream::sample_rate() const
+{
+    return info_.sample_rate;
+}
+
+int mapped_wav_input_stream::channels() const
+{
+    return info_.channels;
+}
+
+wav_sample_format mapped_wav_input_stream::format() const
+{
+    return info_.format;
+}
+
+size_t mapped_wav_input_stream::frames() const
+{
+    return info_.frames;
+}
+
+size_t mapped_wav_input_stream::position() const
+{
+    return position_;
+}
+
+bool mapped_wav_input_stream::eof() const
+{
+    return position_ >= info_.frames;
+}
+
+bool mapped_wav_input_stream::is_open() const
+{
+    return open_;
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// mapped_wav_output_stream                                         //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+mapped_wav_output_stream::mapped_wav_output_stream(const std::string& path, int sample_rate, wav_sample_format format, uint64_t max_size, size_t max_files, bool append, size_t segment_size) :
+    path_(path),
+    sample_rate_(sample_rate),
+    format_(format),
+    bytes_per_sample_(wav_bytes_per_sample(format)),
+    max_size_(max_size),
+    max_files_((std::max)(size_t(1), max_files)),
+    segment_size_((std::max)(size_t(4096), segment_size))
+{
+    // The WAV sizes are 32 bit, a file never goes past 4 GB
+
+    const uint64_t wav_limit = 0xFFFFFFFFull - 8;
+    if (max_size_ == 0 || max_size_ > wav_limit)
+    {
+        max_size_ = wav_limit;
+    }
+
+    // is_open() is false when the file could not be created
+
+    if (!open_file(append))
+    {
+        file_.close();
+    }
+}
+
+mapped_wav_output_stream::~mapped_wav_output_stream()
+{
+    close();
+}
+
+size_t mapped_wav_output_stream::write(const double* samples, size_t count)
+{
+    // Fills the current file up to max_size, rotates, and continues in the next one
+
+    size_t written = 0;
+
+    while (written < count && file_.is_open())
+    {
+        const uint64_t used = wav_header_size + static_cast<uint64_t>(frames_) * bytes_per_sample_;
+        const size_t room = static_cast<size_t>((max_size_ - (std::min)(max_size_, used)) / bytes_per_sample_);
+
+        if (room == 0)
+        {
+            if (!rotate())
+            {
+                break;
+            }
+            continue;
+        }
+
+        size_t n = (std::min)(count - written, room);
+        const size_t offset = wav_header_size + frames_ * bytes_per_sample_;
+
+        // The file could not grow, ex: disk full, keep what fits in the current size
+
+        if (!reserve(offset + n * bytes_per_sample_))
+        {
+            n = (std::min)(n, (file_.size() - (std::min)(file_.size(), offset)) / bytes_per_sample_);
+            if (n == 0 || file_.mutable_data() == nullptr)
+            {
+                break;
+            }
+        }
+
+        write_wav_samples(file_.mutable_data() + offset, format_, samples + written, n);
+
+        frames_ += n;
+        written += n;
+    }
+
+    return written;
+}
+
+size_t mapped_wav_output_stream::read(double* samples, size_t count)
+{
+    // Output only
+    (void)samples;
+    (void)count;
+    return 0;
+}
+
+void mapped_wav_output_stream::flush()
+{
+    // Header up to date, the file is readable as is, the pages are written back in the background
+
+    if (file_.is_open() && file_.mutable_data() != nullptr)
+    {
+        write_wav_header(file_.mutable_data(), sample_rate_, 1, format_, frames_);
+        file_.flush();
+    }
+}
+
+void mapped_wav_output_stream::close()
+{
+    if (file_.is_open())
+    {
+        finish_file();
+    }
+}
+
+int mapped_wav_output_stream::sample_rate() const
+{
+    return sample_rate_;
+}
+
+size_t mapped_wav_output_stream::frames() const
+{
+    return frames_;
+}
+
+uint64_t mapped_wav_output_stream::rotations() const
+{
+    return rotations_;
+}
+
+bool mapped_wav_output_stream::is_open() const
+{
+    return file_.is_open();
+}
+
+bool mapped_wav_output_stream::open_file(bool append)
+{
+    frames_ = 0;
+
+    // Continue an existing recording only when the format matches
+
+    if (append)
+    {
+        mapped_file existing(path_);
+        wav_info info;
+        if (existing.is_open() && parse_wav_header(existing.data(), existing.size(), info) &&
+            info.data_offset == wav_header_size && info.channels == 1 && info.sample_rate == sample_rate_ && info.format == format_)
+        {
+            frames_ = info.frames;
+        }
+        else
+        {
+            append = false;
+        }
+    }
+
+    if (!append)
+    {
+        std::error_code ec;
+        std::filesystem::remove(path_, ec);
+    }
+
+    const size_t used = wav_header_size + frames_ * bytes_per_sample_;
+    const size_t size = (std::max)(used, segment_size_);
+
+    if (!file_.open_writable(path_, size))
+    {
+        return false;
+    }
+
+    write_wav_header(file_.mutable_data(), sample_rate_, 1, format_, frames_);
+
+    return true;
+}
+
+void mapped_wav_output_stream::finish_file()
+{
+    // Final header, then trim the unused part of the last segment
+
+    if (file_.mutable_data() != nullptr)
+    {
+        write_wav_header(file_.mutable_data(), sample_rate_, 1, format_, frames_);
+        file_.resize(wav_header_size + frames_ * bytes_per_sample_);
+    }
+    file_.close();
+}
+
+bool mapped_wav_output_stream::rotate()
+{
+    finish_file();
+
+    // output.wav -> output.1.wav -> output.2.wav ... the oldest is deleted
+
+    std::filesystem::path path(path_);
+    std::filesystem::path stem = path.parent_path() / path.stem();
+    std::string extension = path.extension().string();
+
+    auto rotated = [&](size_t index) {
+        return std::filesystem::path(stem.string() + "." + std::to_string(index) + extension);
+    };
+
+    std::error_code ec;
+
+    if (max_files_ > 1)
+    {
+        std::filesystem::remove(rotated(max_files_ - 1), ec);
+        for (size_t i = max_files_ - 1; i > 1; i--)
+        {
+            std::filesystem::rename(rotated(i - 1), rotated(i), ec);
+        }
+        std::filesystem::rename(path, rotated(1), ec);
+    }
+
+    rotations_++;
+
+    return open_file(false);
+}
+
+bool mapped_wav_output_stream::reserve(size_t bytes)
+{
+    // Grow by whole segments, each growth remaps the file
+
+    if (bytes <= file_.size())
+    {
+        return true;
+    }
+
+    size_t size = file_.size();
+    while (size < bytes)
+    {
+        size += segment_size_;
+    }
+
+    // No need to go past the rotation size
+
+    size = (std::max)(bytes, static_cast<size_t>((std::min)(static_cast<uint64_t>(size), max_size_)));
+
+    return file_.resize(size);
+}
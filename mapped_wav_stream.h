@@ -0,0 +1,148 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// mapped_wav_stream.h
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#include "mapped_file.h"
+#include "wav_file.h"
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// mapped_wav_input_stream                                          //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Samples of a WAV file, in place in the mapping
+// Frame i of channel c is at data + i * stride + c * bytes per sample
+
+struct wav_span
+{
+    const uint8_t* data = nullptr;
+    size_t frames = 0;
+    size_t stride = 0;           // Bytes per frame
+    wav_sample_format format = wav_sample_format::int16;
+};
+
+// Memory mapped WAV input
+//
+// read converts the first channel to doubles, like any input audio stream
+// read_span returns the samples straight from the mapping with no copy,
+// valid until the stream is closed
+
+struct mapped_wav_input_stream
+{
+    mapped_wav_input_stream() = default;
+    explicit mapped_wav_input_stream(const std::string& path);
+
+    bool open(const std::string& path);
+    void close();
+
+    size_t read(double* samples, size_t count);
+    wav_span read_span(size_t count);
+    size_t write(const double* samples, size_t count);
+    bool seek(size_t frame);
+
+    int sample_rate() const;
+    int channels() const;
+    wav_sample_format format() const;
+    size_t frames() const;
+    size_t position() const;
+    bool eof() const;
+    bool is_open() const;
+
+private:
+    mapped_file file_;
+    wav_info info_;
+    size_t position_ = 0;        // Next frame to read
+    bool open_ = false;
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// mapped_wav_output_stream                                         //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Memory mapped WAV output, mono
+//
+//   - The file grows one segment at a time, samples are converted straight
+//     into the mapping, no system call per write
+//   - The header is patched and the file trimmed to its real size on close
+//     and on rotation
+//   - Rotation: once a file reaches max_size, ex: output.wav, it is renamed
+//     output.1.wav, older files shift up to output.<max_files - 1>.wav,
+//     the oldest is deleted, and a new output.wav is started
+//     max_size = 0 never rotates
+//   - Append: an existing file with the same format is continued
+
+struct mapped_wav_output_stream
+{
+    mapped_wav_output_stream(const std::string& path, int sample_rate, wav_sample_format format = wav_sample_format::int16, uint64_t max_size = 500ull * 1024 * 1024, size_t max_files = 10, bool append = false, size_t segment_size = 16 * 1024 * 1024);
+    mapped_wav_output_stream(const mapped_wav_output_stream&) = delete;
+    mapped_wav_output_stream& operator=(const mapped_wav_output_stream&) = delete;
+    ~mapped_wav_output_stream();
+
+    size_t write(const double* samples, size_t count);
+    size_t read(double* samples, size_t count);
+    void flush();
+    void close();
+
+    int sample_rate() const;
+    size_t frames() const;
+    uint64_t rotations() const;
+    bool is_open() const;
+
+private:
+    bool open_file(bool append);
+    void finish_file();
+    bool rotate();
+    bool reserve(size_t bytes);
+
+    std::string path_;
+    int sample_rate_;
+    wav_sample_format format_;
+    size_t bytes_per_sample_;
+    uint64_t max_size_;          // Bytes per file, header included, 0 = no limit
+    size_t max_files_;           // Files kept, the current one included
+    size_t segment_size_;        // Bytes the file grows by
+    mapped_file file_;
+    size_t frames_ = 0;          // Frames in the current file
+    uint64_t rotations_ = 0;
+};
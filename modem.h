@@ -1,35 +1,52 @@
 ﻿#pragma once
 
 #include <cmath>
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
 #include <algorithm>
 #include <optional>
+#include <array>
+#include <memory>
+#include <thread>
+#include <chrono>
 
 #include "audio_stream.h"
 #include "modulator.h"
 #include "bitstream.h"
+#include "dsp.h"
+#include "audio_events.h"
+#include "audio_fanout.h"
 
 #include "external/aprsroute.hpp"
 
 // **************************************************************** //
 //                                                                  //
 //                                                                  //
-// modem                                                            //
+// basic_modem                                                      //
 //                                                                  //
 //                                                                  //
 // **************************************************************** //
 
-struct modem
+template<typename Modulator, typename Converter, typename Stream>
+struct basic_modem
 {
-    void initialize(audio_stream& stream, modulator_base& modulator, bitstream_converter_base& converter);
+    void initialize(Stream& stream, Modulator& modulator, Converter& converter);
+    void add_output(Stream& stream, size_t max_pending = 8);
+    void flush();
 
     void transmit();
-    void transmit(aprs::router::packet p);
+    void transmit(const aprs::router::packet& p);
     void transmit(const std::vector<uint8_t>& bits);
-    
+
     size_t receive(std::vector<aprs::router::packet>& packets);
 
     void preemphasis(bool);
     bool preemphasis() const;
+    void preemphasis_tau(double);
+    double preemphasis_tau() const;
+    void soft_clip(bool);
+    bool soft_clip() const;
     void gain(double);
     double gain() const;
     void start_silence(double);
@@ -42,18 +59,31 @@ struct modem
     double tx_tail() const;
     void baud_rate(int);
     int baud_rate() const;
+    void write_timeout(double);
+    double write_timeout() const;
+    void write_timeout_action(write_timeout_policy);
+    write_timeout_policy write_timeout_action() const;
+    void render_mode(render_profile);
+    render_profile render_mode() const;
 
 private:
     void postprocess_audio(std::vector<double>& audio_buffer);
     void render_audio(const std::vector<double>& audio_buffer);
     void modulate_bitstream(const std::vector<uint8_t>& bitstream, std::vector<double>& audio_buffer);
 
-    std::optional<std::reference_wrapper<audio_stream>> audio;
-    std::optional<std::reference_wrapper<modulator_base>> mod;
-    std::optional<std::reference_wrapper<bitstream_converter_base>> conv;
+    Stream* audio = nullptr;
+    Modulator* mod = nullptr;
+    Converter* conv = nullptr;
+    std::optional<polyphase_resampler> resampler; // Set when the modulator and audio stream sample rates differ
+    std::vector<std::unique_ptr<audio_sink<Stream>>> outputs; // Additional output streams, fed asynchronously, each converts to its own rate
     double start_silence_duration_s = 0.0;
     double end_silence_duration_s = 0.0;
     bool preemphasis_enabled = false;
+    double preemphasis_tau_us = 75.0; // Pre-emphasis time constant in microseconds
+    bool soft_clip_enabled = false;
+    double write_timeout_ms = 0.0; // Longest wait for writable space, 0 = no timeout
+    write_timeout_policy write_timeout_policy_ = write_timeout_policy::block;
+    render_profile render_profile_ = render_profile::balanced;
     double gain_value = 1.0; // Linear scale (1.0 = no change)
     double tx_delay_ms = 0.0;
     double tx_tail_ms = 0.0;
@@ -62,6 +92,56 @@ private:
     int postamble_flags = 1; // Number of HDLC flags after frame
 };
 
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// modem                                                            //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+struct modem
+{
+    void initialize(audio_stream& stream, modulator_base& modulator, bitstream_converter_base& converter);
+    void add_output(audio_stream& stream, size_t max_pending = 8);
+    void flush();
+
+    void transmit();
+    void transmit(aprs::router::packet p);
+    void transmit(const std::vector<uint8_t>& bits);
+    
+    size_t receive(std::vector<aprs::router::packet>& packets);
+
+    void preemphasis(bool);
+    bool preemphasis() const;
+    void preemphasis_tau(double);
+    double preemphasis_tau() const;
+    void soft_clip(bool);
+    bool soft_clip() const;
+    void gain(double);
+    double gain() const;
+    void start_silence(double);
+    double start_silence() const;
+    void end_silence(double);
+    double end_silence() const;
+    void tx_delay(double);
+    double tx_delay() const;
+    void tx_tail(double);
+    double tx_tail() const;
+    void baud_rate(int);
+    int baud_rate() const;
+    void write_timeout(double);
+    double write_timeout() const;
+    void write_timeout_action(write_timeout_policy);
+    write_timeout_policy write_timeout_action() const;
+    void render_mode(render_profile);
+    render_profile render_mode() const;
+
+private:
+    // Type-erased modem, dispatches through the modulator, converter and audio stream base classes
+    basic_modem<modulator_base, bitstream_converter_base, audio_stream> impl;
+};
+
 // **************************************************************** //
 //                                                                  //
 //                                                                  //
@@ -126,3 +206,473 @@ inline void apply_preemphasis(It first, It last, int sample_rate, double tau = 7
         *it = y;
     }
 }
+
+inline double soft_clip_sample(double x, double threshold = 0.8)
+{
+    // Unity gain below the threshold, tanh knee above it, never exceeds 1.0
+    // Continuous, with a continuous first derivative at the threshold
+
+    double magnitude = std::abs(x);
+
+    if (magnitude <= threshold)
+    {
+        return x;
+    }
+
+    double knee = 1.0 - threshold;
+    double y = threshold + knee * std::tanh((magnitude - threshold) / knee);
+
+    return (x < 0.0) ? -y : y;
+}
+
+template<typename T>
+inline T convert_sample(double x)
+{
+    // Converts a [-1.0, 1.0] sample to the audio device format
+
+    if constexpr (std::is_same<T, int16_t>::value)
+    {
+        double scaled = std::round(x * 32767.0);
+        scaled = (std::min)((std::max)(scaled, -32768.0), 32767.0);
+        return static_cast<int16_t>(scaled);
+    }
+    else
+    {
+        return static_cast<T>(x);
+    }
+}
+
+template<typename T = double, typename It, typename OutputIt>
+inline OutputIt postprocess(It first, It last, OutputIt out, int sample_rate, bool preemphasis, double tau, double gain, bool clip)
+{
+    // Fused post-processing kernel, one pass over the buffer:
+    //
+    //   - First-order pre-emphasis, same filter and initial state as apply_preemphasis
+    //   - Gain, same as apply_gain
+    //   - Optional soft clipping
+    //   - Conversion to the output type, ex: double, float or int16_t
+    //
+    // Produces the same output as apply_preemphasis followed by apply_gain,
+    // without walking the buffer several times
+    // Samples are staged in cache sized blocks, the pre-emphasis runs
+    // through the block-parallel first_order_iir, then the rest of the chain
+    // is applied while the block is still hot
+    // Input and output can be the same buffer when T is the input type
+
+    if (first == last)
+    {
+        return out;
+    }
+
+    constexpr size_t block_size = 2048;
+
+    std::array<double, block_size> block;
+
+    first_order_iir filter = make_preemphasis_filter(sample_rate, tau);
+
+    // The first sample passes through, and seeds the filter state
+    filter.reset(*first, *first);
+
+    bool first_block = true;
+
+    while (first != last)
+    {
+        size_t count = 0;
+        while (count < block_size && first != last)
+        {
+            block[count++] = *first++;
+        }
+
+        if (preemphasis)
+        {
+            size_t offset = first_block ? 1 : 0;
+            filter.process(block.data() + offset, count - offset);
+        }
+
+        first_block = false;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            double y = block[i] * gain;
+
+            if (clip)
+            {
+                y = soft_clip_sample(y);
+            }
+
+            *out++ = convert_sample<T>(y);
+        }
+    }
+
+    return out;
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// basic_modem                                                      //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// basic_modem is statically dispatched:
+//
+//   - The modulator, converter and audio stream are template parameters,
+//     ex: basic_modem<dds_afsk_modulator_fast<double>, basic_bitstream_converter, wav_audio_stream>
+//   - Calls are resolved at compile time, and the per-sample modulate() call
+//     inlines into modulate_bitstream for header-only modulators
+//
+// modem instantiates it with the base classes for runtime configuration
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::initialize(Stream& stream, Modulator& modulator, Converter& converter)
+{
+    audio = &stream;
+    mod = &modulator;
+    conv = &converter;
+
+    // The modulator synthesizes at its own sample rate
+    // Convert to the audio stream rate only when they differ
+
+    resampler.reset();
+
+    if (modulator.sample_rate() != stream.sample_rate())
+    {
+        resampler.emplace(modulator.sample_rate(), stream.sample_rate());
+    }
+
+    double ms_per_flag = (8.0 * 1000.0) / baud_rate_;
+
+    preamble_flags = (std::max)(static_cast<int>(tx_delay_ms / ms_per_flag), 1);
+    postamble_flags = (std::max)(static_cast<int>(tx_tail_ms / ms_per_flag), 1);
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::add_output(Stream& stream, size_t max_pending)
+{
+    // Every transmission is rendered once at the modulator rate and shared
+    // with the additional outputs, each output converts it to its own rate
+
+    outputs.push_back(std::make_unique<audio_sink<Stream>>(stream, max_pending, write_timeout_ms, write_timeout_policy_, render_profile_));
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::flush()
+{
+    for (auto& output : outputs)
+    {
+        output->flush();
+    }
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::transmit()
+{
+    std::vector<uint8_t> bitstream({ 0 });
+
+    transmit(bitstream);
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::transmit(const aprs::router::packet& p)
+{
+    assert(conv != nullptr);
+
+    // Convert packet to bitstream
+    // 
+    // - Compute CRC
+    // - Append CRC to the AX.25 frame
+    // - Convert bytes to bits (LSB-first)
+    // - Bit-stuffing (insert 0 after five consecutive 1s)
+    // - Add HDLC flags (0x7E) at start and end
+    // - NRZI encoding (invert on 1, no change on 0)
+
+    std::vector<uint8_t> bitstream = conv->encode(p, preamble_flags, postamble_flags);
+
+    transmit(bitstream);
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::transmit(const std::vector<uint8_t>& bits)
+{
+    // AFSK modulation
+
+    std::vector<double> audio_buffer;
+
+    modulate_bitstream(bits, audio_buffer);
+
+    // Apply pre-emphasis filter and gain
+
+    postprocess_audio(audio_buffer);
+
+    // Hand the same immutable buffer to the additional outputs,
+    // each one converts and writes it from its own thread at its own pace
+
+    audio_frame frame = std::make_shared<const std::vector<double>>(std::move(audio_buffer));
+
+    for (auto& output : outputs)
+    {
+        output->push(frame, mod->sample_rate());
+    }
+
+    // Convert to the audio stream sample rate, and render to the output audio device
+
+    if (!resampler.has_value())
+    {
+        render_audio(*frame);
+        return;
+    }
+
+    std::vector<double> resampled_buffer;
+
+    resample_frame(*resampler, *frame, resampled_buffer);
+
+    render_audio(resampled_buffer);
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::postprocess_audio(std::vector<double>& audio_buffer)
+{
+    int sample_rate = mod->sample_rate();
+
+    int silence_samples = static_cast<int>(start_silence_duration_s * sample_rate);
+
+    // Pre-emphasis, gain and soft clipping in a single pass, in place
+
+    postprocess(audio_buffer.begin() + silence_samples, audio_buffer.end(), audio_buffer.begin() + silence_samples, sample_rate, preemphasis_enabled, preemphasis_tau_us * 1e-6, gain_value, soft_clip_enabled);
+
+    insert_silence(audio_buffer.begin(), sample_rate, start_silence_duration_s);
+
+    insert_silence(std::back_inserter(audio_buffer), sample_rate, end_silence_duration_s);
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::modulate_bitstream(const std::vector<uint8_t>& bitstream, std::vector<double>& audio_buffer)
+{
+    assert(mod != nullptr);
+
+    Modulator& modulator = *mod;
+
+    // Symbol boundaries come from a phase accumulator rather than a fixed
+    // samples_per_bit, so 44.1 kHz or odd baud rates keep the exact baud rate
+
+    bit_clock clock(modulator.bitrate(), modulator.sample_rate());
+
+    // Modulators with a pulse shaping filter, ex: G3RUH, need a few more
+    // bits for the end of the bitstream to come out of the filter
+
+    const int flush_bits = bitstream.empty() ? 0 : modulator_flush_bits(modulator);
+
+    size_t signal_samples = clock.samples(bitstream.size() + flush_bits);
+
+    int silence_samples = static_cast<int>(start_silence_duration_s * modulator.sample_rate());
+
+    audio_buffer.resize(silence_samples + signal_samples);
+
+    size_t write_pos = silence_samples;
+    for (uint8_t bit : bitstream)
+    {
+        int bit_samples = clock.next();
+        for (int i = 0; i < bit_samples; ++i)
+        {
+            audio_buffer[write_pos++] = modulator.modulate(bit);
+        }
+    }
+
+    for (int n = 0; n < flush_bits; ++n)
+    {
+        int bit_samples = clock.next();
+        for (int i = 0; i < bit_samples; ++i)
+        {
+            audio_buffer[write_pos++] = modulator.modulate(0);
+        }
+    }
+
+    modulator.reset();
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::render_audio(const std::vector<double>& audio_buffer)
+{
+    assert(audio != nullptr);
+
+    Stream& audio_stream = *audio;
+
+    // Size writes from the device period, see render_chunk_size
+
+    const size_t chunk_size = render_chunk_size(render_profile_, audio_stream.sample_rate(), get_stream_timing(audio_stream));
+
+    write_audio(audio_stream, audio_buffer.data(), audio_buffer.size(), chunk_size, write_timeout_ms, write_timeout_policy_);
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline size_t basic_modem<Modulator, Converter, Stream>::receive([[maybe_unused]] std::vector<aprs::router::packet>& packets)
+{
+    // Receive is not implemented yet, same as modem::receive before basic_modem
+    return 0;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::preemphasis(bool enable)
+{
+    preemphasis_enabled = enable;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline bool basic_modem<Modulator, Converter, Stream>::preemphasis() const
+{
+    return preemphasis_enabled;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::preemphasis_tau(double tau_us)
+{
+    if (tau_us <= 0.0) tau_us = 75.0;
+    preemphasis_tau_us = tau_us;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline double basic_modem<Modulator, Converter, Stream>::preemphasis_tau() const
+{
+    return preemphasis_tau_us;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::soft_clip(bool enable)
+{
+    soft_clip_enabled = enable;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline bool basic_modem<Modulator, Converter, Stream>::soft_clip() const
+{
+    return soft_clip_enabled;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::gain(double g)
+{
+    gain_value = g;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline double basic_modem<Modulator, Converter, Stream>::gain() const
+{
+    return gain_value;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::start_silence(double d)
+{
+    if (d < 0.0) d = 0.0;
+    start_silence_duration_s = d;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline double basic_modem<Modulator, Converter, Stream>::start_silence() const
+{
+    return start_silence_duration_s;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::end_silence(double d)
+{
+    if (d < 0.0) d = 0.0;
+    end_silence_duration_s = d;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline double basic_modem<Modulator, Converter, Stream>::end_silence() const
+{
+    return end_silence_duration_s;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::tx_delay(double d)
+{
+    if (d < 0.0) d = 0.0;
+    tx_delay_ms = d;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline double basic_modem<Modulator, Converter, Stream>::tx_delay() const
+{
+    return tx_delay_ms;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::tx_tail(double d)
+{
+    if (d < 0.0) d = 0.0;
+    tx_tail_ms = d;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline double basic_modem<Modulator, Converter, Stream>::tx_tail() const
+{
+    return tx_tail_ms;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::baud_rate(int b)
+{
+    if (b <= 0) b = 1200;
+    baud_rate_ = b;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline int basic_modem<Modulator, Converter, Stream>::baud_rate() const
+{
+    return baud_rate_;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::write_timeout(double ms)
+{
+    write_timeout_ms = ms;
+
+    for (auto& output : outputs)
+    {
+        output->configure(write_timeout_ms, write_timeout_policy_, render_profile_);
+    }
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline double basic_modem<Modulator, Converter, Stream>::write_timeout() const
+{
+    return write_timeout_ms;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::write_timeout_action(write_timeout_policy policy)
+{
+    write_timeout_policy_ = policy;
+
+    for (auto& output : outputs)
+    {
+        output->configure(write_timeout_ms, write_timeout_policy_, render_profile_);
+    }
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline write_timeout_policy basic_modem<Modulator, Converter, Stream>::write_timeout_action() const
+{
+    return write_timeout_policy_;
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline void basic_modem<Modulator, Converter, Stream>::render_mode(render_profile profile)
+{
+    render_profile_ = profile;
+
+    for (auto& output : outputs)
+    {
+        output->configure(write_timeout_ms, write_timeout_policy_, render_profile_);
+    }
+}
+
+template<typename Modulator, typename Converter, typename Stream>
+inline render_profile basic_modem<Modulator, Converter, Stream>::render_mode() const
+{
+    return render_profile_;
+}
@@ -1,6 +1,68 @@
 ﻿#include "modulator.h"
 
 #include <cassert>
+#include <algorithm>
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// bit_clock                                                        //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+bit_clock::bit_clock(int bitrate, int sample_rate) : bitrate_(bitrate), sample_rate_(sample_rate)
+{
+}
+
+int bit_clock::next()
+{
+    // Symbol timing phase accumulator
+    //
+    // Bit k ends at sample floor((k + 1) * sample_rate / bitrate)
+    // The accumulator keeps the fractional remainder as an exact integer,
+    // so the bit boundaries never drift, however long the frame is
+    //
+    // Example: 44100 Hz at 1200 baud = 36.75 samples per bit
+    //
+    //   36, 37, 37, 37, 36, 37, 37, 37, ...
+
+    remainder_ += sample_rate_;
+    int samples = remainder_ / bitrate_;
+    remainder_ %= bitrate_;
+    return samples;
+}
+
+void bit_clock::reset()
+{
+    remainder_ = 0;
+}
+
+size_t bit_clock::samples(size_t bits) const
+{
+    // Total number of samples for a number of bits, starting from reset
+    return static_cast<size_t>((static_cast<uint64_t>(bits) * static_cast<uint64_t>(sample_rate_)) / static_cast<uint64_t>(bitrate_));
+}
+
+int bit_clock::samples_per_bit() const
+{
+    return sample_rate_ / bitrate_;
+}
+
+double bit_clock::samples_per_bit_exact() const
+{
+    return static_cast<double>(sample_rate_) / bitrate_;
+}
+
+int bit_clock::bitrate() const
+{
+    return bitrate_;
+}
+
+int bit_clock::sample_rate() const
+{
+    return sample_rate_;
+}
 
 // **************************************************************** //
 //                                                                  //
@@ -14,7 +76,8 @@ dds_afsk_modulator::dds_afsk_modulator(double f_mark = 1200.0, double f_space =
 {
     this->f_mark = f_mark;
     this->f_space = f_space;
-    this->sample_rate = sample_rate;
+    this->bitrate_ = bitrate;
+    this->sample_rate_ = sample_rate;
     this->alpha = alpha;
 
     freq_smooth = f_mark;
@@ -33,6 +96,7 @@ double dds_afsk_modulator::modulate(uint8_t bit)
     // Process one bit and generate one audio sample
     // Call this function at the sample rate (e.g., 48000 times/second
     // Each bit must be held for samples_per_bit samples to achieve correct baud rate
+    // (use bit_clock when the sample rate is not a multiple of the bitrate)
 
     constexpr double two_pi = 2.0 * 3.14159265358979323846;
 
@@ -53,7 +117,7 @@ double dds_afsk_modulator::modulate(uint8_t bit)
     // This creates the desired output frequency
     // fmod() wraps phase to [0, 2π) to prevent numerical precision loss
     // over long transmissions (phase would grow unbounded otherwise)
-    phase = std::fmod(phase + two_pi * freq_smooth / sample_rate, two_pi);
+    phase = std::fmod(phase + two_pi * freq_smooth / sample_rate_, two_pi);
 
     assert(phase >= 0.0 && phase < two_pi);
 
@@ -79,6 +143,16 @@ int dds_afsk_modulator::samples_per_bit() const
     return samples_per_bit_;
 }
 
+int dds_afsk_modulator::bitrate() const
+{
+    return bitrate_;
+}
+
+int dds_afsk_modulator::sample_rate() const
+{
+    return sample_rate_;
+}
+
 // **************************************************************** //
 //                                                                  //
 //                                                                  //
@@ -90,8 +164,9 @@ int dds_afsk_modulator::samples_per_bit() const
 cpfsk_modulator::cpfsk_modulator(double f_mark, double f_space, int bitrate, int sample_rate)
     : f_center_((f_mark + f_space) / 2.0),      // Calculate center frequency
     f_delta_((f_mark - f_space) / 2.0),       // Calculate deviation (can be negative)
+    bitrate_(bitrate),
     sample_rate_(sample_rate),
-    samples_per_bit_(sample_rate / bitrate),  // Samples needed per bit period
+    samples_per_bit_(static_cast<double>(sample_rate) / bitrate),  // Samples needed per bit period, can be fractional
     m_(0.0),
     current_sample_(0)
 {
@@ -103,7 +178,8 @@ double cpfsk_modulator::modulate(uint8_t bit)
 
     // On bit boundaries, convert bit to NRZ and append to bitstream
     // NRZ encoding: bit 1 → -1.0, bit 0 → +1.0
-    if (current_sample_ % samples_per_bit_ == 0)
+    // Bit k starts at sample floor(k * sample_rate / bitrate), same boundaries as bit_clock
+    if (static_cast<int64_t>(bitstream_nrz_.size()) * sample_rate_ < (static_cast<int64_t>(current_sample_) + 1) * bitrate_)
     {
         double nrz = (bit == 1) ? -1.0 : 1.0;
         bitstream_nrz_.push_back(nrz);
@@ -161,7 +237,11 @@ void cpfsk_modulator::reset()
     current_sample_ = 0;
 }
 
-int cpfsk_modulator::samples_per_bit() const { return samples_per_bit_; }
+int cpfsk_modulator::samples_per_bit() const { return sample_rate_ / bitrate_; }
+
+int cpfsk_modulator::bitrate() const { return bitrate_; }
+
+int cpfsk_modulator::sample_rate() const { return sample_rate_; }
 
 // **************************************************************** //
 //                                                                  //
@@ -183,8 +263,10 @@ bessel_null_modulator::bessel_null_modulator(double f_mark = 1200.0,
     , sample_index_(0)
     , current_freq_(f_mark)
     , use_mark_(true)
+    , clock_(bitrate, sample_rate)
 {
     samples_per_bit_ = sample_rate_ / bitrate_;
+    samples_in_bit_ = clock_.next();
 
     // Calculate transition samples for smooth frequency changes
     transition_samples_ = static_cast<int>(alpha_ * samples_per_bit_);
@@ -244,9 +326,10 @@ double bessel_null_modulator::modulate(uint8_t bit)
 
     // Increment sample counter
     sample_index_++;
-    if (sample_index_ >= samples_per_bit_)
+    if (sample_index_ >= samples_in_bit_)
     {
         sample_index_ = 0;
+        samples_in_bit_ = clock_.next(); // Length of the next bit period, fractional timing
         use_mark_ = !use_mark_; // Toggle for next bit period
     }
 
@@ -259,6 +342,8 @@ void bessel_null_modulator::reset()
     sample_index_ = 0;
     current_freq_ = f_mark_;
     use_mark_ = true;
+    clock_.reset();
+    samples_in_bit_ = clock_.next();
 }
 
 int bessel_null_modulator::samples_per_bit() const
@@ -266,6 +351,16 @@ int bessel_null_modulator::samples_per_bit() const
     return samples_per_bit_;
 }
 
+int bessel_null_modulator::bitrate() const
+{
+    return bitrate_;
+}
+
+int bessel_null_modulator::sample_rate() const
+{
+    return sample_rate_;
+}
+
 void bessel_null_modulator::compute_bessel_window()
 {
     // Compute modified Bessel function of the first kind, order 0
@@ -303,6 +398,165 @@ double bessel_null_modulator::bessel_i0(double x)
     return sum;
 }
 
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// g3ruh_modulator                                                  //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+g3ruh_modulator::g3ruh_modulator(int bitrate, int sample_rate, double rolloff, int span, int phases)
+    : bitrate_(bitrate)
+    , sample_rate_(sample_rate)
+    , rolloff_(rolloff)
+    , span_((std::clamp)(span, 2, max_span))
+    , phases_((std::max)(phases, 1))
+    , clock_(bitrate, sample_rate)
+{
+    compute_pulse_table();
+    reset();
+}
+
+double g3ruh_modulator::modulate(uint8_t bit)
+{
+    // G3RUH baseband FSK modulator - processes one sample at a time
+    //
+    //   - On each bit boundary, scramble the (NRZI) bit and push a +1/-1 symbol
+    //   - Shape the symbols with a raised cosine pulse, spanning span_ symbols
+    //   - The pulse is read from a polyphase table indexed by the sub-symbol phase
+    //
+    // The output drives the FM modulator directly (flat audio, 9600 baud and up),
+    // unlike the AFSK modulators which produce audio tones
+
+    if (sample_index_ == 0)
+    {
+        uint8_t scrambled = scrambler_.scramble(bit);
+
+        std::copy_backward(symbols_.begin(), symbols_.begin() + span_ - 1, symbols_.begin() + span_);
+        symbols_[0] = scrambled ? 1.0 : -1.0;
+
+        bit_count_++;
+    }
+
+    // Sub-symbol phase, time elapsed since the ideal start of the current bit
+    //
+    //   phase = (sample * bitrate - bit * sample_rate) / sample_rate, in [0, 1)
+    //
+    // Bit boundaries are rounded to whole samples, the phase stays exact
+
+    int64_t phase_num = sample_count_ * bitrate_ - (bit_count_ - 1) * sample_rate_;
+    int phase = static_cast<int>((phase_num * phases_) / sample_rate_);
+    phase = (std::clamp)(phase, 0, phases_ - 1);
+
+    const double* taps = &pulse_table_[static_cast<size_t>(phase) * span_];
+
+    double output = 0.0;
+    for (int k = 0; k < span_; k++)
+    {
+        output += symbols_[k] * taps[k];
+    }
+
+    sample_count_++;
+    sample_index_++;
+    if (sample_index_ >= samples_in_bit_)
+    {
+        sample_index_ = 0;
+        samples_in_bit_ = clock_.next();
+    }
+
+    return output;
+}
+
+void g3ruh_modulator::reset()
+{
+    scrambler_.reset();
+    clock_.reset();
+    samples_in_bit_ = clock_.next();
+    sample_index_ = 0;
+    bit_count_ = 0;
+    sample_count_ = 0;
+    symbols_.fill(0.0);
+}
+
+int g3ruh_modulator::samples_per_bit() const
+{
+    return sample_rate_ / bitrate_;
+}
+
+int g3ruh_modulator::bitrate() const
+{
+    return bitrate_;
+}
+
+int g3ruh_modulator::sample_rate() const
+{
+    return sample_rate_;
+}
+
+int g3ruh_modulator::delay() const
+{
+    // Symbol k peaks delay() bits after it started
+    return span_ / 2;
+}
+
+int g3ruh_modulator::flush_bits() const
+{
+    // The last bit peaks delay() bits after the end of the bitstream
+    return delay();
+}
+
+void g3ruh_modulator::compute_pulse_table()
+{
+    // Raised cosine pulse, t in symbol periods
+    //
+    //   h(t) = sinc(t) * cos(pi * rolloff * t) / (1 - (2 * rolloff * t)^2)
+    //
+    // Entry [p][k] is the contribution of the symbol k bits back,
+    // at sub-symbol phase p / phases_ of the current bit:
+    //
+    //   t = p / phases_ + k - span_ / 2
+    //
+    // h(0) = 1 and h(n) = 0 for other integers, so sampling the output at
+    // phase 0, delay() bits after a symbol, gives that symbol without ISI
+
+    constexpr double pi = 3.14159265358979323846;
+
+    auto raised_cosine = [&](double t)
+    {
+        double sinc = (t == 0.0) ? 1.0 : std::sin(pi * t) / (pi * t);
+        double d = 2.0 * rolloff_ * t;
+        if (std::abs(1.0 - d * d) < 1e-9)
+        {
+            return (pi / 4.0) * ((rolloff_ > 0.0) ? std::sin(pi / (2.0 * rolloff_)) / (pi / (2.0 * rolloff_)) : 1.0);
+        }
+        return sinc * std::cos(pi * rolloff_ * t) / (1.0 - d * d);
+    };
+
+    pulse_table_.resize(static_cast<size_t>(phases_) * span_);
+
+    double max_sum = 0.0;
+    for (int p = 0; p < phases_; p++)
+    {
+        double sum = 0.0;
+        for (int k = 0; k < span_; k++)
+        {
+            double t = static_cast<double>(p) / phases_ + k - span_ / 2;
+            double h = raised_cosine(t);
+            pulse_table_[static_cast<size_t>(p) * span_ + k] = h;
+            sum += std::abs(h);
+        }
+        max_sum = (std::max)(max_sum, sum);
+    }
+
+    // Scale so the worst case symbol pattern stays within [-1, 1]
+
+    for (double& h : pulse_table_)
+    {
+        h /= max_sum;
+    }
+}
+
 // **************************************************************** //
 //                                                                  //
 //                                                                  //
@@ -321,6 +575,11 @@ int16_t modulator_base::modulate_int(uint8_t bit)
     return 0;
 }
 
+int modulator_base::flush_bits() const
+{
+    return 0;
+}
+
 // **************************************************************** //
 //                                                                  //
 //                                                                  //
@@ -351,6 +610,16 @@ int dds_afsk_modulator_adapter::samples_per_bit() const
     return dds_mod.samples_per_bit();
 }
 
+int dds_afsk_modulator_adapter::bitrate() const
+{
+    return dds_mod.bitrate();
+}
+
+int dds_afsk_modulator_adapter::sample_rate() const
+{
+    return dds_mod.sample_rate();
+}
+
 // **************************************************************** //
 //                                                                  //
 //                                                                  //
@@ -380,6 +649,16 @@ int dds_afsk_modulator_fast_adapter::samples_per_bit() const
     return dds_mod.samples_per_bit();
 }
 
+int dds_afsk_modulator_fast_adapter::bitrate() const
+{
+    return dds_mod.bitrate();
+}
+
+int dds_afsk_modulator_fast_adapter::sample_rate() const
+{
+    return dds_mod.sample_rate();
+}
+
 // **************************************************************** //
 //                                                                  //
 //                                                                  //
@@ -409,6 +688,16 @@ int cpfsk_modulator_adaptor::samples_per_bit() const
     return cpfsk_mod.samples_per_bit();
 }
 
+int cpfsk_modulator_adaptor::bitrate() const
+{
+    return cpfsk_mod.bitrate();
+}
+
+int cpfsk_modulator_adaptor::sample_rate() const
+{
+    return cpfsk_mod.sample_rate();
+}
+
 // **************************************************************** //
 //                                                                  //
 //                                                                  //
@@ -437,4 +726,57 @@ void bessel_null_modulator_adapter::reset()
 int bessel_null_modulator_adapter::samples_per_bit() const
 {
     return bessel_mod.samples_per_bit();
+}
+
+int bessel_null_modulator_adapter::bitrate() const
+{
+    return bessel_mod.bitrate();
+}
+
+int bessel_null_modulator_adapter::sample_rate() const
+{
+    return bessel_mod.sample_rate();
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// g3ruh_modulator_adapter                                          //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+g3ruh_modulator_adapter::g3ruh_modulator_adapter(int bitrate, int sample_rate, double rolloff)
+    : g3ruh_mod(bitrate, sample_rate, rolloff)
+{
+}
+
+double g3ruh_modulator_adapter::modulate(uint8_t bit)
+{
+    return g3ruh_mod.modulate(bit);
+}
+
+void g3ruh_modulator_adapter::reset()
+{
+    g3ruh_mod.reset();
+}
+
+int g3ruh_modulator_adapter::samples_per_bit() const
+{
+    return g3ruh_mod.samples_per_bit();
+}
+
+int g3ruh_modulator_adapter::bitrate() const
+{
+    return g3ruh_mod.bitrate();
+}
+
+int g3ruh_modulator_adapter::sample_rate() const
+{
+    return g3ruh_mod.sample_rate();
+}
+
+int g3ruh_modulator_adapter::flush_bits() const
+{
+    return g3ruh_mod.flush_bits();
 }
\ No newline at end of file
@@ -3,6 +3,37 @@
 #include <cstdint>
 #include <vector>
 #include <cmath>
+#include <array>
+#include <type_traits>
+#include <utility>
+
+#include "bitstream.h"
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// bit_clock                                                        //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+struct bit_clock
+{
+    bit_clock(int bitrate = 1200, int sample_rate = 48000);
+
+    int next();
+    void reset();
+    size_t samples(size_t bits) const;
+    int samples_per_bit() const;
+    double samples_per_bit_exact() const;
+    int bitrate() const;
+    int sample_rate() const;
+
+private:
+    int bitrate_;
+    int sample_rate_;
+    int remainder_ = 0;  // Fractional part of the symbol phase, in units of 1/bitrate samples
+};
 
 // **************************************************************** //
 //                                                                  //
@@ -19,11 +50,14 @@ struct dds_afsk_modulator
     double modulate(uint8_t bit);
     void reset();
     int samples_per_bit() const;
+    int bitrate() const;
+    int sample_rate() const;
 
 private:
     double f_mark;
     double f_space;
-    int sample_rate;
+    int bitrate_;
+    int sample_rate_;
     double alpha;
     double freq_smooth;
     double phase = 0.0;
@@ -46,11 +80,14 @@ struct dds_afsk_modulator_fast
     T modulate(uint8_t bit);
     void reset();
     int samples_per_bit() const;
+    int bitrate() const;
+    int sample_rate() const;
 
 private:
     double f_mark;
     double f_space;
-    int sample_rate;
+    int bitrate_;
+    int sample_rate_;
     int samples_per_bit_;
     std::vector<T> lookup_table_;
     unsigned int lookup_table_bits_ = 0;
@@ -61,7 +98,7 @@ private:
 };
 
 template<typename T>
-inline dds_afsk_modulator_fast<T>::dds_afsk_modulator_fast(double f_mark, double f_space, int bitrate, int sample_rate) : f_mark(f_mark), f_space(f_space), sample_rate(sample_rate), samples_per_bit_(static_cast<int>((sample_rate + (bitrate / 2)) / bitrate))
+inline dds_afsk_modulator_fast<T>::dds_afsk_modulator_fast(double f_mark, double f_space, int bitrate, int sample_rate) : f_mark(f_mark), f_space(f_space), bitrate_(bitrate), sample_rate_(sample_rate), samples_per_bit_(static_cast<int>((sample_rate + (bitrate / 2)) / bitrate))
 {
     const unsigned int default_lut_size = 1024;
 
@@ -91,8 +128,8 @@ inline dds_afsk_modulator_fast<T>::dds_afsk_modulator_fast(double f_mark, double
         }
     }
 
-    phase_increment_mark_ = static_cast<unsigned int>(((static_cast<uint64_t>(static_cast<unsigned int>(this->f_mark)) << 32) / static_cast<uint64_t>(this->sample_rate)));
-    phase_increment_space_ = static_cast<unsigned int>(((static_cast<uint64_t>(static_cast<unsigned int>(this->f_space)) << 32) / static_cast<uint64_t>(this->sample_rate)));
+    phase_increment_mark_ = static_cast<unsigned int>(((static_cast<uint64_t>(static_cast<unsigned int>(this->f_mark)) << 32) / static_cast<uint64_t>(this->sample_rate_)));
+    phase_increment_space_ = static_cast<unsigned int>(((static_cast<uint64_t>(static_cast<unsigned int>(this->f_space)) << 32) / static_cast<uint64_t>(this->sample_rate_)));
     phase_accumulator_ = 0;
 }
 
@@ -121,9 +158,22 @@ inline void dds_afsk_modulator_fast<T>::reset()
 template<typename T>
 inline int dds_afsk_modulator_fast<T>::samples_per_bit() const
 {
+    // Nominal (rounded) value, use bit_clock for exact symbol boundaries
     return samples_per_bit_;
 }
 
+template<typename T>
+inline int dds_afsk_modulator_fast<T>::bitrate() const
+{
+    return bitrate_;
+}
+
+template<typename T>
+inline int dds_afsk_modulator_fast<T>::sample_rate() const
+{
+    return sample_rate_;
+}
+
 // **************************************************************** //
 //                                                                  //
 //                                                                  //
@@ -140,12 +190,15 @@ public:
     double modulate(uint8_t bit);
     void reset();
     int samples_per_bit() const;
+    int bitrate() const;
+    int sample_rate() const;
 
 private:
     double f_center_;         // Center frequency (Hz) - midpoint between mark and space
     double f_delta_;          // Frequency deviation (Hz) - half the difference between mark and space
-    int samples_per_bit_;     // Number of samples per bit period
+    int bitrate_;             // Bits per second
     int sample_rate_;         // Audio sample rate (Hz)
+    double samples_per_bit_;  // Number of samples per bit period (fractional)
     double m_;                // Phase integration accumulator (integral of NRZ bitstream)
     std::vector<double> bitstream_nrz_;  // NRZ-encoded bitstream (+1 or -1 per bit)
     int current_sample_;      // Current sample index in the output stream
@@ -168,6 +221,8 @@ struct bessel_null_modulator
     double modulate(uint8_t bit);
     void reset();
     int samples_per_bit() const;
+    int bitrate() const;
+    int sample_rate() const;
 
 private:
     void compute_bessel_window();
@@ -181,14 +236,92 @@ private:
 
     double phase_;               // Current phase accumulator
     int sample_index_;           // Current sample within bit period
-    int samples_per_bit_;        // Number of samples per bit
+    int samples_per_bit_;        // Nominal number of samples per bit
+    int samples_in_bit_;         // Number of samples in the current bit period
     int transition_samples_;     // Number of samples for frequency transition
     double current_freq_;        // Current instantaneous frequency
     bool use_mark_;              // Toggle between mark and space
+    bit_clock clock_;            // Fractional symbol timing
 
     std::vector<double> bessel_window_;  // Precomputed transition window
 };
 
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// g3ruh_modulator                                                  //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+struct g3ruh_modulator
+{
+    static constexpr int max_span = 16;
+
+    g3ruh_modulator(int bitrate = 9600, int sample_rate = 48000, double rolloff = 0.5, int span = 6, int phases = 32);
+
+    double modulate(uint8_t bit);
+    void reset();
+    int samples_per_bit() const;
+    int bitrate() const;
+    int sample_rate() const;
+    int delay() const;
+    int flush_bits() const;
+
+    template<typename InputIt, typename OutputIt>
+    OutputIt modulate(InputIt first, InputIt last, OutputIt out);
+
+    template<typename OutputIt>
+    OutputIt flush(OutputIt out);
+
+private:
+    void compute_pulse_table();
+
+    int bitrate_;                // Bits per second
+    int sample_rate_;            // Samples per second
+    double rolloff_;             // Raised cosine rolloff factor (0-1)
+    int span_;                   // Pulse length in symbols
+    int phases_;                 // Number of sub-symbol phases in the pulse table
+
+    g3ruh_scrambler scrambler_;
+    bit_clock clock_;            // Fractional symbol timing
+    int samples_in_bit_;         // Number of samples in the current bit period
+    int sample_index_;           // Current sample within the bit period
+    int64_t bit_count_;          // Number of bits started so far
+    int64_t sample_count_;       // Number of samples generated so far
+
+    std::array<double, max_span> symbols_;  // Recent symbols (+1/-1), newest first
+    std::vector<double> pulse_table_;       // phases x span raised cosine taps
+};
+
+template<typename InputIt, typename OutputIt>
+inline OutputIt g3ruh_modulator::modulate(InputIt first, InputIt last, OutputIt out)
+{
+    // Block API, modulates a range of NRZI bits
+    // Each bit is held for the number of samples given by the bit clock
+
+    for (auto it = first; it != last; ++it)
+    {
+        do
+        {
+            *out++ = modulate(*it);
+        } while (sample_index_ != 0);
+    }
+
+    return out;
+}
+
+template<typename OutputIt>
+inline OutputIt g3ruh_modulator::flush(OutputIt out)
+{
+    // Clocks flush_bits() idle bits through the pulse filter, so the last
+    // bits of the frame reach their decision sample
+
+    std::array<uint8_t, max_span> idle = {};
+
+    return modulate(idle.begin(), idle.begin() + flush_bits(), out);
+}
+
 // **************************************************************** //
 //                                                                  //
 //                                                                  //
@@ -203,9 +336,38 @@ struct modulator_base
     virtual int16_t modulate_int(uint8_t bit);
     virtual void reset() = 0;
     virtual int samples_per_bit() const = 0;
+    virtual int bitrate() const = 0;
+    virtual int sample_rate() const = 0;
+    virtual int flush_bits() const;
     virtual ~modulator_base() = default;
 };
 
+// Bits to clock out after a bitstream, so a modulator with a shaping
+// filter delay outputs the end of the frame, 0 for the others
+
+template<typename Modulator, typename = void>
+struct has_flush_bits : std::false_type
+{
+};
+
+template<typename Modulator>
+struct has_flush_bits<Modulator, std::void_t<decltype(std::declval<const Modulator&>().flush_bits())>> : std::true_type
+{
+};
+
+template<typename Modulator>
+inline int modulator_flush_bits(const Modulator& modulator)
+{
+    if constexpr (has_flush_bits<Modulator>::value)
+    {
+        return modulator.flush_bits();
+    }
+    else
+    {
+        return 0;
+    }
+}
+
 // **************************************************************** //
 //                                                                  //
 //                                                                  //
@@ -221,6 +383,8 @@ struct dds_afsk_modulator_adapter : public modulator_base
     double modulate(uint8_t bit) override;
     void reset() override;
     int samples_per_bit() const override;
+    int bitrate() const override;
+    int sample_rate() const override;
 
 private:
     dds_afsk_modulator dds_mod;
@@ -241,6 +405,8 @@ struct dds_afsk_modulator_fast_adapter : public modulator_base
     double modulate(uint8_t bit) override;
     void reset() override;
     int samples_per_bit() const override;
+    int bitrate() const override;
+    int sample_rate() const override;
 
 private:
     dds_afsk_modulator_fast<double> dds_mod;
@@ -261,6 +427,8 @@ struct cpfsk_modulator_adaptor : public modulator_base
     double modulate(uint8_t bit) override;
     void reset() override;
     int samples_per_bit() const override;
+    int bitrate() const override;
+    int sample_rate() const override;
 
 private:
     cpfsk_modulator cpfsk_mod;
@@ -281,7 +449,32 @@ struct bessel_null_modulator_adapter : public modulator_base
     double modulate(uint8_t bit) override;
     void reset() override;
     int samples_per_bit() const override;
+    int bitrate() const override;
+    int sample_rate() const override;
 
 private:
     bessel_null_modulator bessel_mod;
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// g3ruh_modulator_adapter                                          //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+struct g3ruh_modulator_adapter : public modulator_base
+{
+    g3ruh_modulator_adapter(int bitrate = 9600, int sample_rate = 48000, double rolloff = 0.5);
+
+    double modulate(uint8_t bit) override;
+    void reset() override;
+    int samples_per_bit() const override;
+    int bitrate() const override;
+    int sample_rate() const override;
+    int flush_bits() const override;
+
+private:
+    g3ruh_modulator g3ruh_mod;
 };
\ No newline at end of file
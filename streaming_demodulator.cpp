@@ -0,0 +1,569 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// streaming_demodulator.cpp
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "streaming_demodulator.h"
+
+#include <cmath>
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+    int64_t clamp_timing_offset(double timing_offset, int bitrate, int sample_rate)
+    {
+        // Decision offset in samples, the decisions are matched sample by sample,
+        // an offset of a bit or more early would put the first decision before
+        // the first sample and no bit would ever be decided
+        // Late offsets are valid, ex: to make up for a decimation filter delay
+
+        const int64_t samples_per_bit = sample_rate / bitrate;
+        const int64_t offset = std::lround(timing_offset * sample_rate / bitrate);
+        return (std::max)(offset, 1 - samples_per_bit);
+    }
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// g3ruh_demodulator                                                //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+g3ruh_demodulator::g3ruh_demodulator(int bitrate, int sample_rate, int delay) : bitrate_(bitrate), sample_rate_(sample_rate), delay_((std::max)(delay, 0))
+{
+}
+
+void g3ruh_demodulator::demodulate(const double* samples, size_t count, std::vector<uint8_t>& bits)
+{
+    // Streaming G3RUH demodulator
+    //
+    //   - Sample the baseband signal at the raised cosine peak of each symbol
+    //   - Slice at zero: positive = 1, negative = 0
+    //   - Descramble the sliced bits, 32 at a time
+    //
+    // The output is the NRZI bitstream, same as the AFSK demodulators,
+    // and plugs into the existing bitstream converters
+    // State is kept across calls, the samples can be fed in any block size
+
+    raw_bits_.clear();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (sample_count_ == decision_sample(symbol_count_))
+        {
+            raw_bits_.push_back(samples[i] > 0.0 ? 1 : 0);
+            symbol_count_++;
+        }
+        sample_count_++;
+    }
+
+    g3ruh_descramble(raw_bits_.begin(), raw_bits_.end(), descrambler_);
+
+    bits.insert(bits.end(), raw_bits_.begin(), raw_bits_.end());
+}
+
+std::vector<uint8_t> g3ruh_demodulator::demodulate(const std::vector<double>& samples)
+{
+    std::vector<uint8_t> bits;
+    demodulate(samples.data(), samples.size(), bits);
+    return bits;
+}
+
+void g3ruh_demodulator::reset()
+{
+    descrambler_.reset();
+    sample_count_ = 0;
+    symbol_count_ = 0;
+}
+
+int64_t g3ruh_demodulator::decision_sample(int64_t symbol) const
+{
+    // Symbol m peaks at the start of bit m + delay
+    // Same rounding as bit_clock, bit k starts at floor(k * sample_rate / bitrate)
+    return ((symbol + delay_) * sample_rate_) / bitrate_;
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// sliding_dft_demodulator                                          //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+sliding_dft_demodulator::sliding_dft_demodulator(double f_mark, double f_space, int bitrate, int sample_rate, double threshold, double timing_offset) :
+    bitrate_(bitrate),
+    sample_rate_(sample_rate),
+    threshold_(threshold),
+    offset_samples_(clamp_timing_offset(timing_offset, bitrate, sample_rate)),
+    window_(static_cast<size_t>(std::lround(static_cast<double>(sample_rate) / bitrate))),
+    mark_(f_mark, window_, sample_rate),
+    space_(f_space, window_, sample_rate)
+{
+}
+
+void sliding_dft_demodulator::demodulate(const double* samples, size_t count, std::vector<uint8_t>& bits)
+{
+    demodulate_bits(samples, count, bits, nullptr);
+}
+
+void sliding_dft_demodulator::demodulate(const double* samples, size_t count, std::vector<uint8_t>& bits, std::vector<float>& confidence)
+{
+    demodulate_bits(samples, count, bits, &confidence);
+}
+
+void sliding_dft_demodulator::demodulate_bits(const double* samples, size_t count, std::vector<uint8_t>& bits, std::vector<float>* confidence)
+{
+    // Streaming tone energy demodulator, sliding DFT at the mark and space frequencies
+    //
+    //   - Every sample is mixed with e^(-j w n), the window sum is updated
+    //     by adding the new product and removing the one leaving the window
+    //   - O(1) work per sample, independent of the window size
+    //   - At the end of every bit the window holds exactly that bit,
+    //     same energies as a per-bit DFT, the stronger tone wins
+    //
+    // Bit boundaries follow bit_clock, the window is one bit rounded to whole samples
+    // State is kept across calls, the samples can be fed in any block size
+    //
+    // The confidence of a bit is the distance of the normalized energy
+    // difference from the slicer threshold, 0 = undecided, up to 2
+
+    for (size_t i = 0; i < count; i++)
+    {
+        mark_.update(samples[i]);
+        space_.update(samples[i]);
+
+        if (sample_count_ == decision_sample(bit_count_))
+        {
+            double mark_energy = mark_.energy();
+            double space_energy = space_.energy();
+            double diff = mark_energy - space_energy;
+            bits.push_back(diff > threshold_ * (mark_energy + space_energy) ? 1 : 0);
+            if (confidence != nullptr)
+            {
+                double total = mark_energy + space_energy;
+                confidence->push_back(total > 0.0 ? static_cast<float>(std::abs(diff / total - threshold_)) : 0.0f);
+            }
+            bit_count_++;
+        }
+
+        sample_count_++;
+    }
+}
+
+std::vector<uint8_t> sliding_dft_demodulator::demodulate(const std::vector<double>& samples)
+{
+    std::vector<uint8_t> bits;
+    demodulate(samples.data(), samples.size(), bits);
+    return bits;
+}
+
+void sliding_dft_demodulator::reset()
+{
+    mark_.reset();
+    space_.reset();
+    sample_count_ = 0;
+    bit_count_ = 0;
+}
+
+int64_t sliding_dft_demodulator::decision_sample(int64_t bit) const
+{
+    // Last sample of bit k, same rounding as bit_clock, plus the timing offset
+    return ((bit + 1) * sample_rate_) / bitrate_ - 1 + offset_samples_;
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// quadrature_demodulator                                           //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+quadrature_demodulator::quadrature_demodulator(double f_mark, double f_space, int bitrate, int sample_rate, double threshold, double timing_offset, double taper, double window_bits) : bitrate_(bitrate), sample_rate_(sample_rate), threshold_(threshold)
+{
+    constexpr double pi = 3.14159265358979323846;
+
+    window_ = static_cast<size_t>((std::max)(std::lround(window_bits * sample_rate / bitrate), 1L));
+
+    // A window longer than a bit is centered on the bit, the decision is
+    // delayed by half the excess
+
+    offset_samples_ = clamp_timing_offset(timing_offset, bitrate, sample_rate) + std::lround((window_bits - 1.0) / 2.0 * sample_rate / bitrate);
+
+    // Matched filter for a rectangular bit is a boxcar over the bit
+    // taper > 0 rolls off the edges with a cosine (Tukey window), less
+    // sensitive to the transition between bits
+    // With CPFSK the neighbouring bits are phase continuous, integrating
+    // into them with tapered edges gains more energy than it lets in noise,
+    // 1.5 bits with taper 0.5 decodes more frames than a one bit boxcar
+    // at low SNR
+
+    taps_.assign(window_, 1.0);
+
+    size_t edge = static_cast<size_t>(taper * window_ / 2.0);
+    for (size_t i = 0; i < edge; i++)
+    {
+        double w = 0.5 * (1.0 - std::cos(pi * (i + 0.5) / edge));
+        taps_[i] = w;
+        taps_[window_ - 1 - i] = w;
+    }
+
+    for (auto [m, f] : { std::pair<mixer*, double>{ &mark_, f_mark }, { &space_, f_space } })
+    {
+        m->table_re.resize(block_size + 1);
+        m->table_im.resize(block_size + 1);
+        for (size_t i = 0; i <= block_size; i++)
+        {
+            m->table_re[i] = std::cos(2.0 * pi * f * i / sample_rate);
+            m->table_im[i] = std::sin(2.0 * pi * f * i / sample_rate);
+        }
+    }
+
+    reset();
+}
+
+void quadrature_demodulator::demodulate(const double* samples, size_t count, std::vector<uint8_t>& bits)
+{
+    demodulate_bits(samples, count, bits, nullptr);
+}
+
+void quadrature_demodulator::demodulate(const double* samples, size_t count, std::vector<uint8_t>& bits, std::vector<float>& confidence)
+{
+    demodulate_bits(samples, count, bits, &confidence);
+}
+
+void quadrature_demodulator::demodulate_bits(const double* samples, size_t count, std::vector<uint8_t>& bits, std::vector<float>* confidence)
+{
+    // Quadrature correlator AFSK demodulator
+    //
+    //   - Mix the input down with e^(-j w n) at the mark and space frequencies
+    //   - Integrate I and Q over the window with the matched filter taps
+    //   - The tone with more energy wins, |I|^2 + |Q|^2
+    //
+    // Samples are processed in blocks, every stage is a straight loop over
+    // arrays (mixing, multiply-accumulate) that the compiler vectorizes
+    // The matched filter only runs at the decision points, once per bit
+    //
+    // Bit boundaries follow bit_clock, same bits as sliding_dft_demodulator
+    // when window_bits is 1 and taper is 0
+    // State is kept across calls, the samples can be fed in any block size
+
+    const size_t history_size = window_ - 1;
+
+    while (count > 0)
+    {
+        size_t n = (std::min)(count, block_size);
+
+        for (auto& h : history_)
+        {
+            h.resize(history_size + n);
+        }
+
+        mark_.mix(samples, n, &history_[0][history_size], &history_[1][history_size]);
+        space_.mix(samples, n, &history_[2][history_size], &history_[3][history_size]);
+
+        // Decisions that fall inside this block, the window ends at sample j
+
+        for (size_t j = 0; j < n; j++)
+        {
+            if (sample_count_ + static_cast<int64_t>(j) != decision_sample(bit_count_))
+            {
+                continue;
+            }
+
+            size_t start = history_size + j + 1 - window_;
+
+            double mark_re = correlate(&history_[0][start]);
+            double mark_im = correlate(&history_[1][start]);
+            double space_re = correlate(&history_[2][start]);
+            double space_im = correlate(&history_[3][start]);
+
+            double mark_energy = mark_re * mark_re + mark_im * mark_im;
+            double space_energy = space_re * space_re + space_im * space_im;
+
+            bits.push_back(mark_energy - space_energy > threshold_ * (mark_energy + space_energy) ? 1 : 0);
+            if (confidence != nullptr)
+            {
+                double total = mark_energy + space_energy;
+                confidence->push_back(total > 0.0 ? static_cast<float>(std::abs((mark_energy - space_energy) / total - threshold_)) : 0.0f);
+            }
+            bit_count_++;
+        }
+
+        // Keep the last window - 1 samples for the next block
+
+        for (auto& h : history_)
+        {
+            std::copy(h.end() - history_size, h.end(), h.begin());
+            h.resize(history_size);
+        }
+
+        sample_count_ += n;
+        samples += n;
+        count -= n;
+    }
+}
+
+std::vector<uint8_t> quadrature_demodulator::demodulate(const std::vector<double>& samples)
+{
+    std::vector<uint8_t> bits;
+    demodulate(samples.data(), samples.size(), bits);
+    return bits;
+}
+
+void quadrature_demodulator::reset()
+{
+    for (mixer* m : { &mark_, &space_ })
+    {
+        m->phase_re = 1.0;
+        m->phase_im = 0.0;
+    }
+
+    for (auto& h : history_)
+    {
+        h.assign(window_ - 1, 0.0);
+    }
+
+    sample_count_ = 0;
+    bit_count_ = 0;
+}
+
+int64_t quadrature_demodulator::decision_sample(int64_t bit) const
+{
+    // Last sample of bit k, same rounding as bit_clock, plus the timing offset
+    return ((bit + 1) * sample_rate_) / bitrate_ - 1 + offset_samples_;
+}
+
+double quadrature_demodulator::correlate(const double* products) const
+{
+    const double* taps = taps_.data();
+    const size_t size = window_;
+
+    // Four partial sums, breaks the dependency on a single accumulator
+
+    double sum0 = 0.0;
+    double sum1 = 0.0;
+    double sum2 = 0.0;
+    double sum3 = 0.0;
+
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4)
+    {
+        sum0 += products[i] * taps[i];
+        sum1 += products[i + 1] * taps[i + 1];
+        sum2 += products[i + 2] * taps[i + 2];
+        sum3 += products[i + 3] * taps[i + 3];
+    }
+    for (; i < size; i++)
+    {
+        sum0 += products[i] * taps[i];
+    }
+
+    return (sum0 + sum1) + (sum2 + sum3);
+}
+
+void quadrature_demodulator::mixer::mix(const double* samples, size_t count, double* out_re, double* out_im)
+{
+    // Oscillator for the block = phase at the block start * e^(j w i)
+    // No dependency between samples, the loop vectorizes
+
+    const double* t_re = table_re.data();
+    const double* t_im = table_im.data();
+    const double p_re = phase_re;
+    const double p_im = phase_im;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        double c = p_re * t_re[i] - p_im * t_im[i];
+        double s = p_re * t_im[i] + p_im * t_re[i];
+        out_re[i] = samples[i] * c;
+        out_im[i] = -samples[i] * s;
+    }
+
+    // Advance the phase to the next block, and keep it on the unit circle
+
+    double next_re = p_re * t_re[count] - p_im * t_im[count];
+    double next_im = p_re * t_im[count] + p_im * t_re[count];
+    double magnitude = std::sqrt(next_re * next_re + next_im * next_im);
+
+    phase_re = next_re / magnitude;
+    phase_im = next_im / magnitude;
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// pll_demodulator                                                  //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+pll_demodulator::pll_demodulator(double f_mark, double f_space, int bitrate, int sample_rate, double threshold) :
+    threshold_(threshold),
+    mark_(f_mark, static_cast<size_t>(std::lround(static_cast<double>(sample_rate) / bitrate)), sample_rate),
+    space_(f_space, static_cast<size_t>(std::lround(static_cast<double>(sample_rate) / bitrate)), sample_rate),
+    clock_(bitrate, sample_rate)
+{
+}
+
+void pll_demodulator::demodulate(const double* samples, size_t count, std::vector<uint8_t>& bits)
+{
+    demodulate_bits(samples, count, bits, nullptr);
+}
+
+void pll_demodulator::demodulate(const double* samples, size_t count, std::vector<uint8_t>& bits, std::vector<float>& confidence)
+{
+    demodulate_bits(samples, count, bits, &confidence);
+}
+
+void pll_demodulator::demodulate_bits(const double* samples, size_t count, std::vector<uint8_t>& bits, std::vector<float>* confidence)
+{
+    // AFSK demodulator with bit clock recovery
+    //
+    //   - Discriminator: sliding DFT energies over one bit at the mark and
+    //     space frequencies, (mark - space) / (mark + space), in [-1, 1]
+    //   - The discriminator crosses zero halfway into a bit transition,
+    //     clock_recovery locks onto the crossings and samples every bit
+    //     at its peak, with sub-sample precision
+    //
+    // No assumption on the bit alignment or on the sample clock of the
+    // transmitter, bits are produced as soon as they are recovered
+
+    for (size_t i = 0; i < count; i++)
+    {
+        mark_.update(samples[i]);
+        space_.update(samples[i]);
+
+        double mark_energy = mark_.energy();
+        double space_energy = space_.energy();
+        double total = mark_energy + space_energy;
+
+        double discriminator = total > 0.0 ? (mark_energy - space_energy) / total : 0.0;
+
+        double value;
+        if (clock_.process(discriminator, value))
+        {
+            bits.push_back(value > threshold_ ? 1 : 0);
+            if (confidence != nullptr)
+            {
+                confidence->push_back(static_cast<float>(std::abs(value - threshold_)));
+            }
+        }
+    }
+}
+
+std::vector<uint8_t> pll_demodulator::demodulate(const std::vector<double>& samples)
+{
+    std::vector<uint8_t> bits;
+    demodulate(samples.data(), samples.size(), bits);
+    return bits;
+}
+
+void pll_demodulator::reset()
+{
+    mark_.reset();
+    space_.reset();
+    clock_.reset();
+}
+
+double pll_demodulator::samples_per_bit() const
+{
+    return clock_.samples_per_bit();
+}
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// channelized_demodulator                                          //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+channelized_demodulator::channelized_demodulator(double f_mark, double f_space, int bitrate, int sample_rate, double max_offset, double offset_step, double threshold) :
+    threshold_(threshold),
+    channelizer_(sample_rate, (f_mark + f_space) / 2.0, f_space - f_mark, bitrate, max_offset, offset_step)
+{
+    clocks_.assign(channelizer_.channels(), clock_recovery(bitrate, channelizer_.sample_rate()));
+}
+
+void channelized_demodulator::demodulate(const double* samples, size_t count, std::vector<std::vector<uint8_t>>& bits)
+{
+    // The channelizer does all the filtering in one pass, what is left per
+    // channel is the clock recovery and the slicer, a few operations per
+    // decimated sample, adding offsets is almost free
+
+    const size_t channels = clocks_.size();
+
+    bits.resize(channels);
+
+    discriminators_.clear();
+    channelizer_.process(samples, count, discriminators_);
+
+    for (size_t n = 0; n + channels <= discriminators_.size(); n += channels)
+    {
+        for (size_t c = 0; c < channels; c++)
+        {
+            double value;
+            if (clocks_[c].process(discriminators_[n + c], value))
+            {
+                bits[c].push_back(value > threshold_ ? 1 : 0);
+            }
+        }
+    }
+}
+
+std::vector<std::vector<uint8_t>> channelized_demodulator::demodulate(const std::vector<double>& samples)
+{
+    std::vector<std::vector<uint8_t>> bits;
+    demodulate(samples.data(), samples.size(), bits);
+    return bits;
+}
+
+void channelized_demodulator::reset()
+{
+    channelizer_.reset();
+    for (clock_recovery& clock : clocks_)
+    {
+        clock.reset();
+    }
+}
+
+size_t channelized_demodulator::channels() const
+{
+    return channelizer_.channels();
+}
+
+double channelized_demodulator::offset(size_t channel) const
+{
+    return channelizer_.offset(channel);
+}
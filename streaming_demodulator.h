@@ -0,0 +1,213 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// streaming_demodulator.h
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "bitstream.h"
+#include "dsp.h"
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// g3ruh_demodulator                                                //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+struct g3ruh_demodulator
+{
+    g3ruh_demodulator(int bitrate = 9600, int sample_rate = 48000, int delay = 3);
+
+    void demodulate(const double* samples, size_t count, std::vector<uint8_t>& bits);
+    std::vector<uint8_t> demodulate(const std::vector<double>& samples);
+    void reset();
+
+private:
+    int64_t decision_sample(int64_t symbol) const;
+
+    int bitrate_;                // Bits per second
+    int sample_rate_;            // Samples per second
+    int delay_;                  // Pulse shaping delay of the modulator, in bits
+    g3ruh_descrambler descrambler_;
+    int64_t sample_count_ = 0;   // Samples consumed so far
+    int64_t symbol_count_ = 0;   // Symbols decided so far
+    std::vector<uint8_t> raw_bits_;
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// sliding_dft_demodulator                                          //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// timing_offset moves the decision point from the end of the bit, in bits,
+// later when positive, ex: after a filter delay, earlier offsets are clamped
+// to just over -1, the first decision must fall on the first bit
+
+struct sliding_dft_demodulator
+{
+    sliding_dft_demodulator(double f_mark = 1200.0, double f_space = 2200.0, int bitrate = 1200, int sample_rate = 48000, double threshold = 0.0, double timing_offset = 0.0);
+
+    void demodulate(const double* samples, size_t count, std::vector<uint8_t>& bits);
+    void demodulate(const double* samples, size_t count, std::vector<uint8_t>& bits, std::vector<float>& confidence);
+    std::vector<uint8_t> demodulate(const std::vector<double>& samples);
+    void reset();
+
+private:
+    void demodulate_bits(const double* samples, size_t count, std::vector<uint8_t>& bits, std::vector<float>* confidence);
+    int64_t decision_sample(int64_t bit) const;
+
+    int bitrate_;                // Bits per second
+    int sample_rate_;            // Samples per second
+    double threshold_;           // Slicer bias, normalized to the total energy, 0 = unbiased
+    int64_t offset_samples_;     // Decision point relative to the end of the bit
+    size_t window_;              // Samples per bit, rounded
+    sliding_dft mark_;
+    sliding_dft space_;
+    int64_t sample_count_ = 0;   // Samples consumed so far
+    int64_t bit_count_ = 0;      // Bits decided so far
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// quadrature_demodulator                                           //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// timing_offset is clamped the same as sliding_dft_demodulator
+// The default matched filter spans 1.5 bits centered on the bit with a
+// tapered edge, window_bits = 1 and taper = 0 decide the same bits as
+// sliding_dft_demodulator
+
+struct quadrature_demodulator
+{
+    quadrature_demodulator(double f_mark = 1200.0, double f_space = 2200.0, int bitrate = 1200, int sample_rate = 48000, double threshold = 0.0, double timing_offset = 0.0, double taper = 0.5, double window_bits = 1.5);
+
+    void demodulate(const double* samples, size_t count, std::vector<uint8_t>& bits);
+    void demodulate(const double* samples, size_t count, std::vector<uint8_t>& bits, std::vector<float>& confidence);
+    std::vector<uint8_t> demodulate(const std::vector<double>& samples);
+    void reset();
+
+private:
+    static constexpr size_t block_size = 256;
+
+    struct mixer
+    {
+        std::vector<double> table_re; // e^(j w i), i = 0 .. block_size
+        std::vector<double> table_im;
+        double phase_re = 1.0;        // e^(j w n) at the start of the block
+        double phase_im = 0.0;
+
+        void mix(const double* samples, size_t count, double* out_re, double* out_im);
+    };
+
+    void demodulate_bits(const double* samples, size_t count, std::vector<uint8_t>& bits, std::vector<float>* confidence);
+    int64_t decision_sample(int64_t bit) const;
+    double correlate(const double* products) const;
+
+    int bitrate_;                // Bits per second
+    int sample_rate_;            // Samples per second
+    double threshold_;           // Slicer bias, normalized to the total energy, 0 = unbiased
+    int64_t offset_samples_;     // Decision point relative to the end of the bit, includes the delay to center the window
+    size_t window_;              // Matched filter length, window_bits rounded to whole samples
+    std::vector<double> taps_;   // Matched filter taps
+    mixer mark_;
+    mixer space_;
+    std::vector<double> history_[4];  // Mixer outputs, mark I/Q and space I/Q, window - 1 samples of history + current block
+    int64_t sample_count_ = 0;   // Samples consumed so far
+    int64_t bit_count_ = 0;      // Bits decided so far
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// pll_demodulator                                                  //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+struct pll_demodulator
+{
+    pll_demodulator(double f_mark = 1200.0, double f_space = 2200.0, int bitrate = 1200, int sample_rate = 48000, double threshold = 0.0);
+
+    void demodulate(const double* samples, size_t count, std::vector<uint8_t>& bits);
+    void demodulate(const double* samples, size_t count, std::vector<uint8_t>& bits, std::vector<float>& confidence);
+    std::vector<uint8_t> demodulate(const std::vector<double>& samples);
+    void reset();
+
+    double samples_per_bit() const;
+
+private:
+    void demodulate_bits(const double* samples, size_t count, std::vector<uint8_t>& bits, std::vector<float>* confidence);
+
+    double threshold_;           // Slicer level on the normalized discriminator, 0 = unbiased
+    sliding_dft mark_;
+    sliding_dft space_;
+    clock_recovery clock_;
+};
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// channelized_demodulator                                          //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// AFSK demodulator searching a range of frequency offsets, ex: mistuned HF
+// One fft_channelizer for all offsets, a bit clock recovery per channel
+// Each channel produces its own bit stream
+
+struct channelized_demodulator
+{
+    channelized_demodulator(double f_mark = 1600.0, double f_space = 1800.0, int bitrate = 300, int sample_rate = 48000, double max_offset = 100.0, double offset_step = 25.0, double threshold = 0.0);
+
+    void demodulate(const double* samples, size_t count, std::vector<std::vector<uint8_t>>& bits);
+    std::vector<std::vector<uint8_t>> demodulate(const std::vector<double>& samples);
+    void reset();
+
+    size_t channels() const;
+    double offset(size_t channel) const;
+
+private:
+    double threshold_;           // Slicer level on the normalized discriminator, 0 = unbiased
+    fft_channelizer channelizer_;
+    std::vector<clock_recovery> clocks_;     // One per channel
+    std::vector<double> discriminators_;     // Channelizer output, interleaved
+};
@@ -0,0 +1,487 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// tcp_data_stream.cpp
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "tcp_data_stream.h"
+
+#include <algorithm>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// tcp_data_stream                                                  //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+namespace
+{
+    constexpr uint64_t listen_tag = ~uint64_t(0);   // epoll tag of the listening socket, clients use their slot
+    constexpr size_t receive_buffer_size = 4096;
+    constexpr int max_iov = 64;
+    constexpr int max_events = 64;
+
+    bool set_nonblocking(int fd)
+    {
+        int flags = fcntl(fd, F_GETFL, 0);
+        return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+}
+
+tcp_data_stream::tcp_data_stream(const std::string& bind_address, int port, size_t max_clients, size_t max_queue_frames, size_t max_queue_bytes, int send_buffer_size) :
+    bind_address_(bind_address),
+    port_(port),
+    max_queue_frames_((std::max)(size_t(1), max_queue_frames)),
+    max_queue_bytes_(max_queue_bytes),
+    send_buffer_size_(send_buffer_size),
+    connections_(max_clients)
+{
+    // Slots are allocated upfront, accepting a client does not allocate
+
+    for (connection& c : connections_)
+    {
+        c.receive_buffer.resize(receive_buffer_size);
+        c.queue.resize(max_queue_frames_);
+    }
+
+    for (size_t i = max_clients; i > 0; i--)
+    {
+        free_slots_.push_back(i - 1);
+    }
+}
+
+tcp_data_stream::~tcp_data_stream()
+{
+    stop();
+}
+
+bool tcp_data_stream::start()
+{
+    stop();
+
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd_ < 0)
+    {
+        return false;
+    }
+
+    int reuse = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port_));
+
+    if (inet_pton(AF_INET, bind_address_.c_str(), &address.sin_addr) != 1 ||
+        bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listen_fd_, 64) != 0 ||
+        !set_nonblocking(listen_fd_))
+    {
+        stop();
+        return false;
+    }
+
+    // Port 0 binds an ephemeral port, report the real one
+
+    socklen_t length = sizeof(address);
+    getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &length);
+    port_ = ntohs(address.sin_port);
+
+    epoll_fd_ = epoll_create1(0);
+    if (epoll_fd_ < 0)
+    {
+        stop();
+        return false;
+    }
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = listen_tag;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &event);
+
+    reserve_fd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    return true;
+}
+
+void tcp_data_stream::stop()
+{
+    for (size_t slot = 0; slot < connections_.size(); slot++)
+    {
+        if (connections_[slot].fd >= 0)
+        {
+            close_client(slot);
+        }
+    }
+
+    if (epoll_fd_ >= 0)
+    {
+        ::close(epoll_fd_);
+        epoll_fd_ = -1;
+    }
+
+    if (listen_fd_ >= 0)
+    {
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+    }
+
+    if (reserve_fd_ >= 0)
+    {
+        ::close(reserve_fd_);
+        reserve_fd_ = -1;
+    }
+}
+
+size_t tcp_data_stream::poll(int timeout_ms, std::vector<kiss_frame>& received)
+{
+    // One round of the event loop: new clients, client input, queued output
+    // Returns the number of KISS frames received from the clients
+
+    if (epoll_fd_ < 0)
+    {
+        return 0;
+    }
+
+    epoll_event events[max_events];
+    int n = epoll_wait(epoll_fd_, events, max_events, timeout_ms);
+
+    size_t before = received.size();
+
+    for (int i = 0; i < n; i++)
+    {
+        if (events[i].data.u64 == listen_tag)
+        {
+            accept_clients();
+            continue;
+        }
+
+        size_t slot = static_cast<size_t>(events[i].data.u64);
+
+        if (connections_[slot].fd < 0)
+        {
+            continue;
+        }
+
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        {
+            read_client(slot, received);
+        }
+
+        if (connections_[slot].fd >= 0 && (events[i].events & EPOLLOUT))
+        {
+            flush_client(slot);
+        }
+    }
+
+    return received.size() - before;
+}
+
+size_t tcp_data_stream::write(const uint8_t* frame, size_t size, uint8_t port)
+{
+    encode_buffer_.clear();
+    kiss_encode(frame, size, encode_buffer_, port);
+    return write(std::make_shared<const std::vector<uint8_t>>(encode_buffer_));
+}
+
+size_t tcp_data_stream::write(std::shared_ptr<const std::vector<uint8_t>> data)
+{
+    // Queues an encoded buffer for every client and sends what the sockets take now
+    // Returns the number of clients the buffer was queued for
+
+    size_t queued = 0;
+
+    for (size_t slot = 0; slot < connections_.size(); slot++)
+    {
+        connection& c = connections_[slot];
+
+        if (c.fd < 0)
+        {
+            continue;
+        }
+
+        if (c.count == max_queue_frames_ || c.queued_bytes + data->size() > max_queue_bytes_)
+        {
+            stats_.dropped_frames++;
+            continue;
+        }
+
+        c.queue[(c.head + c.count) % max_queue_frames_] = data;
+        c.count++;
+        c.queued_bytes += data->size();
+        stats_.sent_frames++;
+        queued++;
+
+        flush_client(slot);
+    }
+
+    return queued;
+}
+
+int tcp_data_stream::port() const
+{
+    return port_;
+}
+
+size_t tcp_data_stream::clients() const
+{
+    return connections_.size() - free_slots_.size();
+}
+
+const tcp_data_stream_stats& tcp_data_stream::stats() const
+{
+    return stats_;
+}
+
+void tcp_data_stream::accept_clients()
+{
+    while (true)
+    {
+        int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+
+            // Out of descriptors, the connection stays pending and the level triggered
+            // listening socket would wake every poll, free the spare descriptor to
+            // accept the connection and close it
+
+            if ((errno == EMFILE || errno == ENFILE) && reserve_fd_ >= 0)
+            {
+                ::close(reserve_fd_);
+                fd = accept(listen_fd_, nullptr, nullptr);
+                reserve_fd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                if (fd >= 0)
+                {
+                    ::close(fd);
+                    stats_.rejected++;
+                    continue;
+                }
+            }
+
+            return;
+        }
+
+        if (free_slots_.empty() || !set_nonblocking(fd))
+        {
+            ::close(fd);
+            stats_.rejected++;
+            continue;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        if (send_buffer_size_ > 0)
+        {
+            setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &send_buffer_size_, sizeof(send_buffer_size_));
+        }
+
+        size_t slot = free_slots_.back();
+        free_slots_.pop_back();
+
+        connection& c = connections_[slot];
+        c.fd = fd;
+        c.decoder.reset();
+        c.head = 0;
+        c.count = 0;
+        c.offset = 0;
+        c.queued_bytes = 0;
+        c.want_write = false;
+
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = slot;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+
+        stats_.accepted++;
+    }
+}
+
+void tcp_data_stream::read_client(size_t slot, std::vector<kiss_frame>& received)
+{
+    connection& c = connections_[slot];
+
+    while (true)
+    {
+        ssize_t n = recv(c.fd, c.receive_buffer.data(), c.receive_buffer.size(), 0);
+
+        if (n > 0)
+        {
+            stats_.received_frames += c.decoder.process(c.receive_buffer.data(), static_cast<size_t>(n), received);
+            continue;
+        }
+
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return;
+        }
+
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        // Closed by the client, or an error
+
+        close_client(slot);
+        return;
+    }
+}
+
+void tcp_data_stream::flush_client(size_t slot)
+{
+    // One gathered write of the queued buffers, the first one from where the last write stopped
+
+    connection& c = connections_[slot];
+
+    while (c.count > 0)
+    {
+        iovec iov[max_iov];
+        int iov_count = 0;
+
+        for (size_t i = 0; i < c.count && iov_count < max_iov; i++)
+        {
+            const std::vector<uint8_t>& data = *c.queue[(c.head + i) % max_queue_frames_];
+            size_t skip = (i == 0) ? c.offset : 0;
+            iov[iov_count].iov_base = const_cast<uint8_t*>(data.data() + skip);
+            iov[iov_count].iov_len = data.size() - skip;
+            iov_count++;
+        }
+
+        // sendmsg is writev with flags, MSG_NOSIGNAL turns a closed client into EPIPE instead of SIGPIPE
+
+        msghdr message = {};
+        message.msg_iov = iov;
+        message.msg_iovlen = static_cast<size_t>(iov_count);
+
+        ssize_t n = sendmsg(c.fd, &message, MSG_NOSIGNAL);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                close_client(slot);
+                return;
+            }
+            break;
+        }
+
+        size_t sent = static_cast<size_t>(n);
+        c.queued_bytes -= sent;
+
+        while (sent > 0)
+        {
+            size_t remaining = c.queue[c.head]->size() - c.offset;
+            if (sent < remaining)
+            {
+                c.offset += sent;
+                break;
+            }
+
+            sent -= remaining;
+            c.queue[c.head].reset();
+            c.head = (c.head + 1) % max_queue_frames_;
+            c.count--;
+            c.offset = 0;
+        }
+
+        if (c.count > 0 && c.offset > 0)
+        {
+            // Partial write, the socket buffer is full
+            break;
+        }
+    }
+
+    update_interest(slot);
+}
+
+void tcp_data_stream::close_client(size_t slot)
+{
+    connection& c = connections_[slot];
+
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, c.fd, nullptr);
+    ::close(c.fd);
+
+    c.fd = -1;
+    for (size_t i = 0; i < c.count; i++)
+    {
+        c.queue[(c.head + i) % max_queue_frames_].reset();
+    }
+    c.count = 0;
+    c.queued_bytes = 0;
+    c.offset = 0;
+
+    free_slots_.push_back(slot);
+}
+
+void tcp_data_stream::update_interest(size_t slot)
+{
+    // EPOLLOUT only while there is something queued, otherwise it fires continuously
+
+    connection& c = connections_[slot];
+
+    bool want_write = c.count > 0;
+    if (want_write == c.want_write)
+    {
+        return;
+    }
+
+    uint32_t events = EPOLLIN;
+    if (want_write)
+    {
+        events |= EPOLLOUT;
+    }
+
+    epoll_event event = {};
+    event.events = events;
+    event.data.u64 = slot;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, c.fd, &event);
+
+    c.want_write = want_write;
+}
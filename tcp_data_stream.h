@@ -0,0 +1,125 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// tcp_data_stream.h
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "kiss.h"
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// tcp_data_stream                                                  //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// KISS over TCP server, ex: tcp_data_stream with the ax25_kiss format
+//
+//   - Single threaded, one epoll set for the listening socket and every
+//     client, poll runs one round of the event loop
+//   - Connection slots and their receive buffers are allocated upfront,
+//     max_clients of them, more connections are accepted and closed
+//   - Every frame is KISS encoded once, the clients queue a reference to
+//     the same buffer, queued buffers go out with one gathered sendmsg per client
+//   - A client that does not keep up queues up to max_queue_frames frames
+//     or max_queue_bytes bytes, past that its frames are dropped
+//
+// Linux only, epoll
+
+struct tcp_data_stream_stats
+{
+    uint64_t accepted = 0;         // Connections accepted
+    uint64_t rejected = 0;         // Connections closed because all slots were in use
+    uint64_t sent_frames = 0;      // Frames queued to clients
+    uint64_t dropped_frames = 0;   // Frames dropped for clients with a full queue
+    uint64_t received_frames = 0;  // KISS frames received from clients
+};
+
+struct tcp_data_stream
+{
+    tcp_data_stream(const std::string& bind_address = "0.0.0.0", int port = 8002, size_t max_clients = 100, size_t max_queue_frames = 256, size_t max_queue_bytes = 256 * 1024, int send_buffer_size = 0);
+    tcp_data_stream(const tcp_data_stream&) = delete;
+    tcp_data_stream& operator=(const tcp_data_stream&) = delete;
+    ~tcp_data_stream();
+
+    bool start();
+    void stop();
+
+    size_t poll(int timeout_ms, std::vector<kiss_frame>& received);
+    size_t write(const uint8_t* frame, size_t size, uint8_t port = 0);
+    size_t write(std::shared_ptr<const std::vector<uint8_t>> data);
+
+    int port() const;
+    size_t clients() const;
+    const tcp_data_stream_stats& stats() const;
+
+private:
+    using buffer = std::shared_ptr<const std::vector<uint8_t>>;
+
+    struct connection
+    {
+        int fd = -1;
+        std::vector<uint8_t> receive_buffer;  // Allocated once with the slot
+        kiss_decoder decoder;
+        std::vector<buffer> queue;            // Ring of max_queue_frames entries
+        size_t head = 0;                      // Oldest queued buffer
+        size_t count = 0;                     // Queued buffers
+        size_t offset = 0;                    // Bytes of the oldest buffer already sent
+        size_t queued_bytes = 0;
+        bool want_write = false;              // EPOLLOUT registered
+    };
+
+    void accept_clients();
+    void read_client(size_t slot, std::vector<kiss_frame>& received);
+    void flush_client(size_t slot);
+    void close_client(size_t slot);
+    void update_interest(size_t slot);
+
+    std::string bind_address_;
+    int port_;
+    size_t max_queue_frames_;
+    size_t max_queue_bytes_;
+    int send_buffer_size_;         // SO_SNDBUF for the clients, 0 = system default
+    int listen_fd_ = -1;
+    int reserve_fd_ = -1;          // Spare descriptor, freed to turn away connections when out of descriptors
+    int epoll_fd_ = -1;
+    std::vector<connection> connections_;
+    std::vector<size_t> free_slots_;
+    std::vector<uint8_t> encode_buffer_;   // Scratch for write(frame)
+    tcp_data_stream_stats stats_;
+};
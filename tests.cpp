@@ -1,11 +1,39 @@
-#include "bitstream.h"
+﻿#include "bitstream.h"
 #include "audio_stream.h"
 #include "modem.h"
 #include "demodulator.h"
 #include "modulator.h"
+#include "streaming_demodulator.h"
+#include "audio_ring.h"
+#include "decoder.h"
+#include "iq_stream.h"
+#include "batch_decoder.h"
+#include "mapped_wav_stream.h"
+#include "kiss.h"
+#include "data_format.h"
 
 #include <random>
 #include <fstream>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <filesystem>
+#include <cstring>
+#include <deque>
+#include <limits>
+
+#ifdef __linux__
+#include "tcp_data_stream.h"
+#include <arpa/inet.h>
+#include <csignal>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 #include <gtest/gtest.h>
 
@@ -23,6 +51,25 @@ std::vector<uint8_t> generate_random_bits(size_t count)
     return bits;
 }
 
+size_t count_decoded_packets(const std::vector<uint8_t>& bits)
+{
+    size_t count = 0;
+    size_t offset = 0;
+    while (offset < bits.size())
+    {
+        aprs::router::packet p;
+        size_t read = 0;
+        bool decoded = try_decode_basic_bitstream(bits, offset, p, read);
+        if (read == 0)
+        {
+            break;
+        }
+        count += decoded ? 1 : 0;
+        offset += read;
+    }
+    return count;
+}
+
 TEST(address, to_string)
 {
     address s;
@@ -32,168 +79,3119 @@ TEST(address, to_string)
     s.mark = false;
     EXPECT_TRUE(to_string(s) == "WIDE2-1");
 
-    s.mark = true;
-    EXPECT_TRUE(to_string(s) == "WIDE2-1*");
+    s.mark = true;
+    EXPECT_TRUE(to_string(s) == "WIDE2-1*");
+
+    s.mark = true;
+    s.N = 0;
+    EXPECT_TRUE(to_string(s) == "WIDE2*");
+
+    s.N = 0;
+    s.n = 0;
+    EXPECT_TRUE(to_string(s) == "WIDE*");
+
+    s = address{};
+    s.text = "N0CALL";
+    s.ssid = 10;
+    EXPECT_TRUE(to_string(s) == "N0CALL-10");
+
+    s = address{};
+    s.text = "N0CALL";
+    s.ssid = 10;
+    s.mark = true;
+    EXPECT_TRUE(to_string(s) == "N0CALL-10*");
+
+    s = address{};
+    s.text = "N0CALL-10";
+    s.ssid = 10;
+    EXPECT_TRUE(to_string(s) == "N0CALL-10-10"); // to_string preserves the text even if ssid is specified and results in an invalid address
+}
+
+TEST(dds_afsk_modulator_dft_demodulator, modulate_demodulate_8bits)
+{
+    std::vector<double> audio_buffer;
+
+    std::vector<uint8_t> bitstream = { 0, 0, 1, 1, 0, 1, 0, 0 };
+
+    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 1.0); // Coherent 1200 baud AFSK
+
+    for (uint8_t bit : bitstream)
+    {
+        for (int i = 0; i < modulator.samples_per_bit(); ++i)
+        {
+            audio_buffer.push_back(modulator.modulate(bit));
+        }
+    }
+
+    dft_demodulator demodulator(1200.0, 2200.0, 1200, 48000);
+
+    std::vector<uint8_t> demodulated_bits = demodulator.demodulate(audio_buffer);
+    
+    EXPECT_EQ(bitstream, demodulated_bits);
+}
+
+TEST(dds_afsk_modulator_dft_demodulator, modulate_demodulate_random_100000bits)
+{
+    std::vector<double> audio_buffer;
+
+    std::vector<uint8_t> bitstream = generate_random_bits(100'000);
+
+    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 1.0); // Coherent 1200 baud AFSK
+
+    for (uint8_t bit : bitstream)
+    {
+        for (int i = 0; i < modulator.samples_per_bit(); ++i)
+        {
+            audio_buffer.push_back(modulator.modulate(bit));
+        }
+    }
+
+    dft_demodulator demodulator(1200.0, 2200.0, 1200, 48000);
+
+    std::vector<uint8_t> demodulated_bits = demodulator.demodulate(audio_buffer);
+
+    EXPECT_EQ(bitstream, demodulated_bits);
+}
+
+TEST(dds_afsk_modulator_dft_demodulator, modulate_demodulate_packet)
+{
+    std::vector<double> audio_buffer;
+
+    aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+
+    std::vector<uint8_t> bitstream = encode_basic_bitstream(p, 45, 30);
+
+    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 1.0); // Coherent 1200 baud AFSK
+
+    for (uint8_t bit : bitstream)
+    {
+        for (int i = 0; i < modulator.samples_per_bit(); ++i)
+        {
+            audio_buffer.push_back(modulator.modulate(bit));
+        }
+    }
+
+    dft_demodulator demodulator(1200.0, 2200.0, 1200, 48000);
+
+    std::vector<uint8_t> demodulated_bits = demodulator.demodulate(audio_buffer);
+
+    aprs::router::packet p2;
+
+    size_t read = 0;
+    try_decode_basic_bitstream(demodulated_bits, 0, p2, read);
+
+    EXPECT_TRUE(p == p2);
+}
+
+TEST(bit_clock, fractional_samples_per_bit)
+{
+    {
+        bit_clock clock(1200, 44100); // 36.75 samples per bit
+
+        EXPECT_EQ(clock.next(), 36);
+        EXPECT_EQ(clock.next(), 37);
+        EXPECT_EQ(clock.next(), 37);
+        EXPECT_EQ(clock.next(), 37);
+        EXPECT_EQ(clock.next(), 36);
+
+        clock.reset();
+
+        size_t total = 0;
+        for (int i = 0; i < 1200; i++)
+        {
+            total += clock.next();
+        }
+
+        EXPECT_EQ(total, 44100);
+        EXPECT_EQ(clock.samples(1200), 44100);
+    }
+
+    {
+        bit_clock clock(1200, 48000);
+
+        for (int i = 0; i < 100; i++)
+        {
+            EXPECT_EQ(clock.next(), 40);
+        }
+    }
+}
+
+TEST(modem, modulate_demodulate_packet)
+{
+    {
+        dds_afsk_modulator_adapter modulator(1200.0, 2200.0, 1200, 48000);
+        basic_bitstream_converter_adapter bitstream_converter;
+        wav_audio_stream wav_stream("test.wav", true, 48000);
+
+        aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+
+        modem m;
+        m.baud_rate(1200);
+        m.tx_delay(300);
+        m.tx_tail(45);
+        m.gain(0.3);
+        m.preemphasis(true);
+        m.initialize(wav_stream, modulator, bitstream_converter);
+
+        m.transmit(p);
+
+        wav_stream.close();
+    }
+
+    {
+        std::vector<double> audio_buffer;
+
+        wav_audio_stream wav_stream("test.wav", false, 48'000);
+
+        while (true)
+        {
+            std::vector<double> audio_samples(4096);
+            size_t read = wav_stream.read(audio_samples.data(), audio_samples.size());
+            if (read == 0) break;
+            audio_buffer.insert(audio_buffer.end(), audio_samples.begin(), audio_samples.begin() + read);
+        }
+
+        dft_demodulator demodulator(1200.0, 2200.0, 1200, 48000);
+
+        std::vector<uint8_t> bitstream = demodulator.demodulate(audio_buffer);
+
+        basic_bitstream_converter_adapter bitstream_converter;
+
+        std::vector<aprs::router::packet> packets;
+        size_t read = 0;
+        size_t offset = 0;
+        aprs::router::packet packet;
+        while (offset < bitstream.size())
+        {
+            if (bitstream_converter.try_decode(bitstream, offset, packet, read))
+            {
+                packets.push_back(packet);
+            }
+            if (read == 0) break; // No more data
+            offset += read;
+        }
+        wav_stream.close();
+
+        EXPECT_TRUE(packets.size() == 1);
+        EXPECT_TRUE(to_string(packets[0]) == "N0CALL-10>APZ001,WIDE1-1,WIDE2-2:Hello, APRS!");
+    }
+}
+
+TEST(modem, basic_modem_same_samples)
+{
+    // The type-erased modem and the statically dispatched basic_modem
+    // render the same samples for the same frames
+
+    aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+
+    const int frames = 20;
+
+    {
+        dds_afsk_modulator_fast_adapter modulator(1200.0, 2200.0, 1200, 48000);
+        basic_bitstream_converter_adapter bitstream_converter;
+        wav_audio_stream wav_stream("test_modem_render.wav", true, 48000);
+
+        modem m;
+        m.tx_delay(300);
+        m.gain(0.3);
+        m.preemphasis(true);
+        m.initialize(wav_stream, modulator, bitstream_converter);
+
+        for (int i = 0; i < frames; i++)
+        {
+            m.transmit(p);
+        }
+
+        wav_stream.close();
+    }
+
+    {
+        dds_afsk_modulator_fast<double> modulator(1200.0, 2200.0, 1200, 48000);
+        basic_bitstream_converter bitstream_converter;
+        wav_audio_stream wav_stream("test_basic_modem_render.wav", true, 48000);
+
+        basic_modem<dds_afsk_modulator_fast<double>, basic_bitstream_converter, wav_audio_stream> m;
+        m.tx_delay(300);
+        m.gain(0.3);
+        m.preemphasis(true);
+        m.initialize(wav_stream, modulator, bitstream_converter);
+
+        for (int i = 0; i < frames; i++)
+        {
+            m.transmit(p);
+        }
+
+        wav_stream.close();
+    }
+
+    auto read_all = [](const std::string& path) {
+        wav_audio_stream wav_stream(path, false, 48000);
+        std::vector<double> audio;
+        std::vector<double> audio_samples(4096);
+        while (size_t read = wav_stream.read(audio_samples.data(), audio_samples.size()))
+        {
+            audio.insert(audio.end(), audio_samples.begin(), audio_samples.begin() + read);
+        }
+        return audio;
+    };
+
+    std::vector<double> modem_audio = read_all("test_modem_render.wav");
+    std::vector<double> basic_modem_audio = read_all("test_basic_modem_render.wav");
+
+    EXPECT_FALSE(modem_audio.empty());
+    EXPECT_EQ(modem_audio, basic_modem_audio);
+}
+
+TEST(modem, DISABLED_benchmark_frame_render)
+{
+    // Frame render time, type-erased modem vs statically dispatched basic_modem
+    // Run with --gtest_also_run_disabled_tests, the timings are recorded as
+    // test properties, ex: with --gtest_output=xml
+
+    aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+
+    const int frames = 200;
+
+    auto render = [&](auto& m) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++)
+        {
+            m.transmit(p);
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+    };
+
+    double virtual_ms = 0.0;
+    double static_ms = 0.0;
+
+    {
+        dds_afsk_modulator_fast_adapter modulator(1200.0, 2200.0, 1200, 48000);
+        basic_bitstream_converter_adapter bitstream_converter;
+        wav_audio_stream wav_stream("benchmark.wav", true, 48000);
+
+        modem m;
+        m.tx_delay(300);
+        m.gain(0.3);
+        m.preemphasis(true);
+        m.initialize(wav_stream, modulator, bitstream_converter);
+
+        virtual_ms = render(m);
+
+        wav_stream.close();
+    }
+
+    {
+        dds_afsk_modulator_fast<double> modulator(1200.0, 2200.0, 1200, 48000);
+        basic_bitstream_converter bitstream_converter;
+        wav_audio_stream wav_stream("benchmark.wav", true, 48000);
+
+        basic_modem<dds_afsk_modulator_fast<double>, basic_bitstream_converter, wav_audio_stream> m;
+        m.tx_delay(300);
+        m.gain(0.3);
+        m.preemphasis(true);
+        m.initialize(wav_stream, modulator, bitstream_converter);
+
+        static_ms = render(m);
+
+        wav_stream.close();
+    }
+
+    RecordProperty("modem_frame_render_ms", std::to_string(virtual_ms));
+    RecordProperty("basic_modem_frame_render_ms", std::to_string(static_ms));
+
+    EXPECT_GT(virtual_ms, 0.0);
+    EXPECT_GT(static_ms, 0.0);
+}
+
+TEST(modem, modulate_demodulate_packet_resampled)
+{
+    {
+        // Modulator runs at 44.1 kHz, the audio stream at 48 kHz
+
+        dds_afsk_modulator_adapter modulator(1200.0, 2200.0, 1200, 44100);
+        basic_bitstream_converter_adapter bitstream_converter;
+        wav_audio_stream wav_stream("test_resampled.wav", true, 48000);
+
+        aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+
+        modem m;
+        m.baud_rate(1200);
+        m.tx_delay(300);
+        m.tx_tail(45);
+        m.gain(0.3);
+        m.initialize(wav_stream, modulator, bitstream_converter);
+
+        m.transmit(p);
+
+        wav_stream.close();
+    }
+
+    {
+        std::vector<double> audio_buffer;
+
+        wav_audio_stream wav_stream("test_resampled.wav", false, 48'000);
+
+        while (true)
+        {
+            std::vector<double> audio_samples(4096);
+            size_t read = wav_stream.read(audio_samples.data(), audio_samples.size());
+            if (read == 0) break;
+            audio_buffer.insert(audio_buffer.end(), audio_samples.begin(), audio_samples.begin() + read);
+        }
+
+        dft_demodulator demodulator(1200.0, 2200.0, 1200, 48000);
+
+        std::vector<uint8_t> bitstream = demodulator.demodulate(audio_buffer);
+
+        basic_bitstream_converter_adapter bitstream_converter;
+
+        std::vector<aprs::router::packet> packets;
+        size_t read = 0;
+        size_t offset = 0;
+        aprs::router::packet packet;
+        while (offset < bitstream.size())
+        {
+            if (bitstream_converter.try_decode(bitstream, offset, packet, read))
+            {
+                packets.push_back(packet);
+            }
+            if (read == 0) break; // No more data
+            offset += read;
+        }
+        wav_stream.close();
+
+        EXPECT_TRUE(packets.size() == 1);
+        EXPECT_TRUE(packets.size() == 1 && to_string(packets[0]) == "N0CALL-10>APZ001,WIDE1-1,WIDE2-2:Hello, APRS!");
+    }
+}
+
+TEST(polyphase_resampler, resample_48000_44100)
+{
+    constexpr double two_pi = 2.0 * 3.14159265358979323846;
+
+    std::vector<double> input(48000);
+    for (size_t i = 0; i < input.size(); i++)
+    {
+        input[i] = std::sin(two_pi * 1000.0 * i / 48000.0);
+    }
+
+    polyphase_resampler resampler(48000, 44100);
+
+    // Feed in uneven chunks, the resampler state carries across calls
+
+    std::vector<double> output;
+    size_t pos = 0;
+    size_t chunk = 97;
+    while (pos < input.size())
+    {
+        size_t count = (std::min)(chunk, input.size() - pos);
+        resampler.process(&input[pos], count, output);
+        pos += count;
+        chunk = (chunk * 7) % 1000 + 1;
+    }
+
+    EXPECT_EQ(output.size(), 44100);
+
+    // Compare against the ideal 1 kHz tone at 44.1 kHz, skipping the filter delay
+
+    double delay = (147.0 * 32.0 - 1.0) / 2.0 / (147.0 * 48000.0); // (N - 1) / 2 samples at the upsampled rate
+    double max_error = 0.0;
+    for (size_t i = 100; i < output.size() - 100; i++)
+    {
+        double expected = std::sin(two_pi * 1000.0 * (i / 44100.0 - delay));
+        max_error = (std::max)(max_error, std::abs(output[i] - expected));
+    }
+
+    EXPECT_LT(max_error, 0.01);
+}
+
+TEST(spsc_audio_ring, overrun_underrun)
+{
+    spsc_audio_ring ring(1000);
+
+    EXPECT_EQ(ring.capacity(), 1024);
+
+    std::vector<double> input(1500);
+    for (size_t i = 0; i < input.size(); i++)
+    {
+        input[i] = static_cast<double>(i);
+    }
+
+    // Full ring drops the excess
+
+    EXPECT_EQ(ring.write(input.data(), input.size()), 1024);
+    EXPECT_EQ(ring.overruns(), 476);
+
+    // Reads wrap around the end of the buffer
+
+    std::vector<double> output(2000);
+    EXPECT_EQ(ring.read(output.data(), 1000), 1000);
+    EXPECT_EQ(ring.write(input.data() + 1024, 100), 100);
+    EXPECT_EQ(ring.read(output.data() + 1000, 1000), 124);
+    EXPECT_EQ(ring.underruns(), 876);
+
+    for (size_t i = 0; i < 1124; i++)
+    {
+        EXPECT_EQ(output[i], static_cast<double>(i));
+    }
+}
+
+TEST(spsc_audio_ring, producer_consumer_threads)
+{
+    spsc_audio_ring ring(256);
+
+    constexpr size_t total = 200'000;
+
+    std::thread producer([&] {
+        std::vector<double> block(97);
+        size_t next = 0;
+        while (next < total)
+        {
+            size_t n = (std::min)(block.size(), total - next);
+            for (size_t i = 0; i < n; i++)
+            {
+                block[i] = static_cast<double>(next + i);
+            }
+            size_t written = 0;
+            while (written < n)
+            {
+                size_t space = (std::min)(n - written, ring.available_write());
+                if (space == 0)
+                {
+                    std::this_thread::yield();
+                }
+                written += ring.write(block.data() + written, space);
+            }
+            next += n;
+        }
+    });
+
+    std::vector<double> received;
+    std::vector<double> block(64);
+    while (received.size() < total)
+    {
+        size_t n = ring.read(block.data(), (std::min)(block.size(), ring.available_read()));
+        if (n == 0)
+        {
+            std::this_thread::yield();
+        }
+        received.insert(received.end(), block.begin(), block.begin() + n);
+    }
+
+    producer.join();
+
+    EXPECT_EQ(ring.overruns(), 0);
+    for (size_t i = 0; i < total; i++)
+    {
+        ASSERT_EQ(received[i], static_cast<double>(i));
+    }
+}
+
+TEST(spsc_audio_ring, write_audio_waits_for_consumer)
+{
+    spsc_audio_ring ring(1024);
+
+    std::vector<double> fill(1024, 0.0);
+    EXPECT_EQ(ring.write(fill.data(), fill.size()), 1024);
+
+    // Full ring, nothing reads, the wait times out
+
+    EXPECT_FALSE(ring.wait_write(100, std::chrono::milliseconds(10)));
+
+    // The consumer frees space, the wait returns long before its timeout
+
+    std::thread consumer([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        ring.read(fill.data(), 200);
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(ring.wait_write(100, std::chrono::seconds(10)));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+
+    consumer.join();
+
+    ring.read(fill.data(), ring.available_read());
+
+    // write_audio blocks on the ring event, every sample arrives in order
+
+    constexpr size_t total = 20'000;
+
+    std::vector<double> samples(total);
+    for (size_t i = 0; i < total; i++)
+    {
+        samples[i] = static_cast<double>(i);
+    }
+
+    std::thread producer([&] {
+        EXPECT_EQ(write_audio(ring, samples.data(), samples.size(), 480), total);
+    });
+
+    std::vector<double> received;
+    std::vector<double> block(256);
+    while (received.size() < total)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        size_t n = ring.read(block.data(), block.size());
+        received.insert(received.end(), block.begin(), block.begin() + n);
+    }
+
+    producer.join();
+
+    EXPECT_EQ(received, samples);
+
+    // The ring was full most of the time, but nothing was dropped
+
+    EXPECT_EQ(ring.overruns(), 0);
+
+    // A plain write still counts what it drops
+
+    std::vector<double> overfill(ring.capacity() + 100, 0.0);
+    EXPECT_EQ(ring.write(overfill.data(), overfill.size()), ring.capacity());
+    EXPECT_EQ(ring.overruns(), 100);
+}
+
+TEST(audio_ring_mixer, mix_producers)
+{
+    audio_ring_mixer mixer(1024);
+
+    spsc_audio_ring* a = mixer.add_producer();
+    spsc_audio_ring* b = mixer.add_producer();
+    mixer.add_producer(); // Idle producer
+
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+    EXPECT_EQ(mixer.producers(), 3);
+
+    std::vector<double> ones(100, 1.0);
+    std::vector<double> halves(50, 0.5);
+
+    a->write(ones.data(), ones.size());
+    b->write(halves.data(), halves.size());
+
+    std::vector<double> output(100);
+    mixer.mix(output.data(), output.size());
+
+    for (size_t i = 0; i < output.size(); i++)
+    {
+        EXPECT_DOUBLE_EQ(output[i], i < 50 ? 1.5 : 1.0);
+    }
+
+    // Producer b started and ran dry, the idle producer doesn't count
+
+    EXPECT_EQ(mixer.underruns(), 50);
+    EXPECT_EQ(mixer.overruns(), 0);
+}
+
+TEST(broadcast_audio_ring, readers)
+{
+    // 60 s overrun buffer from settings.json, scaled down to 10 ms,
+    // rounded up to a power of two
+
+    broadcast_audio_ring ring(broadcast_ring_capacity(48000, 10));
+
+    EXPECT_EQ(ring.capacity(), 512);
+
+    broadcast_audio_reader fast(ring);
+    broadcast_audio_reader slow(ring);
+
+    std::vector<double> input(400);
+    std::vector<double> fast_output;
+    std::vector<double> slow_output;
+
+    double value = 0.0;
+
+    for (int block = 0; block < 10; block++)
+    {
+        for (double& x : input)
+        {
+            x = value++;
+        }
+
+        ring.write(input.data(), input.size());
+
+        // Fast reader consumes everything, in place, in two pieces
+
+        while (fast.available() > 0)
+        {
+            size_t count = 300;
+            const double* data = fast.peek(count);
+            fast_output.insert(fast_output.end(), data, data + count);
+            EXPECT_TRUE(fast.consume(count));
+        }
+
+        // Slow reader only keeps up for the first block
+
+        if (block == 0)
+        {
+            size_t count = 400;
+            const double* data = slow.peek(count);
+            slow_output.insert(slow_output.end(), data, data + count);
+            slow.consume(count);
+        }
+    }
+
+    ASSERT_EQ(fast_output.size(), 4000);
+    for (size_t i = 0; i < fast_output.size(); i++)
+    {
+        EXPECT_EQ(fast_output[i], static_cast<double>(i));
+    }
+
+    // The slow reader was lapped, it is dropped instead of the buffer growing
+
+    size_t count = 100;
+    EXPECT_EQ(slow.peek(count), nullptr);
+    EXPECT_EQ(count, 0);
+    EXPECT_TRUE(slow.dropped());
+    EXPECT_FALSE(fast.dropped());
+    EXPECT_EQ(slow_output.size(), 400);
+    EXPECT_EQ(ring.dropped_readers(), 1);
+}
+
+TEST(fir_decimator, passband_stopband)
+{
+    constexpr double two_pi = 2.0 * 3.14159265358979323846;
+
+    auto amplitude = [&](double frequency) {
+        fir_decimator decimator(4);
+        std::vector<double> input(48000);
+        for (size_t i = 0; i < input.size(); i++)
+        {
+            input[i] = std::sin(two_pi * frequency * i / 48000.0);
+        }
+        std::vector<double> output;
+        decimator.process(input.data(), input.size(), output);
+        EXPECT_EQ(output.size(), 12000);
+        double power = 0.0;
+        for (size_t i = 1000; i < output.size(); i++)
+        {
+            power += output[i] * output[i];
+        }
+        return std::sqrt(2.0 * power / (output.size() - 1000));
+    };
+
+    // AFSK tones pass, tones that would alias onto them are rejected
+
+    EXPECT_NEAR(amplitude(1200.0), 1.0, 0.01);
+    EXPECT_NEAR(amplitude(2200.0), 1.0, 0.01);
+    EXPECT_LT(amplitude(10000.0), 0.001);
+    EXPECT_LT(amplitude(13200.0), 0.001);
+}
+
+TEST(rx_front_end, shared_decimated_stream)
+{
+    aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+
+    std::vector<uint8_t> bitstream = encode_basic_bitstream(p, 45, 30);
+
+    std::vector<double> audio_buffer;
+
+    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 1.0);
+
+    for (uint8_t bit : bitstream)
+    {
+        for (int i = 0; i < modulator.samples_per_bit(); ++i)
+        {
+            audio_buffer.push_back(modulator.modulate(bit));
+        }
+    }
+
+    // Decimated once, two demodulators read the 12 kHz stream
+
+    rx_front_end front_end(48000, 4);
+
+    EXPECT_EQ(front_end.sample_rate(), 12000);
+
+    broadcast_audio_reader reader_a(front_end.ring());
+    broadcast_audio_reader reader_b(front_end.ring());
+
+    // The PLL finds the bit timing, the fixed grid demodulator is told the filter delay
+
+    pll_demodulator demodulator_a(1200.0, 2200.0, 1200, 12000);
+    quadrature_demodulator demodulator_b(1200.0, 2200.0, 1200, 12000, 0.0, front_end.delay() * 1200.0 / 12000.0);
+
+    std::vector<uint8_t> bits_a;
+    std::vector<uint8_t> bits_b;
+
+    for (size_t pos = 0; pos < audio_buffer.size(); pos += 480)
+    {
+        front_end.write(&audio_buffer[pos], (std::min)(size_t(480), audio_buffer.size() - pos));
+
+        size_t count_a = reader_a.available();
+        const double* data_a = reader_a.peek(count_a);
+        demodulator_a.demodulate(data_a, count_a, bits_a);
+        reader_a.consume(count_a);
+
+        size_t count_b = reader_b.available();
+        const double* data_b = reader_b.peek(count_b);
+        demodulator_b.demodulate(data_b, count_b, bits_b);
+        reader_b.consume(count_b);
+    }
+
+    EXPECT_EQ(count_decoded_packets(bits_a), 1);
+    EXPECT_EQ(count_decoded_packets(bits_b), 1);
+}
+
+TEST(energy_gate, idle_during_silence)
+{
+    aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+
+    std::vector<uint8_t> bitstream = encode_basic_bitstream(p, 45, 30);
+
+    // Noise, packet, noise, packet, noise
+
+    std::mt19937 rng(4);
+    std::normal_distribution<double> dist(0.0, 0.01);
+
+    std::vector<double> audio_buffer;
+
+    auto add_noise = [&](size_t count) {
+        for (size_t i = 0; i < count; i++)
+        {
+            audio_buffer.push_back(dist(rng));
+        }
+    };
+
+    auto add_packet = [&]() {
+        dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 1.0);
+        for (uint8_t bit : bitstream)
+        {
+            for (int i = 0; i < modulator.samples_per_bit(); ++i)
+            {
+                audio_buffer.push_back(0.5 * modulator.modulate(bit) + dist(rng));
+            }
+        }
+    };
+
+    add_noise(96000);
+    add_packet();
+    add_noise(96000);
+    add_packet();
+    add_noise(48000);
+
+    // Ungated reference
+
+    size_t expected = count_decoded_packets(pll_demodulator(1200.0, 2200.0, 1200, 48000).demodulate(audio_buffer));
+
+    EXPECT_EQ(expected, 2);
+
+    // Gated, the demodulator only runs around the packets
+
+    broadcast_audio_ring ring(broadcast_ring_capacity(48000, 1000));
+    energy_gate gate(ring, 48000);
+    pll_demodulator demodulator(1200.0, 2200.0, 1200, 48000);
+
+    std::vector<uint8_t> bits;
+    size_t processed = 0;
+
+    for (size_t pos = 0; pos < audio_buffer.size(); pos += 480)
+    {
+        ring.write(&audio_buffer[pos], (std::min)(size_t(480), audio_buffer.size() - pos));
+
+        processed += gate.process([&](const double* samples, size_t count) {
+            demodulator.demodulate(samples, count, bits);
+        });
+    }
+
+    EXPECT_EQ(count_decoded_packets(bits), expected);
+    EXPECT_LT(processed, audio_buffer.size() / 2);
+    EXPECT_GT(gate.skipped(), audio_buffer.size() / 2);
+}
+
+TEST(energy_gate, resync_after_stall)
+{
+    aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+
+    std::vector<uint8_t> bitstream = encode_basic_bitstream(p, 45, 30);
+
+    std::mt19937 rng(4);
+    std::normal_distribution<double> dist(0.0, 0.01);
+
+    std::vector<double> noise(48000);
+    for (double& x : noise)
+    {
+        x = dist(rng);
+    }
+
+    std::vector<double> packet_audio;
+    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 1.0);
+    for (uint8_t bit : bitstream)
+    {
+        for (int i = 0; i < modulator.samples_per_bit(); ++i)
+        {
+            packet_audio.push_back(0.5 * modulator.modulate(bit) + dist(rng));
+        }
+    }
+
+    broadcast_audio_ring ring(broadcast_ring_capacity(48000, 1000));
+    energy_gate gate(ring, 48000);
+    pll_demodulator demodulator(1200.0, 2200.0, 1200, 48000);
+
+    std::vector<uint8_t> bits;
+    uint64_t written = 0;
+
+    auto feed = [&](const std::vector<double>& audio, bool gated) {
+        for (size_t pos = 0; pos < audio.size(); pos += 480)
+        {
+            size_t count = (std::min)(size_t(480), audio.size() - pos);
+            ring.write(&audio[pos], count);
+            written += count;
+            if (gated)
+            {
+                gate.process([&](const double* samples, size_t count) {
+                    demodulator.demodulate(samples, count, bits);
+                });
+            }
+        }
+    };
+
+    feed(noise, true);
+
+    // The gate is not run for three ring capacities, it has been lapped
+
+    for (int i = 0; i < 3; i++)
+    {
+        feed(noise, false);
+        feed(packet_audio, false);
+    }
+
+    EXPECT_EQ(gate.resyncs(), 0);
+
+    // It restarts at the write position instead of staying deaf
+
+    feed(noise, true);
+    feed(packet_audio, true);
+    feed(noise, true);
+
+    EXPECT_EQ(gate.resyncs(), 1);
+    EXPECT_EQ(count_decoded_packets(bits), 1);
+    EXPECT_LT(gate.skipped(), written);
+}
+
+TEST(first_order_iir, preemphasis_matches_scalar)
+{
+    std::mt19937 rng(1);
+    std::normal_distribution<double> dist;
+
+    // Short buffers run serially, long ones through the lanes, odd lengths leave a tail
+
+    for (size_t size : { 1, 7, 511, 512, 4096, 10007 })
+    {
+        std::vector<double> input(size);
+        for (double& x : input)
+        {
+            x = dist(rng);
+        }
+
+        std::vector<double> expected = input;
+        apply_preemphasis(expected.begin(), expected.end(), 48000);
+
+        // Whole buffer in one call
+
+        std::vector<double> output = input;
+        first_order_iir filter = make_preemphasis_filter(48000);
+        filter.reset(output[0], output[0]);
+        filter.process(output.data() + 1, output.size() - 1);
+
+        for (size_t i = 0; i < size; i++)
+        {
+            EXPECT_NEAR(output[i], expected[i], 1e-12);
+        }
+
+        // Uneven chunks, the state carries across calls
+
+        output = input;
+        filter.reset(output[0], output[0]);
+        size_t pos = 1;
+        size_t chunk = 3;
+        while (pos < size)
+        {
+            size_t count = (std::min)(chunk, size - pos);
+            filter.process(&output[pos], count);
+            pos += count;
+            chunk = (chunk * 13) % 3000 + 1;
+        }
+
+        for (size_t i = 0; i < size; i++)
+        {
+            EXPECT_NEAR(output[i], expected[i], 1e-12);
+        }
+    }
+}
+
+TEST(first_order_iir, deemphasis_matches_scalar)
+{
+    std::mt19937 rng(2);
+    std::normal_distribution<double> dist;
+
+    std::vector<double> input(20000);
+    for (double& x : input)
+    {
+        x = dist(rng);
+    }
+
+    double alpha = std::exp(-1.0 / (48000 * 75e-6));
+
+    std::vector<double> expected(input.size());
+    double y_prev = 0.0;
+    for (size_t i = 0; i < input.size(); i++)
+    {
+        y_prev = (1.0 - alpha) * input[i] + alpha * y_prev;
+        expected[i] = y_prev;
+    }
+
+    std::vector<double> output = input;
+    first_order_iir filter = make_deemphasis_filter(48000);
+    filter.process(output.data(), output.size());
+
+    for (size_t i = 0; i < output.size(); i++)
+    {
+        EXPECT_NEAR(output[i], expected[i], 1e-12);
+    }
+}
+
+TEST(first_order_iir, DISABLED_benchmark_block_vs_scalar)
+{
+    // Run with --gtest_also_run_disabled_tests, the timings are recorded as
+    // test properties, ex: with --gtest_output=xml
+
+    std::mt19937 rng(3);
+    std::normal_distribution<double> dist;
+
+    std::vector<double> input(1'000'000);
+    for (double& x : input)
+    {
+        x = dist(rng);
+    }
+
+    // Best of a few runs, ns per sample
+    // Chunks shorter than the lanes minimum run the serial loop
+
+    auto measure = [&](size_t chunk) {
+        double best = std::numeric_limits<double>::max();
+        for (int run = 0; run < 5; run++)
+        {
+            std::vector<double> output = input;
+            first_order_iir filter = make_preemphasis_filter(48000);
+            auto start = std::chrono::steady_clock::now();
+            for (size_t pos = 0; pos < output.size(); pos += chunk)
+            {
+                filter.process(&output[pos], (std::min)(chunk, output.size() - pos));
+            }
+            best = (std::min)(best, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / output.size());
+        }
+        return best;
+    };
+
+    double block_ns = measure(input.size());
+    double scalar_ns = measure(256);
+
+    RecordProperty("block_ns_per_sample", std::to_string(block_ns));
+    RecordProperty("scalar_ns_per_sample", std::to_string(scalar_ns));
+    RecordProperty("speedup", std::to_string(scalar_ns / block_ns));
+
+    EXPECT_LT(block_ns, scalar_ns);
+}
+
+TEST(g3ruh_modulator_g3ruh_demodulator, modulate_demodulate_packet)
+{
+    for (int sample_rate : { 48000, 44100 })
+    {
+        aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+
+        // One closing flag, the filter tail is flushed
+
+        std::vector<uint8_t> bitstream = encode_basic_bitstream(p, 45, 1);
+
+        g3ruh_modulator modulator(9600, sample_rate);
+
+        std::vector<double> audio_buffer;
+
+        modulator.modulate(bitstream.begin(), bitstream.end(), std::back_inserter(audio_buffer));
+        modulator.flush(std::back_inserter(audio_buffer));
+
+        EXPECT_EQ(audio_buffer.size(), bit_clock(9600, sample_rate).samples(bitstream.size() + modulator.delay()));
+
+        g3ruh_demodulator demodulator(9600, sample_rate, modulator.delay());
+
+        // Feed the demodulator in small blocks
+
+        std::vector<uint8_t> demodulated_bits;
+        for (size_t pos = 0; pos < audio_buffer.size(); pos += 100)
+        {
+            demodulator.demodulate(&audio_buffer[pos], (std::min)(size_t(100), audio_buffer.size() - pos), demodulated_bits);
+        }
+
+        aprs::router::packet p2;
+
+        size_t read = 0;
+        EXPECT_TRUE(try_decode_basic_bitstream(demodulated_bits, 0, p2, read));
+        EXPECT_TRUE(p == p2);
+    }
+}
+
+TEST(dds_afsk_modulator_sliding_dft_demodulator, modulate_demodulate_random_100000bits)
+{
+    std::vector<double> audio_buffer;
+
+    std::vector<uint8_t> bitstream = generate_random_bits(100'000);
+
+    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 1.0); // Coherent 1200 baud AFSK
+
+    for (uint8_t bit : bitstream)
+    {
+        for (int i = 0; i < modulator.samples_per_bit(); ++i)
+        {
+            audio_buffer.push_back(modulator.modulate(bit));
+        }
+    }
+
+    // Streaming, fed in uneven blocks
+
+    sliding_dft_demodulator demodulator(1200.0, 2200.0, 1200, 48000);
+
+    std::vector<uint8_t> demodulated_bits;
+    size_t pos = 0;
+    size_t chunk = 17;
+    while (pos < audio_buffer.size())
+    {
+        size_t count = (std::min)(chunk, audio_buffer.size() - pos);
+        demodulator.demodulate(&audio_buffer[pos], count, demodulated_bits);
+        pos += count;
+        chunk = (chunk * 31) % 2000 + 1;
+    }
+
+    // Same bits as the batch demodulator
+
+    dft_demodulator batch_demodulator(1200.0, 2200.0, 1200, 48000);
+
+    EXPECT_EQ(demodulated_bits, batch_demodulator.demodulate(audio_buffer));
+    EXPECT_EQ(demodulated_bits, bitstream);
+}
+
+TEST(dds_afsk_modulator_sliding_dft_demodulator, modulate_demodulate_packet)
+{
+    aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+
+    std::vector<uint8_t> bitstream = encode_basic_bitstream(p, 45, 30);
+
+    for (int sample_rate : { 48000, 44100 })
+    {
+        std::vector<double> audio_buffer;
+
+        dds_afsk_modulator modulator(1200.0, 2200.0, 1200, sample_rate, 1.0);
+
+        bit_clock clock(1200, sample_rate);
+
+        for (uint8_t bit : bitstream)
+        {
+            int samples = clock.next();
+            for (int i = 0; i < samples; ++i)
+            {
+                audio_buffer.push_back(modulator.modulate(bit));
+            }
+        }
+
+        sliding_dft_demodulator demodulator(1200.0, 2200.0, 1200, sample_rate);
+
+        std::vector<uint8_t> demodulated_bits;
+        for (size_t pos = 0; pos < audio_buffer.size(); pos += 480)
+        {
+            demodulator.demodulate(&audio_buffer[pos], (std::min)(size_t(480), audio_buffer.size() - pos), demodulated_bits);
+        }
+
+        aprs::router::packet p2;
+
+        size_t read = 0;
+        EXPECT_TRUE(try_decode_basic_bitstream(demodulated_bits, 0, p2, read));
+        EXPECT_TRUE(p == p2);
+    }
+}
+
+TEST(dds_afsk_modulator_quadrature_demodulator, modulate_demodulate_random_100000bits)
+{
+    std::vector<double> audio_buffer;
+
+    std::vector<uint8_t> bitstream = generate_random_bits(100'000);
+
+    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 1.0); // Coherent 1200 baud AFSK
+
+    for (uint8_t bit : bitstream)
+    {
+        for (int i = 0; i < modulator.samples_per_bit(); ++i)
+        {
+            audio_buffer.push_back(modulator.modulate(bit));
+        }
+    }
+
+    quadrature_demodulator demodulator(1200.0, 2200.0, 1200, 48000);
+
+    // The window is centered on the bit, the last decision needs a quarter
+    // bit past the end of the bit, pad with one bit of silence
+
+    std::vector<double> padded_buffer = audio_buffer;
+    padded_buffer.resize(audio_buffer.size() + modulator.samples_per_bit(), 0.0);
+
+    std::vector<uint8_t> demodulated_bits;
+    size_t pos = 0;
+    size_t chunk = 17;
+    while (pos < padded_buffer.size())
+    {
+        size_t count = (std::min)(chunk, padded_buffer.size() - pos);
+        demodulator.demodulate(&padded_buffer[pos], count, demodulated_bits);
+        pos += count;
+        chunk = (chunk * 31) % 2000 + 1;
+    }
+
+    EXPECT_EQ(demodulated_bits, bitstream);
+    EXPECT_EQ(demodulated_bits, sliding_dft_demodulator(1200.0, 2200.0, 1200, 48000).demodulate(audio_buffer));
+}
+
+TEST(sliding_dft_demodulator, timing_offset_clamped)
+{
+    std::vector<uint8_t> bitstream = generate_random_bits(1000);
+
+    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 1.0);
+
+    std::vector<double> audio_buffer;
+    for (uint8_t bit : bitstream)
+    {
+        for (int i = 0; i < modulator.samples_per_bit(); ++i)
+        {
+            audio_buffer.push_back(modulator.modulate(bit));
+        }
+    }
+
+    // A bit or more early would never match a decision sample, the offset is
+    // clamped, every bit is still decided
+
+    for (double timing_offset : { -0.25, -1.0, -1.5, -10.0 })
+    {
+        EXPECT_EQ(sliding_dft_demodulator(1200.0, 2200.0, 1200, 48000, 0.0, timing_offset).demodulate(audio_buffer).size(), bitstream.size());
+        EXPECT_EQ(quadrature_demodulator(1200.0, 2200.0, 1200, 48000, 0.0, timing_offset).demodulate(audio_buffer).size(), bitstream.size());
+    }
+}
+
+TEST(dds_afsk_modulator_pll_demodulator, clock_offset_and_drift)
+{
+    aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+
+    std::vector<uint8_t> bitstream = encode_basic_bitstream(p, 45, 30);
+
+    // Transmitter clock 0.25% fast, and the capture starts mid-bit
+
+    std::vector<double> audio_buffer(17, 0.0);
+
+    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 1.0);
+
+    bit_clock clock(1203, 48000);
+
+    for (uint8_t bit : bitstream)
+    {
+        int samples = clock.next();
+        for (int i = 0; i < samples; ++i)
+        {
+            audio_buffer.push_back(modulator.modulate(bit));
+        }
+    }
+
+    // Fixed bit grid loses the frame
+
+    std::vector<uint8_t> grid_bits = sliding_dft_demodulator(1200.0, 2200.0, 1200, 48000).demodulate(audio_buffer);
+    EXPECT_EQ(count_decoded_packets(grid_bits), 0);
+
+    // Recovered bit clock follows the transmitter
+
+    pll_demodulator demodulator(1200.0, 2200.0, 1200, 48000);
+
+    std::vector<uint8_t> demodulated_bits;
+    for (size_t pos = 0; pos < audio_buffer.size(); pos += 100)
+    {
+        demodulator.demodulate(&audio_buffer[pos], (std::min)(size_t(100), audio_buffer.size() - pos), demodulated_bits);
+    }
+
+    EXPECT_EQ(count_decoded_packets(demodulated_bits), 1);
+    EXPECT_NEAR(demodulator.samples_per_bit(), 48000.0 / 1203.0, 0.05);
+}
+
+TEST(dds_afsk_modulator_fast_channelized_demodulator, hf_frequency_offset)
+{
+    aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+
+    std::vector<uint8_t> bitstream = encode_basic_bitstream(p, 45, 30);
+
+    // 300 baud HF packet, 1600/1800 Hz tones, the receiver is mistuned by 60 Hz
+
+    std::vector<double> audio_buffer(1234, 0.0);
+
+    for (int i = 0; i < 3; i++)
+    {
+        dds_afsk_modulator_fast<double> modulator(1600.0 - 60.0, 1800.0 - 60.0, 300, 48000);
+
+        for (uint8_t bit : bitstream)
+        {
+            for (int j = 0; j < modulator.samples_per_bit(); j++)
+            {
+                audio_buffer.push_back(0.5 * modulator.modulate(bit));
+            }
+        }
+
+        audio_buffer.insert(audio_buffer.end(), 4800, 0.0);
+    }
+
+    // A demodulator on the nominal tones loses the frames
+
+    EXPECT_EQ(count_decoded_packets(sliding_dft_demodulator(1600.0, 1800.0, 300, 48000).demodulate(audio_buffer)), 0);
+
+    // Channels from -100 Hz to 100 Hz, 25 Hz apart, the nearest channels decode every frame
+
+    channelized_demodulator demodulator(1600.0, 1800.0, 300, 48000, 100.0, 25.0);
+
+    ASSERT_EQ(demodulator.channels(), 9);
+    EXPECT_DOUBLE_EQ(demodulator.offset(0), -100.0);
+    EXPECT_DOUBLE_EQ(demodulator.offset(8), 100.0);
+
+    std::vector<std::vector<uint8_t>> bits;
+    for (size_t pos = 0; pos < audio_buffer.size(); pos += 1000)
+    {
+        demodulator.demodulate(&audio_buffer[pos], (std::min)(size_t(1000), audio_buffer.size() - pos), bits);
+    }
+
+    ASSERT_EQ(bits.size(), 9);
+    EXPECT_EQ(count_decoded_packets(bits[1]), 3); // -75 Hz
+    EXPECT_EQ(count_decoded_packets(bits[2]), 3); // -50 Hz
+    EXPECT_EQ(count_decoded_packets(bits[4]), 0); // 0 Hz
+    EXPECT_EQ(count_decoded_packets(bits[8]), 0); // 100 Hz
+}
+
+TEST(input_iq_stream, int16_float32)
+{
+    std::vector<float> samples = { 0.5f, -0.25f, 0.125f, 0.0f, -1.0f, 0.75f };
+
+    {
+        std::ofstream int16_file("test_iq_int16.iq", std::ios::binary);
+        for (float s : samples)
+        {
+            int16_t value = static_cast<int16_t>(s * 32768.0f > 32767.0f ? 32767 : s * 32768.0f);
+            int16_file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        }
+        std::ofstream float32_file("test_iq_float32.iq", std::ios::binary);
+        float32_file.write(reinterpret_cast<const char*>(samples.data()), samples.size() * sizeof(float));
+        float32_file.put(0); // Partial sample, ignored
+    }
+
+    for (iq_format format : { iq_format::int16, iq_format::float32 })
+    {
+        input_iq_stream input(format == iq_format::int16 ? "test_iq_int16.iq" : "test_iq_float32.iq", format, 240000);
+
+        ASSERT_TRUE(input.is_open());
+        EXPECT_EQ(input.size(), 3);
+
+        double re[4];
+        double im[4];
+
+        EXPECT_EQ(input.read(re, im, 2), 2);
+        EXPECT_DOUBLE_EQ(re[0], 0.5);
+        EXPECT_DOUBLE_EQ(im[0], -0.25);
+        EXPECT_DOUBLE_EQ(re[1], 0.125);
+        EXPECT_DOUBLE_EQ(im[1], 0.0);
+        EXPECT_FALSE(input.eof());
+
+        EXPECT_EQ(input.read(re, im, 4), 1);
+        EXPECT_DOUBLE_EQ(re[0], -1.0);
+        EXPECT_TRUE(input.eof());
+
+        // Positional reads leave the stream position alone
+
+        EXPECT_EQ(input.read(1, re, im, 4), 2);
+        EXPECT_DOUBLE_EQ(re[0], 0.125);
+        EXPECT_EQ(input.position(), 3);
+
+        EXPECT_TRUE(input.seek(0));
+        EXPECT_EQ(input.read(re, im, 1), 1);
+        EXPECT_DOUBLE_EQ(re[0], 0.5);
+    }
+
+    EXPECT_FALSE(input_iq_stream("does_not_exist.iq", iq_format::int16, 240000).is_open());
+}
+
+TEST(iq_channel_stream, decode_channels_in_parallel)
+{
+    // Two 1200 baud APRS channels, 50 kHz below and 60 kHz above the
+    // center of a 240 kHz IQ recording, 3 kHz deviation, some noise
+
+    const int iq_sample_rate = 240000;
+    const double offsets[2] = { -50000.0, 60000.0 };
+    const std::string messages[2] = { "Channel A", "Channel B" };
+
+    std::vector<double> iq_re(iq_sample_rate / 10, 0.0);
+    std::vector<double> iq_im(iq_sample_rate / 10, 0.0);
+
+    {
+        std::vector<std::vector<double>> audio(2);
+
+        for (int c = 0; c < 2; c++)
+        {
+            aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, messages[c] };
+            std::vector<uint8_t> bitstream = encode_basic_bitstream(p, 45, 30);
+
+            dds_afsk_modulator modulator(1200.0, 2200.0, 1200, iq_sample_rate, 1.0);
+            bit_clock clock(1200, iq_sample_rate);
+
+            audio[c].assign(iq_sample_rate / 10 + c * 1234, 0.0);
+            for (int i = 0; i < 3; i++)
+            {
+                for (uint8_t bit : bitstream)
+                {
+                    int samples = clock.next();
+                    for (int j = 0; j < samples; j++)
+                    {
+                        audio[c].push_back(modulator.modulate(bit));
+                    }
+                }
+                audio[c].insert(audio[c].end(), iq_sample_rate / 20, 0.0);
+            }
+        }
+
+        size_t length = (std::max)(audio[0].size(), audio[1].size());
+        audio[0].resize(length, 0.0);
+        audio[1].resize(length, 0.0);
+
+        std::mt19937 rng(11);
+        std::normal_distribution<double> noise(0.0, 0.02);
+
+        const double two_pi = 2.0 * 3.14159265358979323846;
+        double phase[2] = { 0.0, 0.0 };
+
+        for (size_t i = 0; i < length; i++)
+        {
+            double re = noise(rng);
+            double im = noise(rng);
+            for (int c = 0; c < 2; c++)
+            {
+                phase[c] = std::fmod(phase[c] + two_pi * (offsets[c] + 3000.0 * audio[c][i]) / iq_sample_rate, two_pi);
+                re += 0.4 * std::cos(phase[c]);
+                im += 0.4 * std::sin(phase[c]);
+            }
+            iq_re.push_back(re);
+            iq_im.push_back(im);
+        }
+    }
+
+    {
+        std::ofstream file("test_iq_channels.iq", std::ios::binary);
+        for (size_t i = 0; i < iq_re.size(); i++)
+        {
+            int16_t sample[2] = { static_cast<int16_t>(std::lround(iq_re[i] * 32767.0)), static_cast<int16_t>(std::lround(iq_im[i] * 32767.0)) };
+            file.write(reinterpret_cast<const char*>(sample), sizeof(sample));
+        }
+    }
+
+    input_iq_stream input("test_iq_channels.iq", iq_format::int16, iq_sample_rate);
+    ASSERT_TRUE(input.is_open());
+
+    // One thread per channel, each with its own channel stream over the shared mapping
+
+    std::vector<std::string> decoded[2];
+
+    std::vector<std::thread> threads;
+    for (int c = 0; c < 2; c++)
+    {
+        threads.emplace_back([&, c]() {
+            iq_channel_stream stream(input, offsets[c], 48000);
+            pll_demodulator demodulator(1200.0, 2200.0, 1200, stream.sample_rate());
+
+            std::vector<double> audio(4096);
+            std::vector<uint8_t> bits;
+            while (size_t n = stream.read(audio.data(), audio.size()))
+            {
+                demodulator.demodulate(audio.data(), n, bits);
+            }
+            EXPECT_TRUE(stream.eof());
+
+            size_t offset = 0;
+            while (offset < bits.size())
+            {
+                aprs::router::packet p;
+                size_t read = 0;
+                bool ok = try_decode_basic_bitstream(bits, offset, p, read);
+                if (read == 0)
+                {
+                    break;
+                }
+                if (ok)
+                {
+                    decoded[c].push_back(p.data);
+                }
+                offset += read;
+            }
+        });
+    }
+
+    for (std::thread& t : threads)
+    {
+        t.join();
+    }
+
+    EXPECT_EQ(decoded[0], std::vector<std::string>(3, messages[0]));
+    EXPECT_EQ(decoded[1], std::vector<std::string>(3, messages[1]));
+}
+
+TEST(iq_channel, rejects_adjacent_channel)
+{
+    // A weak 1200 baud APRS channel at the IQ center, and a 20 dB stronger
+    // channel 20 kHz above it sending random bits, 3 kHz deviation
+
+    const int iq_sample_rate = 240000;
+    const double two_pi = 2.0 * 3.14159265358979323846;
+
+    aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+    std::vector<uint8_t> bitstream = encode_basic_bitstream(p, 45, 30);
+
+    std::vector<double> audio(iq_sample_rate / 20, 0.0);
+
+    {
+        dds_afsk_modulator modulator(1200.0, 2200.0, 1200, iq_sample_rate, 1.0);
+        bit_clock clock(1200, iq_sample_rate);
+
+        for (int i = 0; i < 3; i++)
+        {
+            for (uint8_t bit : bitstream)
+            {
+                int samples = clock.next();
+                for (int j = 0; j < samples; j++)
+                {
+                    audio.push_back(modulator.modulate(bit));
+                }
+            }
+            audio.insert(audio.end(), iq_sample_rate / 20, 0.0);
+        }
+    }
+
+    std::vector<double> neighbour;
+
+    {
+        std::vector<uint8_t> bits = generate_random_bits(audio.size() / 200 + 1);
+        dds_afsk_modulator modulator(1200.0, 2200.0, 1200, iq_sample_rate, 1.0);
+        for (uint8_t bit : bits)
+        {
+            for (int j = 0; j < 200; j++)
+            {
+                neighbour.push_back(modulator.modulate(bit));
+            }
+        }
+    }
+
+    std::vector<double> iq_re(audio.size());
+    std::vector<double> iq_im(audio.size());
+
+    double phase = 0.0;
+    double neighbour_phase = 0.0;
+
+    for (size_t i = 0; i < audio.size(); i++)
+    {
+        phase = std::fmod(phase + two_pi * 3000.0 * audio[i] / iq_sample_rate, two_pi);
+        neighbour_phase = std::fmod(neighbour_phase + two_pi * (20000.0 + 3000.0 * neighbour[i]) / iq_sample_rate, two_pi);
+        iq_re[i] = 0.05 * std::cos(phase) + 0.5 * std::cos(neighbour_phase);
+        iq_im[i] = 0.05 * std::sin(phase) + 0.5 * std::sin(neighbour_phase);
+    }
+
+    iq_channel channel(iq_sample_rate, 0.0, 5);
+    EXPECT_EQ(channel.sample_rate(), 48000);
+
+    std::vector<double> channel_audio;
+    for (size_t pos = 0; pos < iq_re.size(); pos += 4096)
+    {
+        size_t n = (std::min)(size_t(4096), iq_re.size() - pos);
+        channel.process(&iq_re[pos], &iq_im[pos], n, channel_audio);
+    }
+
+    EXPECT_EQ(count_decoded_packets(pll_demodulator(1200.0, 2200.0, 1200, 48000).demodulate(channel_audio)), 3);
+}
+
+std::vector<double> render_modem_capture(const std::string& path, int frames)
+{
+    // Demodulator input rendered by modem::transmit through wav_audio_stream
+
+    aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+
+    {
+        dds_afsk_modulator_adapter modulator(1200.0, 2200.0, 1200, 48000);
+        basic_bitstream_converter_adapter bitstream_converter;
+        wav_audio_stream wav_stream(path, true, 48000);
+
+        modem m;
+        m.tx_delay(100);
+        m.gain(0.3);
+        m.end_silence(0.05);
+        m.initialize(wav_stream, modulator, bitstream_converter);
+
+        for (int i = 0; i < frames; i++)
+        {
+            m.transmit(p);
+        }
+
+        wav_stream.close();
+    }
+
+    std::vector<double> capture;
+
+    wav_audio_stream wav_stream(path, false, 48000);
+
+    std::vector<double> audio_samples(4096);
+    while (size_t read = wav_stream.read(audio_samples.data(), audio_samples.size()))
+    {
+        capture.insert(capture.end(), audio_samples.begin(), audio_samples.begin() + read);
+    }
+
+    return capture;
+}
+
+TEST(dds_afsk_modulator_quadrature_demodulator, noisy_capture_decode_rate)
+{
+    // Same WAV input for every demodulator, rendered by modem::transmit
+
+    const int frames = 50;
+
+    std::vector<double> capture = render_modem_capture("benchmark_demodulator.wav", frames);
+
+    std::mt19937 rng(3);
+
+    for (double noise : { 0.0, 0.25, 0.3 })
+    {
+        std::normal_distribution<double> dist(0.0, noise > 0.0 ? noise : 1e-12);
+
+        std::vector<double> audio_buffer = capture;
+        for (double& x : audio_buffer)
+        {
+            x += dist(rng);
+        }
+
+        std::vector<uint8_t> sliding_bits = sliding_dft_demodulator(1200.0, 2200.0, 1200, 48000).demodulate(audio_buffer);
+
+        // One bit boxcar, the same detector as the sliding DFT
+
+        EXPECT_EQ(quadrature_demodulator(1200.0, 2200.0, 1200, 48000, 0.0, 0.0, 0.0, 1.0).demodulate(audio_buffer), sliding_bits);
+
+        size_t dft_decoded = count_decoded_packets(dft_demodulator(1200.0, 2200.0, 1200, 48000).demodulate(audio_buffer));
+        size_t sliding_decoded = count_decoded_packets(sliding_bits);
+        size_t quadrature_decoded = count_decoded_packets(quadrature_demodulator(1200.0, 2200.0, 1200, 48000).demodulate(audio_buffer));
+
+        if (noise == 0.0)
+        {
+            EXPECT_EQ(sliding_decoded, frames);
+            EXPECT_EQ(quadrature_decoded, frames);
+        }
+        else
+        {
+            // The default 1.5 bit tapered window decodes frames the one bit windows lose
+
+            EXPECT_GT(quadrature_decoded, dft_decoded);
+            EXPECT_GT(quadrature_decoded, sliding_decoded);
+        }
+    }
+}
+
+TEST(dds_afsk_modulator_quadrature_demodulator, DISABLED_benchmark_cpu_per_sample)
+{
+    // Run with --gtest_also_run_disabled_tests, the timings are recorded as
+    // test properties, ex: with --gtest_output=xml
+
+    std::vector<double> audio_buffer = render_modem_capture("benchmark_demodulator.wav", 50);
+
+    std::mt19937 rng(3);
+    std::normal_distribution<double> dist(0.0, 0.25);
+    for (double& x : audio_buffer)
+    {
+        x += dist(rng);
+    }
+
+    // Best of a few runs, ns per input sample
+
+    auto measure = [&](auto&& demodulate) {
+        double best = std::numeric_limits<double>::max();
+        for (int run = 0; run < 5; run++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            std::vector<uint8_t> bits = demodulate(audio_buffer);
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / audio_buffer.size();
+            EXPECT_FALSE(bits.empty());
+            best = (std::min)(best, ns);
+        }
+        return best;
+    };
+
+    double dft_ns = measure([](const std::vector<double>& a) { return dft_demodulator(1200.0, 2200.0, 1200, 48000).demodulate(a); });
+    double sliding_ns = measure([](const std::vector<double>& a) { return sliding_dft_demodulator(1200.0, 2200.0, 1200, 48000).demodulate(a); });
+    double quadrature_ns = measure([](const std::vector<double>& a) { return quadrature_demodulator(1200.0, 2200.0, 1200, 48000).demodulate(a); });
+
+    RecordProperty("dft_ns_per_sample", std::to_string(dft_ns));
+    RecordProperty("sliding_dft_ns_per_sample", std::to_string(sliding_ns));
+    RecordProperty("quadrature_ns_per_sample", std::to_string(quadrature_ns));
+
+    EXPECT_LT(quadrature_ns, dft_ns);
+}
+
+TEST(hdlc_deframer, process_blocks)
+{
+    aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+
+    // Two frames back to back, with random bits around them
+
+    std::vector<uint8_t> bitstream = generate_random_bits(100);
+    std::vector<uint8_t> frame_bits = encode_basic_bitstream(p, 10, 2);
+    bitstream.insert(bitstream.end(), frame_bits.begin(), frame_bits.end());
+    bitstream.insert(bitstream.end(), frame_bits.begin(), frame_bits.end());
+    std::vector<uint8_t> tail = generate_random_bits(100);
+    bitstream.insert(bitstream.end(), tail.begin(), tail.end());
+
+    hdlc_deframer deframer;
+    std::vector<std::vector<uint8_t>> frames;
+
+    for (size_t pos = 0; pos < bitstream.size(); pos += 13)
+    {
+        deframer.process(&bitstream[pos], (std::min)(size_t(13), bitstream.size() - pos), frames);
+    }
+
+    ASSERT_EQ(frames.size(), 2);
+
+    for (const std::vector<uint8_t>& frame : frames)
+    {
+        EXPECT_EQ(frame, encode_frame(p));
+    }
+}
+
+TEST(hdlc_deframer, crc_repair_flipped_line_bits)
+{
+    aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+
+    std::vector<uint8_t> bitstream = encode_basic_bitstream(p, 45, 30);
+
+    std::vector<std::vector<uint8_t>> expected;
+    hdlc_deframer().process(bitstream.data(), bitstream.size(), expected);
+    ASSERT_EQ(expected.size(), 1);
+
+    // Two wrong line bits inside the frame, the demodulator was unsure about them
+
+    std::vector<uint8_t> bits = bitstream;
+    std::vector<float> confidence(bits.size(), 1.0f);
+
+    for (size_t i : { size_t(45 * 8 + 100), size_t(45 * 8 + 301) })
+    {
+        bits[i] ^= 1;
+        confidence[i] = 0.05f;
+    }
+    confidence[45 * 8 + 200] = 0.1f; // Unsure but right
+
+    std::vector<std::vector<uint8_t>> frames;
+
+    EXPECT_EQ(hdlc_deframer().process(bits.data(), confidence.data(), bits.size(), frames), 0);
+
+    hdlc_deframer single_flip(1024, 8, 1);
+    EXPECT_EQ(single_flip.process(bits.data(), confidence.data(), bits.size(), frames), 0);
+    EXPECT_EQ(single_flip.repair_stats().attempts, 1);
+    EXPECT_EQ(single_flip.repair_stats().repairs, 0);
+    EXPECT_EQ(single_flip.repair_stats().candidates, 8);
+
+    hdlc_deframer deframer(1024, 8, 2);
+    EXPECT_EQ(deframer.process(bits.data(), confidence.data(), bits.size(), frames), 1);
+    ASSERT_EQ(frames.size(), 1);
+    EXPECT_EQ(frames[0], expected[0]);
+    EXPECT_EQ(deframer.repair_stats().attempts, 1);
+    EXPECT_EQ(deframer.repair_stats().repairs, 1);
+    EXPECT_LE(deframer.repair_stats().candidates, 8 + 28);
+}
+
+TEST(hdlc_deframer, crc_repair_noisy_capture)
+{
+    aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+
+    std::vector<uint8_t> bitstream = encode_basic_bitstream(p, 45, 30);
+
+    std::vector<double> audio_buffer;
+
+    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 1.0);
+    bit_clock clock(1200, 48000);
+
+    const size_t frame_count = 50;
+
+    for (size_t i = 0; i < frame_count; i++)
+    {
+        for (uint8_t bit : bitstream)
+        {
+            int samples = clock.next();
+            for (int j = 0; j < samples; j++)
+            {
+                audio_buffer.push_back(0.3 * modulator.modulate(bit));
+            }
+        }
+        audio_buffer.insert(audio_buffer.end(), 2400, 0.0);
+    }
+
+    std::mt19937 rng(7);
+    std::normal_distribution<double> noise(0.0, 0.3);
+    for (double& sample : audio_buffer)
+    {
+        sample += noise(rng);
+    }
+
+    std::vector<uint8_t> bits;
+    std::vector<float> confidence;
+    pll_demodulator(1200.0, 2200.0, 1200, 48000).demodulate(audio_buffer.data(), audio_buffer.size(), bits, confidence);
+    ASSERT_EQ(bits.size(), confidence.size());
+
+    std::vector<std::vector<uint8_t>> hard_frames;
+    hdlc_deframer().process(bits.data(), bits.size(), hard_frames);
+
+    std::vector<std::vector<uint8_t>> frames;
+    hdlc_deframer deframer(1024, 16, 2);
+    deframer.process(bits.data(), confidence.data(), bits.size(), frames);
+
+    // frames holds the hard decoded frames plus the repaired ones
+    // At noise 0.3 the hard decoder loses most frames, repair at least doubles them
+
+    EXPECT_LT(hard_frames.size(), frame_count / 2);
+    EXPECT_GE(frames.size(), 2 * hard_frames.size());
+    EXPECT_LE(frames.size(), frame_count);
+    EXPECT_EQ(deframer.repair_stats().repairs, frames.size() - hard_frames.size());
+    EXPECT_GE(deframer.repair_stats().attempts, deframer.repair_stats().repairs);
+    EXPECT_LE(deframer.repair_stats().candidates, deframer.repair_stats().attempts * (16 + 120));
+
+    for (const std::vector<uint8_t>& frame : frames)
+    {
+        aprs::router::packet decoded;
+        EXPECT_TRUE(try_decode_frame(frame, decoded));
+        EXPECT_EQ(decoded.data, p.data);
+    }
+}
+
+TEST(decoder_bank, dedup_and_stats)
+{
+    aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+
+    std::vector<uint8_t> bitstream = encode_basic_bitstream(p, 45, 30);
+
+    g3ruh_modulator modulator(9600, 48000);
+
+    std::vector<double> audio_buffer;
+
+    modulator.modulate(bitstream.begin(), bitstream.end(), std::back_inserter(audio_buffer));
+
+    // A variant at the wrong bit rate never decodes
+    // Two identical variants decode the same frame, it is reported once
+
+    decoder_bank<g3ruh_demodulator> bank(48000);
+    bank.add_variant(g3ruh_demodulator(4800, 48000, modulator.delay()));
+    bank.add_variant(g3ruh_demodulator(9600, 48000, modulator.delay()));
+    bank.add_variant(g3ruh_demodulator(9600, 48000, modulator.delay()));
+
+    std::vector<aprs::router::packet> packets;
+    for (size_t pos = 0; pos < audio_buffer.size(); pos += 480)
+    {
+        bank.process(&audio_buffer[pos], (std::min)(size_t(480), audio_buffer.size() - pos), packets);
+    }
+
+    ASSERT_EQ(packets.size(), 1);
+    EXPECT_TRUE(packets[0] == p);
+
+    EXPECT_EQ(bank.stats(0).decoded, 0);
+    EXPECT_EQ(bank.stats(1).decoded, 1);
+    EXPECT_EQ(bank.stats(2).decoded, 1);
+    EXPECT_EQ(bank.stats(1).first + bank.stats(2).first, 1);
+}
+
+TEST(decoder_bank, slicer_bandwidth_and_timing_variants)
+{
+    // Noisy capture through a de-emphasized receiver, the space tone comes
+    // out weaker than the mark tone, no single variant decodes every frame
+
+    const int frames = 40;
+
+    std::vector<double> audio_buffer = render_modem_capture("test_decoder_bank.wav", frames);
+
+    make_deemphasis_filter(48000).process(audio_buffer.data(), audio_buffer.size());
+
+    std::mt19937 rng(5);
+    std::normal_distribution<double> noise(0.0, 0.2);
+    for (double& sample : audio_buffer)
+    {
+        sample += noise(rng);
+    }
+
+    // The default, a biased slicer, a shorter (wider bandwidth) window and a
+    // late sampling point; the dedup window is shorter than the frame spacing
+    // so repeats of the same packet are not merged
+
+    decoder_bank<quadrature_demodulator> bank(48000, 100.0);
+    bank.add_variant(quadrature_demodulator(1200.0, 2200.0, 1200, 48000));
+    bank.add_variant(quadrature_demodulator(1200.0, 2200.0, 1200, 48000, 0.1));
+    bank.add_variant(quadrature_demodulator(1200.0, 2200.0, 1200, 48000, 0.0, 0.0, 0.5, 1.0));
+    bank.add_variant(quadrature_demodulator(1200.0, 2200.0, 1200, 48000, 0.0, 0.25));
+
+    std::vector<aprs::router::packet> packets;
+    for (size_t pos = 0; pos < audio_buffer.size(); pos += 480)
+    {
+        bank.process(&audio_buffer[pos], (std::min)(size_t(480), audio_buffer.size() - pos), packets);
+    }
+
+    uint64_t best_single = 0;
+    uint64_t first_total = 0;
+    size_t variants_first = 0;
+
+    for (size_t v = 0; v < bank.variants(); v++)
+    {
+        best_single = (std::max)(best_single, bank.stats(v).decoded);
+        first_total += bank.stats(v).first;
+        if (bank.stats(v).first > 0)
+        {
+            variants_first++;
+        }
+    }
+
+    EXPECT_LE(packets.size(), frames);
+    EXPECT_GE(packets.size(), best_single);
+    EXPECT_EQ(first_total, packets.size());
+
+    // Each variant is the first to decode some frames the others decode
+    // later or not at all
+
+    EXPECT_EQ(variants_first, bank.variants());
+}
+
+TEST(work_stealing_pool, run_and_steal)
+{
+    work_stealing_pool pool(3);
+    EXPECT_EQ(pool.threads(), 3);
+
+    std::atomic<int> done(0);
+
+    // Uneven tasks, the workers that finish early steal from the others
+
+    for (int i = 0; i < 60; i++)
+    {
+        pool.submit([&done, i]() {
+            if (i % 3 == 0)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+            done++;
+        });
+    }
+
+    pool.wait();
+    EXPECT_EQ(done, 60);
+
+    pool.submit([&done]() { done++; });
+    pool.wait();
+    EXPECT_EQ(done, 61);
+}
+
+TEST(parse_wav_header, malformed)
+{
+    std::vector<uint8_t> file(wav_header_size + 100 * 2);
+    write_wav_header(file.data(), 8000, 1, wav_sample_format::int16, 100);
+
+    wav_info info;
+    ASSERT_TRUE(parse_wav_header(file.data(), file.size(), info));
+    EXPECT_EQ(info.frames, 100);
+
+    // fmt chunk fields: sample rate at 24, block align at 32
+
+    auto corrupt = [&](size_t offset, uint32_t value, size_t bytes) {
+        std::vector<uint8_t> bad = file;
+        for (size_t i = 0; i < bytes; i++)
+        {
+            bad[offset + i] = static_cast<uint8_t>(value >> (8 * i));
+        }
+        wav_info bad_info;
+        return parse_wav_header(bad.data(), bad.size(), bad_info);
+    };
+
+    EXPECT_FALSE(corrupt(24, 0, 4));           // Sample rate 0
+    EXPECT_FALSE(corrupt(24, 0x80000000, 4));  // Negative sample rate
+    EXPECT_FALSE(corrupt(32, 1, 2));           // Block align smaller than a 16 bit sample
+    EXPECT_FALSE(corrupt(32, 0, 2));
+    EXPECT_TRUE(corrupt(32, 4, 2));            // Padded frames are fine
+}
+
+TEST(decode_wav_file, overlapping_segments)
+{
+    // 12 frames, 0.7 to 1.3 seconds apart, 1.5 second segments, several frames cross a segment boundary
+
+    const int sample_rate = 48000;
+
+    std::vector<int16_t> pcm(sample_rate / 4, 0);
+
+    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, sample_rate, 1.0);
+    bit_clock clock(1200, sample_rate);
+
+    for (int i = 0; i < 12; i++)
+    {
+        aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Packet " + std::to_string(i) };
+        for (uint8_t bit : encode_basic_bitstream(p, 20, 2))
+        {
+            int samples = clock.next();
+            for (int j = 0; j < samples; j++)
+            {
+                pcm.push_back(static_cast<int16_t>(std::lround(modulator.modulate(bit) * 16000.0)));
+            }
+        }
+        pcm.insert(pcm.end(), static_cast<size_t>(sample_rate * (0.3 + 0.05 * i)), 0);
+    }
+
+    {
+        // 44 byte header, PCM 16 bit mono
+
+        std::ofstream file("test_batch_decoder.wav", std::ios::binary);
+        auto u32 = [&](uint32_t v) { file.write(reinterpret_cast<const char*>(&v), 4); };
+        auto u16 = [&](uint16_t v) { file.write(reinterpret_cast<const char*>(&v), 2); };
+        uint32_t data_size = static_cast<uint32_t>(pcm.size() * 2);
+        file.write("RIFF", 4); u32(36 + data_size); file.write("WAVE", 4);
+        file.write("fmt ", 4); u32(16); u16(1); u16(1); u32(sample_rate); u32(sample_rate * 2); u16(2); u16(16);
+        file.write("data", 4); u32(data_size);
+        file.write(reinterpret_cast<const char*>(pcm.data()), data_size);
+    }
+
+    batch_decoder_options options;
+    options.segment_seconds = 1.5;
+    options.overlap_seconds = 1.0;
+    options.threads = 4;
+
+    std::vector<decoded_frame> frames;
+    ASSERT_TRUE(decode_wav_file("test_batch_decoder.wav", [](int sample_rate) { return pll_demodulator(1200.0, 2200.0, 1200, sample_rate); }, frames, options));
+
+    // Every frame once, in order
+
+    ASSERT_EQ(frames.size(), 12);
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        aprs::router::packet p;
+        EXPECT_TRUE(try_decode_frame(frames[i].frame, p));
+        EXPECT_EQ(p.data, "Packet " + std::to_string(i));
+        if (i > 0)
+        {
+            EXPECT_GT(frames[i].position, frames[i - 1].position);
+        }
+    }
+
+    EXPECT_FALSE(decode_wav_file("does_not_exist.wav", [](int sample_rate) { return pll_demodulator(1200.0, 2200.0, 1200, sample_rate); }, frames, options));
+}
+
+TEST(mapped_wav_output_stream, rotation_and_append)
+{
+    // 1 second per file, 3 files kept, 3.5 seconds written in odd sized blocks
+    // Small segments, the files grow many times
+
+    const int sample_rate = 8000;
+
+    namespace fs = std::filesystem;
+    for (const char* name : { "test_rotate.wav", "test_rotate.1.wav", "test_rotate.2.wav", "test_rotate.3.wav" })
+    {
+        fs::remove(name);
+    }
+
+    std::vector<double> samples(sample_rate * 7 / 2);
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        samples[i] = std::sin(i * 0.01) * 0.8;
+    }
+
+    {
+        mapped_wav_output_stream stream("test_rotate.wav", sample_rate, wav_sample_format::int16, wav_header_size + sample_rate * 2, 3, false, 4096);
+        ASSERT_TRUE(stream.is_open());
+
+        for (size_t pos = 0; pos < samples.size(); pos += 777)
+        {
+            size_t n = (std::min)(size_t(777), samples.size() - pos);
+            EXPECT_EQ(stream.write(&samples[pos], n), n);
+        }
+
+        EXPECT_EQ(stream.rotations(), 3);
+        EXPECT_EQ(stream.frames(), sample_rate / 2);
+    }
+
+    // The first second was rotated out
+
+    EXPECT_FALSE(fs::exists("test_rotate.3.wav"));
+    EXPECT_EQ(fs::file_size("test_rotate.2.wav"), wav_header_size + sample_rate * 2);
+    EXPECT_EQ(fs::file_size("test_rotate.wav"), wav_header_size + sample_rate);
+
+    size_t offset = sample_rate;
+    for (const char* name : { "test_rotate.2.wav", "test_rotate.1.wav", "test_rotate.wav" })
+    {
+        mapped_wav_input_stream input(name);
+        ASSERT_TRUE(input.is_open());
+        EXPECT_EQ(input.sample_rate(), sample_rate);
+
+        std::vector<double> read(input.frames());
+        EXPECT_EQ(input.read(read.data(), read.size()), read.size());
+        EXPECT_TRUE(input.eof());
+
+        for (size_t i = 0; i < read.size(); i++)
+        {
+            EXPECT_NEAR(read[i], samples[offset + i], 2.0 / 32767.0);
+        }
+        offset += read.size();
+    }
+
+    EXPECT_EQ(offset, samples.size());
+
+    // Append continues the current file
+
+    {
+        mapped_wav_output_stream stream("test_rotate.wav", sample_rate, wav_sample_format::int16, 0, 3, true);
+        EXPECT_EQ(stream.frames(), sample_rate / 2);
+        stream.write(samples.data(), 100);
+        EXPECT_EQ(stream.frames(), sample_rate / 2 + 100);
+    }
+
+    EXPECT_EQ(mapped_wav_input_stream("test_rotate.wav").frames(), sample_rate / 2 + 100);
+}
+
+#ifdef __linux__
+
+TEST(mapped_wav_output_stream, file_cannot_grow)
+{
+    // A file size limit stands in for a full disk, growing the file fails,
+    // the stream keeps what was written and closes cleanly
+
+    std::filesystem::remove("test_full.wav");
+
+    std::vector<double> samples(48000, 0.25);  // More than the limit
+    size_t written = 0;
+
+    auto previous_handler = signal(SIGXFSZ, SIG_IGN);
+    rlimit limit;
+    ASSERT_EQ(getrlimit(RLIMIT_FSIZE, &limit), 0);
+
+    {
+        mapped_wav_output_stream stream("test_full.wav", 8000, wav_sample_format::int16, 0, 1, false, 16384);
+        ASSERT_TRUE(stream.is_open());
+
+        rlimit low = limit;
+        low.rlim_cur = 65536;
+        setrlimit(RLIMIT_FSIZE, &low);
+
+        for (size_t pos = 0; pos < samples.size(); pos += 4000)
+        {
+            size_t n = stream.write(&samples[pos], 4000);
+            written += n;
+            if (n < 4000)
+            {
+                break;
+            }
+        }
+
+        EXPECT_EQ(written, (65536 - wav_header_size) / 2);
+        EXPECT_TRUE(stream.is_open());
+        EXPECT_EQ(stream.write(samples.data(), 100), 0);
+
+        stream.flush();
+    }
+
+    setrlimit(RLIMIT_FSIZE, &limit);
+    signal(SIGXFSZ, previous_handler);
+
+    mapped_wav_input_stream input("test_full.wav");
+    ASSERT_TRUE(input.is_open());
+    EXPECT_EQ(input.frames(), written);
+}
+
+#endif
+
+TEST(mapped_wav_input_stream, formats_and_spans)
+{
+    std::vector<double> samples = { 0.0, 0.5, -0.5, 0.25, -1.0, 1.0, 0.125 };
+
+    for (wav_sample_format format : { wav_sample_format::int16, wav_sample_format::int24, wav_sample_format::float32 })
+    {
+        {
+            mapped_wav_output_stream stream("test_format.wav", 48000, format, 0, 1, false);
+            stream.write(samples.data(), samples.size());
+        }
+
+        mapped_wav_input_stream input("test_format.wav");
+        ASSERT_TRUE(input.is_open());
+        EXPECT_EQ(input.format(), format);
+        EXPECT_EQ(input.frames(), samples.size());
+
+        std::vector<double> read(3);
+        EXPECT_EQ(input.read(read.data(), 3), 3);
+        for (size_t i = 0; i < 3; i++)
+        {
+            EXPECT_NEAR(read[i], samples[i], 1e-4);
+        }
+
+        // Zero copy, the span points into the mapping
+
+        wav_span span = input.read_span(100);
+        EXPECT_EQ(span.frames, samples.size() - 3);
+        EXPECT_EQ(span.stride, wav_bytes_per_sample(format));
+        EXPECT_TRUE(input.eof());
+
+        if (format == wav_sample_format::int16)
+        {
+            int16_t s;
+            std::memcpy(&s, span.data, sizeof(s));
+            EXPECT_EQ(s, static_cast<int16_t>(std::lround(0.25 * 32767.0)));
+        }
+        else if (format == wav_sample_format::float32)
+        {
+            float s;
+            std::memcpy(&s, span.data + span.stride, sizeof(s));
+            EXPECT_EQ(s, -1.0f);
+        }
+
+        EXPECT_TRUE(input.seek(1));
+        EXPECT_EQ(input.read(read.data(), 1), 1);
+        EXPECT_NEAR(read[0], 0.5, 1e-4);
+    }
+
+    EXPECT_FALSE(mapped_wav_input_stream("does_not_exist.wav").is_open());
+}
+
+TEST(kiss, encode_decode_split_input)
+{
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<int> byte(0, 255);
+
+    std::vector<std::vector<uint8_t>> frames;
+    frames.push_back({ kiss_fend, kiss_fesc, kiss_tfend, kiss_tfesc, kiss_fend });
+    for (int i = 0; i < 20; i++)
+    {
+        std::vector<uint8_t> frame(1 + i * 7);
+        for (uint8_t& b : frame)
+        {
+            // Plenty of special bytes, and long plain runs
+            b = (i % 3 == 0 && byte(rng) < 32) ? kiss_fend : static_cast<uint8_t>(byte(rng));
+        }
+        frames.push_back(frame);
+    }
+
+    std::vector<uint8_t> stream;
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        kiss_encode(frames[i].data(), frames[i].size(), stream, static_cast<uint8_t>(i % 4));
+    }
+
+    EXPECT_EQ(std::count(stream.begin(), stream.end(), kiss_fend), static_cast<long>(frames.size() * 2));
+
+    std::vector<uint8_t> expected_first = { kiss_fend, 0x00, kiss_fesc, kiss_tfend, kiss_fesc, kiss_tfesc, kiss_tfend, kiss_tfesc, kiss_fesc, kiss_tfend, kiss_fend };
+    EXPECT_TRUE(std::equal(expected_first.begin(), expected_first.end(), stream.begin()));
+
+    // Same frames whatever the split of the input
+
+    for (size_t chunk : { size_t(1), size_t(3), size_t(8), size_t(13), size_t(4096) })
+    {
+        kiss_decoder decoder;
+        std::vector<kiss_frame> decoded;
+        for (size_t pos = 0; pos < stream.size(); pos += chunk)
+        {
+            decoder.process(&stream[pos], (std::min)(chunk, stream.size() - pos), decoded);
+        }
+
+        ASSERT_EQ(decoded.size(), frames.size());
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            EXPECT_EQ(decoded[i].data, frames[i]);
+            EXPECT_EQ(decoded[i].port, i % 4);
+            EXPECT_EQ(decoded[i].command, 0);
+        }
+    }
+
+    // Oversized frames are dropped, the decoder recovers at the next FEND
+
+    kiss_decoder small(16);
+    std::vector<kiss_frame> decoded;
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> long_frame(100, 0x41);
+    std::vector<uint8_t> short_frame(10, 0x42);
+    kiss_encode(long_frame.data(), long_frame.size(), data);
+    kiss_encode(short_frame.data(), short_frame.size(), data);
+    EXPECT_EQ(small.process(data.data(), data.size(), decoded), 1);
+    ASSERT_EQ(decoded.size(), 1);
+    EXPECT_EQ(decoded[0].data, short_frame);
+    // Escaped bytes count against the limit too, ex: a client sending
+    // endless FESC TFEND pairs without a FEND
+
+    decoded.clear();
+    data.assign({ kiss_fend, 0x00 });
+    for (int i = 0; i < 100000; i++)
+    {
+        data.push_back(kiss_fesc);
+        data.push_back(kiss_tfend);
+    }
+    data.push_back(kiss_fend);
+    kiss_encode(short_frame.data(), short_frame.size(), data);
+    EXPECT_EQ(small.process(data.data(), data.size(), decoded), 1);
+    ASSERT_EQ(decoded.size(), 1);
+    EXPECT_EQ(decoded[0].data, short_frame);
+
+}
+
+#ifdef __linux__
+
+TEST(tcp_data_stream, out_of_descriptors)
+{
+    tcp_data_stream server("127.0.0.1", 0, 8);
+    ASSERT_TRUE(server.start());
+
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(server.port()));
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    ASSERT_EQ(connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+
+    // Limit the process to the descriptors in use, accept fails with EMFILE
+
+    int lowest_free = open("/dev/null", O_RDONLY);
+    ASSERT_GE(lowest_free, 0);
+    close(lowest_free);
+
+    rlimit limit;
+    ASSERT_EQ(getrlimit(RLIMIT_NOFILE, &limit), 0);
+    rlimit low = limit;
+    low.rlim_cur = static_cast<rlim_t>(lowest_free);
+    ASSERT_EQ(setrlimit(RLIMIT_NOFILE, &low), 0);
+
+    std::vector<kiss_frame> received;
+    server.poll(100, received);
+    server.poll(0, received);
+
+    tcp_data_stream_stats stats = server.stats();
+
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    // The connection was turned away, it does not stay pending and wake every poll
+
+    EXPECT_EQ(stats.rejected, 1);
+    EXPECT_EQ(server.clients(), 0);
+
+    char byte;
+    EXPECT_EQ(recv(client, &byte, 1, 0), 0);
+
+    close(client);
+}
+
+TEST(tcp_data_stream, loopback_clients)
+{
+    tcp_data_stream server("127.0.0.1", 0, 8, 256, 64 * 1024, 4096);
+    ASSERT_TRUE(server.start());
+    ASSERT_NE(server.port(), 0);
+
+    // Three clients keep up, a fourth never reads
+
+    auto connect_client = [&](int receive_buffer_size) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (receive_buffer_size > 0)
+        {
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer_size, sizeof(receive_buffer_size));
+        }
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(server.port()));
+        inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+        EXPECT_EQ(connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        return fd;
+    };
+
+    std::vector<int> fast_clients = { connect_client(0), connect_client(0), connect_client(0) };
+    int slow_client = connect_client(4096);
+
+    std::vector<kiss_frame> received;
+    for (int i = 0; i < 100 && server.clients() < 4; i++)
+    {
+        server.poll(10, received);
+    }
+    ASSERT_EQ(server.clients(), 4);
+
+    std::vector<kiss_decoder> decoders(fast_clients.size());
+    std::vector<std::vector<kiss_frame>> client_frames(fast_clients.size());
+
+    auto drain = [&]() {
+        uint8_t buffer[8192];
+        for (size_t i = 0; i < fast_clients.size(); i++)
+        {
+            ssize_t n;
+            while ((n = recv(fast_clients[i], buffer, sizeof(buffer), 0)) > 0)
+            {
+                decoders[i].process(buffer, static_cast<size_t>(n), client_frames[i]);
+            }
+        }
+    };
+
+    // A client sends a frame to the server
+
+    {
+        std::vector<uint8_t> frame = { 1, 2, kiss_fend, 3 };
+        std::vector<uint8_t> data;
+        kiss_encode(frame.data(), frame.size(), data);
+        send(fast_clients[0], data.data(), data.size(), 0);
+
+        for (int i = 0; i < 100 && received.empty(); i++)
+        {
+            server.poll(10, received);
+        }
+        ASSERT_EQ(received.size(), 1);
+        EXPECT_EQ(received[0].data, frame);
+    }
+
+    const int frames = 5000;
+
+    std::vector<uint8_t> frame(60);
+    for (size_t i = 0; i < frame.size(); i++)
+    {
+        frame[i] = static_cast<uint8_t>(i * 37);
+    }
+    frame[10] = kiss_fend;
+    frame[20] = kiss_fesc;
+
+    for (int i = 0; i < frames; i++)
+    {
+        frame[0] = static_cast<uint8_t>(i);
+        server.write(frame.data(), frame.size());
+
+        if (i % 32 == 31)
+        {
+            server.poll(0, received);
+            drain();
+        }
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    auto done = [&]() {
+        for (const auto& f : client_frames)
+        {
+            if (f.size() < static_cast<size_t>(frames))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    while (!done() && std::chrono::steady_clock::now() < deadline)
+    {
+        server.poll(1, received);
+        drain();
+    }
+
+    EXPECT_EQ(server.clients(), 4);
+
+    for (const auto& f : client_frames)
+    {
+        ASSERT_EQ(f.size(), static_cast<size_t>(frames));
+        for (int i = 0; i < frames; i++)
+        {
+            frame[0] = static_cast<uint8_t>(i);
+            ASSERT_EQ(f[i].data, frame);
+        }
+    }
+
+    // Only the slow client lost frames, its queue stayed bounded
+
+    EXPECT_GT(server.stats().dropped_frames, 0);
+    EXPECT_EQ(server.stats().sent_frames + server.stats().dropped_frames, static_cast<uint64_t>(frames) * 4);
+
+    // Disconnects free the slots
+
+    for (int fd : fast_clients)
+    {
+        close(fd);
+    }
+    close(slow_client);
+
+    for (int i = 0; i < 100 && server.clients() > 0; i++)
+    {
+        server.poll(10, received);
+    }
+    EXPECT_EQ(server.clients(), 0);
+}
+
+#endif
+
+TEST(data_format, try_parse_data_format)
+{
+    data_format format;
+
+    EXPECT_TRUE(try_parse_data_format("aprs_text", format));
+    EXPECT_TRUE(format.type == data_format_type::aprs_text && !format.telemetry);
+
+    EXPECT_TRUE(try_parse_data_format("aprs_json_with_telemetry", format));
+    EXPECT_TRUE(format.type == data_format_type::aprs_json && format.telemetry);
+
+    EXPECT_TRUE(try_parse_data_format("bitstream_with_telemetry", format));
+    EXPECT_TRUE(format.type == data_format_type::bitstream && format.telemetry);
+
+    EXPECT_TRUE(try_parse_data_format("telemetry", format));
+    EXPECT_TRUE(format.type == data_format_type::telemetry && !format.telemetry);
+
+    EXPECT_FALSE(try_parse_data_format("ax25_kiss_with_telemetry", format));
+    EXPECT_FALSE(try_parse_data_format("_with_telemetry", format));
+    EXPECT_FALSE(try_parse_data_format("aprs", format));
+}
+
+TEST(data_format, writers)
+{
+    aprs::router::packet p = { "N0CALL-10", "APRS", { "WIDE1-1", "WIDE2-2" }, "=4740.00N/12200.00W-Test \"quoted\" back\\slash\ttab\x01 end of a longer comment" };
+
+    std::vector<uint8_t> out;
+    append_aprs_text(p, out);
+    EXPECT_EQ(std::string(out.begin(), out.end()), to_string(p));
+
+    out.clear();
+    append_json_string(p.data, out);
+    EXPECT_EQ(std::string(out.begin(), out.end()), "\"=4740.00N/12200.00W-Test \\\"quoted\\\" back\\\\slash\\ttab\\u0001 end of a longer comment\"");
+
+    out.clear();
+    packet_telemetry telemetry = { 123456, 48000, -50, 2 };
+    append_aprs_json(p, &telemetry, out);
+    std::string json(out.begin(), out.end());
+    EXPECT_EQ(json.find("{\"from\":\"N0CALL-10\",\"to\":\"APRS\",\"path\":[\"WIDE1-1\",\"WIDE2-2\"],\"data\":"), 0);
+    EXPECT_NE(json.find(",\"telemetry\":{\"position\":123456,\"sample_rate\":48000,\"frequency_offset\":-50,\"repaired_bits\":2}}"), std::string::npos);
+
+    // Hex and bits against a byte at a time reference, every tail length
+
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> byte(0, 255);
+    for (size_t size = 0; size < 24; size++)
+    {
+        std::vector<uint8_t> data(size);
+        for (uint8_t& b : data)
+        {
+            b = static_cast<uint8_t>(byte(rng));
+        }
+
+        std::string expected;
+        for (uint8_t b : data)
+        {
+            char digits[3];
+            snprintf(digits, sizeof(digits), "%02X", b);
+            expected += digits;
+        }
+
+        out.clear();
+        append_hex(data.data(), data.size(), out);
+        EXPECT_EQ(std::string(out.begin(), out.end()), expected);
+
+        expected.clear();
+        for (uint8_t& b : data)
+        {
+            b &= 1;
+            expected += static_cast<char>('0' + b);
+        }
+
+        out.clear();
+        append_bits(data.data(), data.size(), out);
+        EXPECT_EQ(std::string(out.begin(), out.end()), expected);
+    }
+}
+
+TEST(data_buffer_pool, bounded_free_list)
+{
+    data_buffer_pool pool(64, 4);
+
+    // A burst of buffers in flight, only max_free are kept when it drains
+
+    std::vector<std::shared_ptr<std::vector<uint8_t>>> burst;
+    for (int i = 0; i < 10; i++)
+    {
+        burst.push_back(pool.acquire());
+        burst.back()->push_back(static_cast<uint8_t>(i));
+    }
+
+    EXPECT_EQ(pool.size(), 10);
+    EXPECT_EQ(pool.free_buffers(), 0);
+
+    // Released in order, the first four are kept, the fourth one last
+
+    const std::vector<uint8_t>* last_kept = burst[3].get();
+
+    burst.clear();
+
+    EXPECT_EQ(pool.size(), 4);
+    EXPECT_EQ(pool.free_buffers(), 4);
+
+    // The most recently released buffer comes back first, empty, with its capacity
+
+    std::shared_ptr<std::vector<uint8_t>> buffer = pool.acquire();
+    EXPECT_EQ(buffer.get(), last_kept);
+    EXPECT_TRUE(buffer->empty());
+    EXPECT_GE(buffer->capacity(), 64);
+    EXPECT_EQ(pool.free_buffers(), 3);
+}
+
+TEST(data_buffer_pool, release_on_other_threads)
+{
+    data_buffer_pool pool(64, 8);
+
+    // Streams drop their buffers on their own threads while the formatter
+    // keeps acquiring, every buffer is either reused or freed
+
+    constexpr int packets = 20000;
+
+    std::mutex mutex;
+    std::deque<std::shared_ptr<const std::vector<uint8_t>>> queue;
+    std::atomic<bool> done = false;
+
+    std::vector<std::thread> streams;
+    for (int t = 0; t < 2; t++)
+    {
+        streams.emplace_back([&] {
+            while (true)
+            {
+                std::shared_ptr<const std::vector<uint8_t>> buffer;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!queue.empty())
+                    {
+                        buffer = std::move(queue.front());
+                        queue.pop_front();
+                    }
+                }
+                if (buffer == nullptr)
+                {
+                    if (done)
+                    {
+                        break;
+                    }
+                    std::this_thread::yield();
+                    continue;
+                }
+                EXPECT_EQ(buffer->size(), 16);
+                EXPECT_EQ((*buffer)[15], (*buffer)[0]);
+            }
+        });
+    }
+
+    for (int i = 0; i < packets; i++)
+    {
+        std::shared_ptr<std::vector<uint8_t>> buffer = pool.acquire();
+        ASSERT_TRUE(buffer->empty());
+        buffer->assign(16, static_cast<uint8_t>(i));
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(buffer));
+    }
+
+    done = true;
+    for (std::thread& t : streams)
+    {
+        t.join();
+    }
+
+    EXPECT_LE(pool.size(), 8);
+    EXPECT_EQ(pool.size(), pool.free_buffers());
+}
+
+TEST(data_formatter, format_once_fan_out)
+{
+    data_formatter formatter;
+
+    auto add = [&](std::string_view name) {
+        data_format format;
+        EXPECT_TRUE(try_parse_data_format(name, format));
+        return formatter.add(format);
+    };
+
+    size_t tcp_1 = add("ax25_kiss");
+    size_t tcp_2 = add("ax25_kiss");
+    size_t stdout_stream = add("aprs_text");
+    size_t log_stream = add("aprs_text");
+    size_t json_stream = add("aprs_json_with_telemetry");
+    size_t hex_stream = add("ax25_hex");
+    size_t bits_stream = add("bitstream");
+
+    EXPECT_EQ(formatter.streams(), 7);
+    EXPECT_EQ(formatter.formats(), 5);
+
+    aprs::router::packet p = { "N0CALL", "APRS", { "WIDE1-1" }, "hello \xC0 world" };
+    std::vector<uint8_t> frame = encode_frame(p);
+
+    // A stream that holds on to buffers, ex: a TCP client queue
+
+    std::deque<data_buffer> queue;
+
+    const int packets = 2000;
+
+    for (int i = 0; i < packets; i++)
+    {
+        data_packet packet;
+        packet.packet = &p;
+        packet.frame = frame.data();
+        packet.frame_size = frame.size();
+        packet.telemetry.position = static_cast<uint64_t>(i);
+        formatter.render(packet);
+
+        // Streams of the same format share the buffer
+
+        ASSERT_EQ(formatter.buffer(tcp_1).get(), formatter.buffer(tcp_2).get());
+        ASSERT_EQ(formatter.buffer(stdout_stream).get(), formatter.buffer(log_stream).get());
+        ASSERT_NE(formatter.buffer(tcp_1).get(), formatter.buffer(stdout_stream).get());
+
+        queue.push_back(formatter.buffer(tcp_1));
+        if (queue.size() > 16)
+        {
+            queue.pop_front();
+        }
+    }
+
+    EXPECT_EQ(formatter.renders(), static_cast<uint64_t>(packets) * 5);
+
+    // The pool settles on the buffers in flight, it does not grow per packet
 
-    s.mark = true;
-    s.N = 0;
-    EXPECT_TRUE(to_string(s) == "WIDE2*");
+    EXPECT_LE(formatter.pooled_buffers(), 5 + 17);
 
-    s.N = 0;
-    s.n = 0;
-    EXPECT_TRUE(to_string(s) == "WIDE*");
+    const data_buffer& text = formatter.buffer(stdout_stream);
+    EXPECT_EQ(std::string(text->begin(), text->end()), to_string(p) + "\n");
 
-    s = address{};
-    s.text = "N0CALL";
-    s.ssid = 10;
-    EXPECT_TRUE(to_string(s) == "N0CALL-10");
+    const data_buffer& json = formatter.buffer(json_stream);
+    EXPECT_NE(std::string(json->begin(), json->end()).find("\"position\":1999"), std::string::npos);
 
-    s = address{};
-    s.text = "N0CALL";
-    s.ssid = 10;
-    s.mark = true;
-    EXPECT_TRUE(to_string(s) == "N0CALL-10*");
+    kiss_decoder decoder;
+    std::vector<kiss_frame> kiss_frames;
+    decoder.process(formatter.buffer(tcp_1)->data(), formatter.buffer(tcp_1)->size(), kiss_frames);
+    ASSERT_EQ(kiss_frames.size(), 1);
+    EXPECT_EQ(kiss_frames[0].data, std::vector<uint8_t>(frame.begin(), frame.end() - 2));
 
-    s = address{};
-    s.text = "N0CALL-10";
-    s.ssid = 10;
-    EXPECT_TRUE(to_string(s) == "N0CALL-10-10"); // to_string preserves the text even if ssid is specified and results in an invalid address
+    EXPECT_EQ(formatter.buffer(hex_stream)->size(), (frame.size() - 2) * 2 + 1);
+
+    // The bitstream is rendered from the frame, and decodes back to the packet
+
+    const data_buffer& bits_text = formatter.buffer(bits_stream);
+    std::vector<uint8_t> bits;
+    for (size_t i = 0; i + 1 < bits_text->size(); i++)
+    {
+        bits.push_back(static_cast<uint8_t>((*bits_text)[i] - '0'));
+    }
+    aprs::router::packet decoded;
+    size_t read = 0;
+    EXPECT_TRUE(try_decode_basic_bitstream(bits, 0, decoded, read));
+    EXPECT_EQ(decoded, p);
 }
 
-TEST(dds_afsk_modulator_dft_demodulator, modulate_demodulate_8bits)
+TEST(bitstream, g3ruh_scramble_descramble)
 {
-    std::vector<double> audio_buffer;
+    std::vector<uint8_t> bits = generate_random_bits(10'000);
 
-    std::vector<uint8_t> bitstream = { 0, 0, 1, 1, 0, 1, 0, 0 };
+    // Word-parallel scrambler matches the bit-serial definition
 
-    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 1.0); // Coherent 1200 baud AFSK
+    std::vector<uint8_t> expected(bits.size());
+    uint32_t lfsr = 0;
+    for (size_t i = 0; i < bits.size(); i++)
+    {
+        uint8_t x = (bits[i] ^ (lfsr >> 16) ^ (lfsr >> 11)) & 1;
+        lfsr = (lfsr << 1) | x;
+        expected[i] = x;
+    }
 
-    for (uint8_t bit : bitstream)
+    std::vector<uint8_t> scrambled = bits;
+    g3ruh_scrambler scrambler;
+    g3ruh_scramble(scrambled.begin(), scrambled.end(), scrambler);
+
+    EXPECT_EQ(scrambled, expected);
+
+    std::vector<uint8_t> descrambled = scrambled;
+    g3ruh_descrambler descrambler;
+    g3ruh_descramble(descrambled.begin(), descrambled.end(), descrambler);
+
+    EXPECT_EQ(descrambled, bits);
+
+    // Bit at a time API gives the same result
+
+    g3ruh_descrambler descrambler_2;
+    for (size_t i = 0; i < scrambled.size(); i++)
     {
-        for (int i = 0; i < modulator.samples_per_bit(); ++i)
+        EXPECT_EQ(descrambler_2.descramble(scrambled[i]), bits[i]);
+    }
+}
+
+struct bounded_test_stream : public audio_stream_events
+{
+    // Fixed capacity stream, a consumer thread drains it and signals writable space
+
+    bounded_test_stream(size_t capacity, int rate = 48000) : capacity(capacity), rate(rate)
+    {
+        event.notify(capacity);
+    }
+
+    size_t write(const double* samples, size_t count)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t n = (std::min)(count, capacity - pending);
+        for (size_t i = 0; i < n; i++)
         {
-            audio_buffer.push_back(modulator.modulate(bit));
+            written.push_back(samples[i]);
         }
+        pending += n;
+        event.notify(capacity - pending);
+        return n;
     }
 
-    dft_demodulator demodulator(1200.0, 2200.0, 1200, 48000);
+    void drain(size_t count)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending -= (std::min)(count, pending);
+        event.notify(capacity - pending);
+    }
 
-    std::vector<uint8_t> demodulated_bits = demodulator.demodulate(audio_buffer);
-    
-    EXPECT_EQ(bitstream, demodulated_bits);
+    bool wait_write(size_t count, std::chrono::milliseconds timeout) override
+    {
+        return event.wait_for(count, timeout);
+    }
+
+    int sample_rate() const
+    {
+        return rate;
+    }
+
+    size_t capacity;
+    int rate;
+    size_t pending = 0;
+    std::vector<double> written;
+    std::mutex mutex;
+    writable_event event;
+};
+
+TEST(modem, render_audio_waits_for_writable_space)
+{
+    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 0.3);
+    basic_bitstream_converter bitstream_converter;
+    bounded_test_stream stream(960);
+
+    basic_modem<dds_afsk_modulator, basic_bitstream_converter, bounded_test_stream> m;
+    m.initialize(stream, modulator, bitstream_converter);
+
+    std::vector<uint8_t> bits = generate_random_bits(1200);
+
+    // Consumer drains 480 samples every 2 ms, the writer blocks in between
+
+    std::atomic<bool> done = false;
+    std::thread consumer([&] {
+        while (!done)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            stream.drain(480);
+        }
+    });
+
+    m.transmit(bits);
+
+    done = true;
+    consumer.join();
+
+    EXPECT_EQ(stream.written.size(), 48000);
 }
 
-TEST(dds_afsk_modulator_dft_demodulator, modulate_demodulate_random_100000bits)
+TEST(modem, render_audio_stream_smaller_than_chunk)
 {
-    std::vector<double> audio_buffer;
+    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 0.3);
+    basic_bitstream_converter bitstream_converter;
+    bounded_test_stream stream(4800);
 
-    std::vector<uint8_t> bitstream = generate_random_bits(100'000);
+    // 1 s chunks on a 100 ms stream, the writer must not wait for a whole chunk of free space
 
-    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 1.0); // Coherent 1200 baud AFSK
+    basic_modem<dds_afsk_modulator, basic_bitstream_converter, bounded_test_stream> m;
+    m.render_mode(render_profile::high_throughput);
+    m.initialize(stream, modulator, bitstream_converter);
 
-    for (uint8_t bit : bitstream)
+    std::atomic<bool> done = false;
+    std::thread consumer([&] {
+        while (!done)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            stream.drain(480);
+        }
+    });
+
+    m.transmit(generate_random_bits(1200));
+
+    done = true;
+    consumer.join();
+
+    EXPECT_EQ(stream.written.size(), 48000);
+}
+
+TEST(modem, render_audio_timeout_drop)
+{
+    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 0.3);
+    basic_bitstream_converter bitstream_converter;
+    bounded_test_stream stream(960);
+
+    basic_modem<dds_afsk_modulator, basic_bitstream_converter, bounded_test_stream> m;
+    m.write_timeout(20);
+    m.write_timeout_action(write_timeout_policy::drop);
+    m.initialize(stream, modulator, bitstream_converter);
+
+    // Nothing drains the stream, the frame is dropped once the timeout elapses
+
+    auto start = std::chrono::steady_clock::now();
+
+    m.transmit(generate_random_bits(1200));
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(stream.written.size(), 960);
+    EXPECT_GE(elapsed, std::chrono::milliseconds(20));
+    EXPECT_LT(elapsed, std::chrono::milliseconds(1000));
+}
+
+TEST(modem, fan_out_outputs)
+{
+    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 0.3);
+    basic_bitstream_converter bitstream_converter;
+    bounded_test_stream primary(1'000'000);
+    bounded_test_stream file_output(1'000'000);
+    bounded_test_stream slow_output(960); // Nothing drains it until the end
+
+    basic_modem<dds_afsk_modulator, basic_bitstream_converter, bounded_test_stream> m;
+    m.initialize(primary, modulator, bitstream_converter);
+    m.add_output(file_output);
+    m.add_output(slow_output, 1);
+
+    // The stalled output must not hold back the primary stream
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < 3; i++)
     {
-        for (int i = 0; i < modulator.samples_per_bit(); ++i)
+        m.transmit(generate_random_bits(120));
+    }
+
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(500));
+    EXPECT_EQ(primary.written.size(), 3 * 4800);
+
+    // Unblock the slow output
+
+    std::atomic<bool> done = false;
+    std::thread consumer([&] {
+        while (!done)
         {
-            audio_buffer.push_back(modulator.modulate(bit));
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            slow_output.drain(960);
         }
+    });
+
+    m.flush();
+
+    done = true;
+    consumer.join();
+
+    EXPECT_EQ(file_output.written, primary.written);
+
+    // The slow output queues one frame, the frames it had no room for
+    // were dropped for the slow output only
+
+    ASSERT_GE(slow_output.written.size(), 4800);
+    ASSERT_LT(slow_output.written.size(), 3 * 4800);
+    EXPECT_EQ(slow_output.written.size() % 4800, 0);
+    EXPECT_TRUE(std::equal(slow_output.written.begin(), slow_output.written.begin() + 4800, primary.written.begin()));
+}
+
+TEST(modem, fan_out_mixed_sample_rates)
+{
+    aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+
+    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 0.3);
+    basic_bitstream_converter bitstream_converter;
+    bounded_test_stream primary(1'000'000);
+    bounded_test_stream wav_output(1'000'000, 48000);
+    bounded_test_stream alsa_output(1'000'000, 44100);
+
+    basic_modem<dds_afsk_modulator, basic_bitstream_converter, bounded_test_stream> m;
+    m.tx_delay(100);
+    m.initialize(primary, modulator, bitstream_converter);
+    m.add_output(wav_output);
+    m.add_output(alsa_output);
+
+    const int frames = 3;
+
+    for (int i = 0; i < frames; i++)
+    {
+        m.transmit(p);
     }
 
-    dft_demodulator demodulator(1200.0, 2200.0, 1200, 48000);
+    m.flush();
 
-    std::vector<uint8_t> demodulated_bits = demodulator.demodulate(audio_buffer);
+    // Same rate output, the shared frame as is
 
-    EXPECT_EQ(bitstream, demodulated_bits);
+    EXPECT_EQ(wav_output.written, primary.written);
+
+    // 44.1 kHz output, each frame converted on its own, same as a modem rendering
+    // to a 44.1 kHz stream
+
+    const size_t frame_size = primary.written.size() / frames;
+
+    std::vector<double> expected;
+    polyphase_resampler resampler(48000, 44100);
+    for (int i = 0; i < frames; i++)
+    {
+        std::vector<double> frame(primary.written.begin() + i * frame_size, primary.written.begin() + (i + 1) * frame_size);
+        std::vector<double> converted;
+        resample_frame(resampler, frame, converted);
+        expected.insert(expected.end(), converted.begin(), converted.end());
+    }
+
+    EXPECT_EQ(alsa_output.written, expected);
+
+    // 44100 / 48000 of the samples, plus the flushed filter tail of each frame
+
+    EXPECT_NEAR(static_cast<double>(alsa_output.written.size()), primary.written.size() * 44100.0 / 48000.0, frames * 32.0);
+
+    EXPECT_EQ(count_decoded_packets(pll_demodulator(1200.0, 2200.0, 1200, 44100).demodulate(alsa_output.written)), frames);
 }
 
-TEST(dds_afsk_modulator_dft_demodulator, modulate_demodulate_packet)
+TEST(modem, fan_out_stalled_output)
 {
-    std::vector<double> audio_buffer;
+    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 0.3);
+    basic_bitstream_converter bitstream_converter;
+    bounded_test_stream primary(1'000'000);
+    bounded_test_stream stalled_output(960); // Never drained
 
-    aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+    // The output follows the modem write timeout and drop policy
 
-    std::vector<uint8_t> bitstream = encode_basic_bitstream(p, 45, 30);
+    {
+        basic_modem<dds_afsk_modulator, basic_bitstream_converter, bounded_test_stream> m;
+        m.initialize(primary, modulator, bitstream_converter);
+        m.add_output(stalled_output);
+        m.write_timeout(20);
+        m.write_timeout_action(write_timeout_policy::drop);
 
-    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 1.0); // Coherent 1200 baud AFSK
+        auto start = std::chrono::steady_clock::now();
+
+        m.transmit(generate_random_bits(120));
+        m.transmit(generate_random_bits(120));
+        m.flush();
+
+        EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(1000));
+        EXPECT_EQ(stalled_output.written.size(), 960);
+    }
+
+    // No timeout, the teardown discards the queued frames and cancels the blocked write
+
+    auto start = std::chrono::steady_clock::now();
 
-    for (uint8_t bit : bitstream)
     {
-        for (int i = 0; i < modulator.samples_per_bit(); ++i)
+        basic_modem<dds_afsk_modulator, basic_bitstream_converter, bounded_test_stream> m;
+        m.initialize(primary, modulator, bitstream_converter);
+        m.add_output(stalled_output);
+
+        for (int i = 0; i < 3; i++)
         {
-            audio_buffer.push_back(modulator.modulate(bit));
+            m.transmit(generate_random_bits(120));
         }
     }
 
-    dft_demodulator demodulator(1200.0, 2200.0, 1200, 48000);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(1000));
+    EXPECT_EQ(stalled_output.written.size(), 960);
+}
 
-    std::vector<uint8_t> demodulated_bits = demodulator.demodulate(audio_buffer);
+TEST(modem, g3ruh_default_postamble)
+{
+    // tx_tail 0, a single closing flag, the modem flushes the pulse filter
 
-    aprs::router::packet p2;
+    g3ruh_modulator modulator(9600, 48000);
+    basic_bitstream_converter bitstream_converter;
+    bounded_test_stream stream(1'000'000);
 
-    size_t read = 0;
-    try_decode_basic_bitstream(demodulated_bits, 0, p2, read);
+    basic_modem<g3ruh_modulator, basic_bitstream_converter, bounded_test_stream> m;
+    m.baud_rate(9600);
+    m.tx_delay(20);
+    m.initialize(stream, modulator, bitstream_converter);
 
-    EXPECT_TRUE(p == p2);
+    aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+
+    m.transmit(p);
+
+    g3ruh_demodulator demodulator(9600, 48000, modulator.delay());
+
+    std::vector<uint8_t> bits;
+    demodulator.demodulate(stream.written.data(), stream.written.size(), bits);
+
+    aprs::router::packet p2;
+    size_t read = 0;
+    EXPECT_TRUE(try_decode_basic_bitstream(bits, 0, p2, read));
+    EXPECT_EQ(p2, p);
 }
 
-TEST(modem, modulate_demodulate_packet)
+TEST(modem, render_chunk_size)
 {
-    {
-        dds_afsk_modulator_adapter modulator(1200.0, 2200.0, 1200, 48000);
-        basic_bitstream_converter_adapter bitstream_converter;
-        wav_audio_stream wav_stream("test.wav", true, 48000);
+    // No device timing, sized from the stream sample rate
 
-        aprs::router::packet p = { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" };
+    EXPECT_EQ(render_chunk_size(render_profile::balanced, 48000, {}), 480);
+    EXPECT_EQ(render_chunk_size(render_profile::balanced, 44100, {}), 441);
+    EXPECT_EQ(render_chunk_size(render_profile::low_latency, 44100, {}), 88);
+    EXPECT_EQ(render_chunk_size(render_profile::high_throughput, 44100, {}), 44100);
 
-        modem m;
-        m.baud_rate(1200);
-        m.tx_delay(300);
-        m.tx_tail(45);
-        m.gain(0.3);
-        m.preemphasis(true);
-        m.initialize(wav_stream, modulator, bitstream_converter);
+    // Device period and buffer size known
 
-        m.transmit(p);
+    stream_timing timing = { 256, 4096 };
 
-        wav_stream.close();
+    EXPECT_EQ(render_chunk_size(render_profile::balanced, 48000, timing), 256);
+    EXPECT_EQ(render_chunk_size(render_profile::low_latency, 48000, timing), 96);
+    EXPECT_EQ(render_chunk_size(render_profile::low_latency, 48000, { 64, 4096 }), 64);
+    EXPECT_EQ(render_chunk_size(render_profile::high_throughput, 48000, timing), 4096);
+
+    // Never larger than the device buffer
+
+    EXPECT_EQ(render_chunk_size(render_profile::balanced, 48000, { 0, 256 }), 256);
+    EXPECT_EQ(render_chunk_size(render_profile::high_throughput, 48000, { 0, 4800 }), 4800);
+}
+
+TEST(modem, postprocess_matches_preemphasis_gain)
+{
+    std::vector<double> audio_buffer;
+
+    dds_afsk_modulator modulator(1200.0, 2200.0, 1200, 48000, 0.3);
+
+    for (uint8_t bit : generate_random_bits(1000))
+    {
+        for (int i = 0; i < modulator.samples_per_bit(); ++i)
+        {
+            audio_buffer.push_back(modulator.modulate(bit));
+        }
     }
 
+    for (double tau : { 75e-6, 750e-6 })
     {
-        std::vector<double> audio_buffer;
+        // Three pass chain
 
-        wav_audio_stream wav_stream("test.wav", false, 48'000);
+        std::vector<double> expected = audio_buffer;
+        apply_preemphasis(expected.begin(), expected.end(), 48000, tau);
+        apply_gain(expected.begin(), expected.end(), 0.3);
 
-        while (true)
+        // Fused kernel, in place
+
+        std::vector<double> fused = audio_buffer;
+        postprocess(fused.begin(), fused.end(), fused.begin(), 48000, true, tau, 0.3, false);
+
+        ASSERT_EQ(fused.size(), expected.size());
+        for (size_t i = 0; i < fused.size(); i++)
         {
-            std::vector<double> audio_samples(4096);
-            size_t read = wav_stream.read(audio_samples.data(), audio_samples.size());
-            if (read == 0) break;
-            audio_buffer.insert(audio_buffer.end(), audio_samples.begin(), audio_samples.begin() + read);
+            EXPECT_NEAR(fused[i], expected[i], 1e-12);
         }
 
-        dft_demodulator demodulator(1200.0, 2200.0, 1200, 48000);
-
-        std::vector<uint8_t> bitstream = demodulator.demodulate(audio_buffer);
+        // Fused kernel, converted to int16
 
-        basic_bitstream_converter_adapter bitstream_converter;
+        std::vector<int16_t> fused_int;
+        postprocess<int16_t>(audio_buffer.begin(), audio_buffer.end(), std::back_inserter(fused_int), 48000, true, tau, 0.3, false);
 
-        std::vector<aprs::router::packet> packets;
-        size_t read = 0;
-        size_t offset = 0;
-        aprs::router::packet packet;
-        while (offset < bitstream.size())
+        ASSERT_EQ(fused_int.size(), expected.size());
+        for (size_t i = 0; i < fused_int.size(); i++)
         {
-            if (bitstream_converter.try_decode(bitstream, offset, packet, read))
-            {
-                packets.push_back(packet);
-            }
-            if (read == 0) break; // No more data
-            offset += read;
+            EXPECT_NEAR(fused_int[i], expected[i] * 32767.0, 0.5 + 1e-9);
         }
-        wav_stream.close();
+    }
 
-        EXPECT_TRUE(packets.size() == 1);
-        EXPECT_TRUE(to_string(packets[0]) == "N0CALL-10>APZ001,WIDE1-1,WIDE2-2:Hello, APRS!");
+    // Soft clipping keeps the output within [-1, 1]
+
+    std::vector<double> clipped;
+    postprocess(audio_buffer.begin(), audio_buffer.end(), std::back_inserter(clipped), 48000, true, 750e-6, 4.0, true);
+
+    for (double sample : clipped)
+    {
+        EXPECT_LE(std::abs(sample), 1.0);
     }
 }
 
@@ -503,6 +3501,81 @@ TEST(bitstream, try_decode_basic_bitstream_offset)
     EXPECT_TRUE(packets.size() == 804);
 }
 
+TEST(il2p, encode_decode_bitstream)
+{
+    // Type 0 header, the path does not fit in a type 1 header
+    // Type 1 header, no path
+
+    std::vector<aprs::router::packet> packets = {
+        { "N0CALL-10", "APZ001", { "WIDE1-1", "WIDE2-2" }, "Hello, APRS!" },
+        { "N0CALL-10", "APZ001", {}, "Hello, APRS!" },
+        { "W7ION-5", "APRS", {}, std::string(600, 'x') }
+    };
+
+    for (bool max_fec : { false, true })
+    {
+        il2p_bitstream_converter_adapter converter(max_fec);
+
+        for (const auto& p : packets)
+        {
+            std::vector<uint8_t> bitstream = converter.encode(p, 4, 1);
+
+            aprs::router::packet p2;
+            size_t read = 0;
+
+            EXPECT_TRUE(converter.try_decode(bitstream, 0, p2, read));
+            EXPECT_TRUE(p == p2);
+            EXPECT_EQ(read, bitstream.size() - 8);
+
+            // Inverted polarity
+
+            for (auto& bit : bitstream)
+            {
+                bit ^= 1;
+            }
+
+            aprs::router::packet p3;
+
+            EXPECT_TRUE(converter.try_decode(bitstream, 0, p3, read));
+            EXPECT_TRUE(p == p3);
+        }
+    }
+}
+
+TEST(il2p, frame_size)
+{
+    // Type 1 header saves the AX.25 addresses, control, PID and CRC
+    // 3 sync bytes, 13 + 2 header bytes, 12 + 2 payload bytes
+
+    aprs::router::packet p = { "N0CALL-10", "APZ001", {}, "Hello, APRS!" };
+
+    std::vector<uint8_t> frame = encode_il2p_frame(p, false);
+
+    EXPECT_EQ(frame.size(), 32);
+
+    // Type 0 header, 3 sync bytes, 13 + 2 header bytes, 42 + 2 payload bytes
+
+    p.path = { "WIDE1-1", "WIDE2-2" };
+
+    frame = encode_il2p_frame(p, false);
+
+    EXPECT_EQ(frame.size(), 62);
+}
+
+TEST(bitstream, il2p_scramble_descramble)
+{
+    std::vector<uint8_t> bytes = { 0x00, 0x00, 0xFF, 0x55, 0x7E, 0x12, 0x34, 0x00, 0x00, 0x00 };
+
+    std::vector<uint8_t> scrambled = bytes;
+    il2p_scramble(scrambled.begin(), scrambled.end());
+
+    EXPECT_TRUE(scrambled != bytes);
+
+    il2p_descramble(scrambled.begin(), scrambled.end());
+
+    EXPECT_TRUE(scrambled == bytes);
+}
+
 TEST(bitstream, nrzi_encode)
 {
     {
@@ -0,0 +1,266 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// wav_file.cpp
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "wav_file.h"
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// wav_info                                                         //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+namespace
+{
+    uint16_t read_u16(const uint8_t* p)
+    {
+        return static_cast<uint16_t>(p[0] | (p[1] << 8));
+    }
+
+    uint32_t read_u32(const uint8_t* p)
+    {
+        return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+}
+
+bool parse_wav_header(const uint8_t* data, size_t size, wav_info& info)
+{
+    // RIFF <size> WAVE, then chunks: <id> <size> <payload, padded to even size>
+
+    if (size < 12 || std::memcmp(data, "RIFF", 4) != 0 || std::memcmp(data + 8, "WAVE", 4) != 0)
+    {
+        return false;
+    }
+
+    bool have_format = false;
+    int bits_per_sample = 0;
+    uint16_t format_tag = 0;
+
+    size_t pos = 12;
+
+    while (pos + 8 <= size)
+    {
+        const uint8_t* chunk = data + pos;
+        size_t chunk_size = read_u32(chunk + 4);
+        size_t payload = pos + 8;
+
+        if (std::memcmp(chunk, "fmt ", 4) == 0)
+        {
+            if (chunk_size < 16 || payload + chunk_size > size)
+            {
+                return false;
+            }
+
+            format_tag = read_u16(data + payload);
+            info.channels = read_u16(data + payload + 2);
+            info.sample_rate = static_cast<int>(read_u32(data + payload + 4));
+            info.block_align = read_u16(data + payload + 12);
+            bits_per_sample = read_u16(data + payload + 14);
+
+            // WAVE_FORMAT_EXTENSIBLE, the real format is the first two bytes of the sub format GUID
+
+            if (format_tag == 0xFFFE && chunk_size >= 40)
+            {
+                format_tag = read_u16(data + payload + 24);
+            }
+
+            have_format = true;
+        }
+        else if (std::memcmp(chunk, "data", 4) == 0)
+        {
+            if (!have_format || info.channels <= 0 || info.sample_rate <= 0)
+            {
+                return false;
+            }
+
+            if (format_tag == 1 && bits_per_sample == 16)
+            {
+                info.format = wav_sample_format::int16;
+            }
+            else if (format_tag == 1 && bits_per_sample == 24)
+            {
+                info.format = wav_sample_format::int24;
+            }
+            else if (format_tag == 3 && bits_per_sample == 32)
+            {
+                info.format = wav_sample_format::float32;
+            }
+            else
+            {
+                return false;
+            }
+
+            // A frame must hold a sample for every channel, readers step by block_align
+
+            if (info.block_align < static_cast<size_t>(info.channels) * (bits_per_sample / 8))
+            {
+                return false;
+            }
+
+            size_t available = size - payload;
+            if (chunk_size == 0 || chunk_size == 0xFFFFFFFF || chunk_size > available)
+            {
+                chunk_size = available;
+            }
+
+            info.data_offset = payload;
+            info.frames = chunk_size / info.block_align;
+
+            return true;
+        }
+
+        pos = payload + chunk_size + (chunk_size & 1);
+    }
+
+    return false;
+}
+
+void read_wav_samples(const uint8_t* data, const wav_info& info, size_t frame, size_t count, double* samples)
+{
+    // memcpy keeps the loads legal for any alignment, the loops stay simple enough to vectorize
+    // for mono files, where the frames are contiguous
+
+    const uint8_t* p = data + info.data_offset + frame * info.block_align;
+    const size_t stride = info.block_align;
+
+    switch (info.format)
+    {
+    case wav_sample_format::int16:
+        for (size_t i = 0; i < count; i++)
+        {
+            int16_t s;
+            std::memcpy(&s, p + i * stride, sizeof(s));
+            samples[i] = s * (1.0 / 32768.0);
+        }
+        break;
+    case wav_sample_format::int24:
+        for (size_t i = 0; i < count; i++)
+        {
+            const uint8_t* b = p + i * stride;
+            int32_t s = static_cast<int32_t>((static_cast<uint32_t>(b[0]) << 8) | (static_cast<uint32_t>(b[1]) << 16) | (static_cast<uint32_t>(b[2]) << 24)) >> 8;
+            samples[i] = s * (1.0 / 8388608.0);
+        }
+        break;
+    case wav_sample_format::float32:
+        for (size_t i = 0; i < count; i++)
+        {
+            float s;
+            std::memcpy(&s, p + i * stride, sizeof(s));
+            samples[i] = s;
+        }
+        break;
+    }
+}
+
+size_t wav_bytes_per_sample(wav_sample_format format)
+{
+    switch (format)
+    {
+    case wav_sample_format::int16:
+        return 2;
+    case wav_sample_format::int24:
+        return 3;
+    case wav_sample_format::float32:
+        return 4;
+    }
+    return 2;
+}
+
+void write_wav_header(uint8_t* data, int sample_rate, int channels, wav_sample_format format, size_t frames)
+{
+    auto put_u16 = [](uint8_t* p, uint16_t v) {
+        p[0] = static_cast<uint8_t>(v);
+        p[1] = static_cast<uint8_t>(v >> 8);
+    };
+
+    auto put_u32 = [](uint8_t* p, uint32_t v) {
+        p[0] = static_cast<uint8_t>(v);
+        p[1] = static_cast<uint8_t>(v >> 8);
+        p[2] = static_cast<uint8_t>(v >> 16);
+        p[3] = static_cast<uint8_t>(v >> 24);
+    };
+
+    const size_t bytes_per_sample = wav_bytes_per_sample(format);
+    const uint32_t block_align = static_cast<uint32_t>(bytes_per_sample * channels);
+    const uint32_t data_size = static_cast<uint32_t>(frames * block_align);
+
+    std::memcpy(data, "RIFF", 4);
+    put_u32(data + 4, 36 + data_size);
+    std::memcpy(data + 8, "WAVE", 4);
+    std::memcpy(data + 12, "fmt ", 4);
+    put_u32(data + 16, 16);
+    put_u16(data + 20, format == wav_sample_format::float32 ? 3 : 1);
+    put_u16(data + 22, static_cast<uint16_t>(channels));
+    put_u32(data + 24, static_cast<uint32_t>(sample_rate));
+    put_u32(data + 28, static_cast<uint32_t>(sample_rate) * block_align);
+    put_u16(data + 32, static_cast<uint16_t>(block_align));
+    put_u16(data + 34, static_cast<uint16_t>(bytes_per_sample * 8));
+    std::memcpy(data + 36, "data", 4);
+    put_u32(data + 40, data_size);
+}
+
+void write_wav_samples(uint8_t* data, wav_sample_format format, const double* samples, size_t count)
+{
+    switch (format)
+    {
+    case wav_sample_format::int16:
+        for (size_t i = 0; i < count; i++)
+        {
+            double x = (std::max)(-1.0, (std::min)(1.0, samples[i]));
+            int16_t s = static_cast<int16_t>(std::lround(x * 32767.0));
+            std::memcpy(data + i * 2, &s, sizeof(s));
+        }
+        break;
+    case wav_sample_format::int24:
+        for (size_t i = 0; i < count; i++)
+        {
+            double x = (std::max)(-1.0, (std::min)(1.0, samples[i]));
+            int32_t s = static_cast<int32_t>(std::lround(x * 8388607.0));
+            data[i * 3] = static_cast<uint8_t>(s);
+            data[i * 3 + 1] = static_cast<uint8_t>(s >> 8);
+            data[i * 3 + 2] = static_cast<uint8_t>(s >> 16);
+        }
+        break;
+    case wav_sample_format::float32:
+        for (size_t i = 0; i < count; i++)
+        {
+            float s = static_cast<float>((std::max)(-1.0, (std::min)(1.0, samples[i])));
+            std::memcpy(data + i * 4, &s, sizeof(s));
+        }
+        break;
+    }
+}
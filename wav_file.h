@@ -0,0 +1,83 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// wav_file.h
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// wav_info                                                         //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+enum class wav_sample_format
+{
+    int16,
+    int24,
+    float32
+};
+
+struct wav_info
+{
+    int sample_rate = 0;
+    int channels = 0;
+    wav_sample_format format = wav_sample_format::int16;
+    size_t block_align = 0;      // Bytes per frame, all channels
+    size_t data_offset = 0;      // Start of the samples in the file
+    size_t frames = 0;           // Samples per channel
+};
+
+// Parses the RIFF header of a WAV file held in memory, ex: a mapped file
+// PCM 16 and 24 bit, and 32 bit float, plain or WAVE_FORMAT_EXTENSIBLE
+// A data chunk with an unknown size, left by an interrupted recording,
+// runs to the end of the file
+
+bool parse_wav_header(const uint8_t* data, size_t size, wav_info& info);
+
+// Converts count frames starting at frame to doubles in [-1, 1], first channel only
+
+void read_wav_samples(const uint8_t* data, const wav_info& info, size_t frame, size_t count, double* samples);
+
+// Writing, 44 byte canonical header, PCM or IEEE float, data follows the header
+
+constexpr size_t wav_header_size = 44;
+
+size_t wav_bytes_per_sample(wav_sample_format format);
+void write_wav_header(uint8_t* data, int sample_rate, int channels, wav_sample_format format, size_t frames);
+
+// Converts count mono samples, clamped to [-1, 1]
+
+void write_wav_samples(uint8_t* data, wav_sample_format format, const double* samples, size_t count);
@@ -0,0 +1,180 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// work_stealing_pool.cpp
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include "work_stealing_pool.h"
+
+#include <algorithm>
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// work_stealing_pool                                               //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+work_stealing_pool::work_stealing_pool(size_t threads)
+{
+    if (threads == 0)
+    {
+        threads = (std::max)(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < threads; i++)
+    {
+        queues_.push_back(std::make_unique<task_queue>());
+    }
+
+    for (size_t i = 0; i < threads; i++)
+    {
+        workers_.emplace_back([this, i]() { run(i); });
+    }
+}
+
+work_stealing_pool::~work_stealing_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+
+    work_available_.notify_all();
+
+    for (std::thread& worker : workers_)
+    {
+        worker.join();
+    }
+}
+
+void work_stealing_pool::submit(std::function<void()> task)
+{
+    pending_++;
+
+    // Counted before the task is queued, under the pool mutex, a worker going
+    // to sleep either sees the count or gets the notification
+
+    size_t index;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        index = next_queue_;
+        next_queue_ = (next_queue_ + 1) % queues_.size();
+        queued_++;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+        queues_[index]->tasks.push_back(std::move(task));
+    }
+
+    work_available_.notify_one();
+}
+
+void work_stealing_pool::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this]() { return pending_ == 0; });
+}
+
+size_t work_stealing_pool::threads() const
+{
+    return workers_.size();
+}
+
+uint64_t work_stealing_pool::steals() const
+{
+    return steals_;
+}
+
+void work_stealing_pool::run(size_t index)
+{
+    std::function<void()> task;
+
+    while (true)
+    {
+        if (try_pop(index, task))
+        {
+            task();
+            task = nullptr;
+
+            if (--pending_ == 0)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                idle_.notify_all();
+            }
+
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        work_available_.wait(lock, [this]() { return stop_ || queued_ > 0; });
+
+        if (stop_ && queued_ == 0)
+        {
+            return;
+        }
+    }
+}
+
+bool work_stealing_pool::try_pop(size_t index, std::function<void()>& task)
+{
+    // Own queue first, newest task, still warm in the cache
+
+    {
+        task_queue& own = *queues_[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued_--;
+            return true;
+        }
+    }
+
+    // Steal the oldest task of the next busy worker
+
+    for (size_t i = 1; i < queues_.size(); i++)
+    {
+        task_queue& other = *queues_[(index + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.tasks.empty())
+        {
+            task = std::move(other.tasks.front());
+            other.tasks.pop_front();
+            queued_--;
+            steals_++;
+            return true;
+        }
+    }
+
+    return false;
+}
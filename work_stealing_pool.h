@@ -0,0 +1,93 @@
+// **************************************************************** //
+// modem - APRS modem                                               // 
+// Version 0.1.0                                                    //
+// https://github.com/iontodirel/modem                              //
+// Copyright (c) 2025 Ion Todirel                                   //
+// **************************************************************** //
+//
+// work_stealing_pool.h
+//
+// MIT License
+//
+// Copyright (c) 2025 Ion Todirel
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// **************************************************************** //
+//                                                                  //
+//                                                                  //
+// work_stealing_pool                                               //
+//                                                                  //
+//                                                                  //
+// **************************************************************** //
+
+// Thread pool with one task queue per worker
+//
+// Tasks are dealt round robin, a worker runs its own queue newest first,
+// and when it runs dry steals the oldest task of another worker
+// Uneven tasks, ex: a segment with many frames, do not leave cores idle
+
+struct work_stealing_pool
+{
+    explicit work_stealing_pool(size_t threads = 0);
+    work_stealing_pool(const work_stealing_pool&) = delete;
+    work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+    ~work_stealing_pool();
+
+    void submit(std::function<void()> task);
+    void wait();
+
+    size_t threads() const;
+    uint64_t steals() const;
+
+private:
+    struct task_queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void run(size_t index);
+    bool try_pop(size_t index, std::function<void()>& task);
+
+    std::vector<std::unique_ptr<task_queue>> queues_;
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable work_available_;
+    std::condition_variable idle_;
+    std::atomic<size_t> queued_ { 0 };   // Tasks waiting in the queues
+    std::atomic<size_t> pending_ { 0 };  // Tasks submitted and not finished
+    std::atomic<uint64_t> steals_ { 0 };
+    size_t next_queue_ = 0;              // Round robin position, guarded by mutex_
+    bool stop_ = false;                  // Guarded by mutex_
+};